@@ -1,25 +1,38 @@
 #include "stdafx.h"
 
 #include "cpuid/cpuid.hpp"
+#include "cpuid/expression.hpp"
+#include "cpuid/export.hpp"
+#include "cpuid/placement.hpp"
+#include "cpuid/sink.hpp"
 #include "docopt/docopt.hpp"
 
 static const char usage_message[] =
 R"(cpuid.
 
 Usage:
-	cpuid [--read-dump <filename>] [--read-format <format>] [--all-cpus | --cpu <id>] [--ignore-vendor] [--ignore-feature-bits] [--brute-force] [--raw] [--write-dump <filename>] [--write-format <format>] [--single-value <spec> | --single-leaf <leaf>] [--no-topology | --only-topology]
+	cpuid [--read-dump <filename>] [--read-format <format>] [--all-cpus | --diff-cpus | --cpu <id>] [--ignore-vendor] [--ignore-feature-bits] [--brute-force] [--raw] [--write-dump <filename>] [--write-format <format>] [--baseline <filename>] [--single-value <spec>... | --spec-file <filename> | --single-leaf <leaf> | --require <expression>] [--value-format <format>] [--format <format>] [--topology-style <style>] [--no-topology | --only-topology] [--prefer-sysfs-caches]
 	cpuid --list-ids [--read-dump <filename>] [--read-format <format>]
+	cpuid --check-caches
+	cpuid --export-placement <kind> [--placement-domain <domain>] [--no-smt-siblings] [--core-type <type>] [--apic-ids] [--prefer-sysfs-caches] [--read-dump <filename>] [--read-format <format>]
+	cpuid --export-table <table> [--table-format <format>] [--read-format <format>] <dump>...
+	cpuid --diff [--read-format <format>] <before> <after>
 	cpuid --help
 	cpuid --version
 
 Input options:
 	--read-dump=<filename>     Read from <filename> rather than the current processors
-	--read-format=<format>     Dump format to read: native, etallen, libcpuid, aida64. [default: native]
+	--read-format=<format>     Dump format to read: native, folded, delta, etallen, libcpuid, aida64. delta needs --baseline. [default: native]
 	--all-cpus                 Show output from every CPU
+	--diff-cpus                Show leaves shared by every CPU once, then only the leaves that differ, with the CPUs for each value
 	--cpu <id>                 Show output from CPU with APIC ID <id>
 	--single-value <spec>      Print specific flag value, using Intel syntax (e.g. CPUID.01H.EDX.SSE[bit 25]).
 	                           Handles most of the wild inconsistencies found in Intel's documentation.
+	                           May be repeated to print several values at once.
+	--spec-file=<filename>     Print the flag value of every spec in <filename>, one per line. - reads from stdin
 	--single-leaf <leaf>       Print specific leaf
+	--require <expression>     Check each CPU against a requirement such as "AVX2 && (VAES || !AVX512F) && L3 >= 8M".
+	                           The exit status is non-zero if any CPU falls short.
 	--ignore-vendor            Ignore vendor constraints
 	--ignore-feature-bits      Ignore feature bit constraints
 	--brute-force              Ignore constraints, and enumerate even reserved leaves
@@ -27,10 +40,28 @@ Input options:
 Output options:
 	--raw                      Write unparsed output to screen
 	--write-dump=<filename>    Write unparsed output to <filename>
-	--write-format=<format>    Dump format to write: native, etallen, libcpuid, aida64, cpuinfo. [default: native]
+	--write-format=<format>    Dump format to write: native, folded, etallen, libcpuid, aida64, cpuinfo, hwloc-xml. [default: native]
+	                           hwloc-xml numbers PUs as the OS does; when the dump doesn't record that, they're numbered in
+	                           APIC ID order, and the Machine gets a CPUIDUnbound info attribute saying they can't be bound to
+	--baseline=<filename>      The native dump that deltas are taken against. With --write-dump, writes a delta, unless reading one
 	--no-topology              Don't print the processor and cache topology
 	--only-topology            Only print the processor and cache topology
-	--list-ids                 List all core IDs
+	--value-format=<format>    Format for flag values: text, table, csv. [default: text]
+	--format=<format>          Format for leaves and topology: text, json. [default: text]
+	--topology-style=<style>   Text topology: auto, bars, ranges, folded. auto uses bars for up to 64 CPUs, and ranges beyond. [default: auto]
+	--list-ids                 List the APIC ID and OS CPU number of every CPU, with - for unknown OS numbers
+	--check-caches             Compare the caches of the current processors with Linux's sysfs, and list where they disagree.
+	                           The exit status is non-zero if they disagree anywhere
+	--prefer-sysfs-caches      Use Linux's sysfs for the caches that it and CPUID disagree about. Ignored when reading a dump
+	--export-placement=<kind>  Write CPU lists for each domain, ready to use: taskset, cpuset, omp, dpdk. CPUs are numbered as the OS does,
+	                           so a dump that doesn't record the OS numbers can't be exported without --apic-ids
+	--placement-domain=<domain>  Domains to export placements for: machine, package, l3. [default: l3]
+	--no-smt-siblings          Leave out every thread but the first of each physical core
+	--core-type=<type>         Only export the cores of one type on hybrid parts: all, core, atom. [default: all]
+	--apic-ids                 Export APIC IDs when the OS numbers aren't known, under a warning; affinity tools will misread them
+	--export-table=<table>     Write a table with a host for each <dump>: leaves, features, machines
+	--table-format=<format>    Format for exported tables: csv, arrow. arrow is an Arrow IPC stream with a record batch per host [default: csv]
+	--diff                     Show the CPUs, leaves, feature bits, and caches that differ between two dumps
 
 Other options:
 	--help                     Show this text
@@ -44,6 +75,18 @@ aida64 is dumped by aida64 (https://www.aida64.com)
 
 static const char version[] = "cpuid 0.1";
 
+static std::map<std::uint32_t, cpuid::cpu_t> read_dump_file(const std::string& filename, cpuid::file_format format) {
+	std::ifstream fin(filename);
+	if(!fin) {
+		throw std::runtime_error(fmt::format("Could not open {:s} for input", filename));
+	}
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, format);
+	if(logical_cpus.empty()) {
+		throw std::runtime_error(fmt::format("No processors found in {:s}", filename));
+	}
+	return logical_cpus;
+}
+
 int main(int argc, char* argv[]) try {
 #if defined(_WIN32)
 	HANDLE output = ::GetStdHandle(STD_OUTPUT_HANDLE);
@@ -55,35 +98,92 @@ int main(int argc, char* argv[]) try {
 	::SetConsoleOutputCP(CP_UTF8);
 #endif
 
-	std::cout.rdbuf()->pubsetbuf(nullptr, 10240);
-
-	const std::map<std::string, docopt::value> args = docopt::docopt_parse(usage_message, { argv + 1, argv + argc }, true, true);
+	const std::shared_ptr<const docopt::grammar> usage_grammar = docopt::compile(usage_message);
+	const std::map<std::string, docopt::value> args = docopt::docopt_parse(*usage_grammar, { argv + 1, argv + argc }, true, true);
 	const bool skip_vendor_check  = std::get<bool>(args.at("--ignore-vendor"));
 	const bool skip_feature_check = std::get<bool>(args.at("--ignore-feature-bits"));
 	const bool raw_dump           = std::get<bool>(args.at("--raw"));
 	const bool all_cpus           = std::get<bool>(args.at("--all-cpus"));
+	const bool diff_cpus          = std::get<bool>(args.at("--diff-cpus"));
 	const bool list_ids           = std::get<bool>(args.at("--list-ids"));
 	const bool brute_force        = std::get<bool>(args.at("--brute-force"));
 	const bool no_topology        = std::get<bool>(args.at("--no-topology"));
 	const bool only_topology      = std::get<bool>(args.at("--only-topology"));
 
-	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus;
-	if(std::holds_alternative<std::string>(args.at("--read-dump"))) {
-		cpuid::file_format format = cpuid::file_format::native;
+	cpuid::file_format read_format = cpuid::file_format::native;
+	bool read_delta = false;
+	{
 		const std::string format_name = boost::to_lower_copy(std::get<std::string>(args.at("--read-format")));
 		if("native" == format_name) {
-			format = cpuid::file_format::native;
+			read_format = cpuid::file_format::native;
 		} else if("etallen" == format_name) {
-			format = cpuid::file_format::etallen;
+			read_format = cpuid::file_format::etallen;
 		} else if("libcpuid" == format_name) {
-			format = cpuid::file_format::libcpuid;
+			read_format = cpuid::file_format::libcpuid;
 		} else if("aida64" == format_name) {
-			format = cpuid::file_format::aida64;
+			read_format = cpuid::file_format::aida64;
 		} else if("cpuinfo" == format_name) {
-			format = cpuid::file_format::cpuinfo;
+			read_format = cpuid::file_format::cpuinfo;
+		} else if("folded" == format_name) {
+			read_format = cpuid::file_format::folded;
+		} else if("delta" == format_name) {
+			read_delta = true;
 		} else {
 			throw std::runtime_error(fmt::format("unknown input format {:s}", format_name));
 		}
+	}
+
+	if(std::holds_alternative<std::string>(args.at("--export-table"))) {
+		cpuid::export_table table = cpuid::export_table::leaves;
+		const std::string table_name = boost::to_lower_copy(std::get<std::string>(args.at("--export-table")));
+		if("leaves" == table_name) {
+			table = cpuid::export_table::leaves;
+		} else if("features" == table_name) {
+			table = cpuid::export_table::features;
+		} else if("machines" == table_name) {
+			table = cpuid::export_table::machines;
+		} else {
+			throw std::runtime_error(fmt::format("unknown table {:s}", table_name));
+		}
+		cpuid::table_format format = cpuid::table_format::csv;
+		const std::string table_format_name = boost::to_lower_copy(std::get<std::string>(args.at("--table-format")));
+		if("csv" == table_format_name) {
+			format = cpuid::table_format::csv;
+		} else if("arrow" == table_format_name) {
+			format = cpuid::table_format::arrow;
+		} else {
+			throw std::runtime_error(fmt::format("unknown table format {:s}", table_format_name));
+		}
+		cpuid::output_sink_t sink;
+		cpuid::table_exporter_t exporter(sink, table, format);
+		for(const std::string& filename : std::get<std::vector<std::string>>(args.at("<dump>"))) {
+			exporter.add_host(std::filesystem::path(filename).stem().string(), read_dump_file(filename, read_format));
+		}
+		exporter.finish();
+		sink.flush();
+		return EXIT_SUCCESS;
+	}
+
+	if(std::get<bool>(args.at("--diff"))) {
+		const std::map<std::uint32_t, cpuid::cpu_t> before = read_dump_file(std::get<std::string>(args.at("<before>")), read_format);
+		const std::map<std::uint32_t, cpuid::cpu_t> after  = read_dump_file(std::get<std::string>(args.at("<after>")) , read_format);
+		cpuid::output_sink_t sink;
+		cpuid::print_dump_diff(sink.buffer(), before, after);
+		sink.flush();
+		return EXIT_SUCCESS;
+	}
+
+	std::map<std::uint32_t, cpuid::cpu_t> baseline;
+	const bool use_baseline = std::holds_alternative<std::string>(args.at("--baseline"));
+	if(read_delta && !use_baseline) {
+		throw std::runtime_error("A delta dump needs --baseline");
+	}
+	if(use_baseline) {
+		baseline = read_dump_file(std::get<std::string>(args.at("--baseline")), cpuid::file_format::native);
+	}
+
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus;
+	if(std::holds_alternative<std::string>(args.at("--read-dump"))) {
 		const std::string filename = std::get<std::string>(args.at("--read-dump"));
 		std::ifstream fin;
 		if(filename != "-") {
@@ -92,7 +192,11 @@ int main(int argc, char* argv[]) try {
 				throw std::runtime_error(fmt::format("Could not open {:s} for input", filename));
 			}
 		}
-		logical_cpus = cpuid::enumerate_file(filename != "-" ? fin : std::cin, format);
+		if(read_delta) {
+			logical_cpus = cpuid::enumerate_file(filename != "-" ? fin : std::cin, baseline);
+		} else {
+			logical_cpus = cpuid::enumerate_file(filename != "-" ? fin : std::cin, read_format);
+		}
 	} else {
 		logical_cpus = cpuid::enumerate_processors(brute_force, skip_vendor_check, skip_feature_check);
 	}
@@ -101,12 +205,88 @@ int main(int argc, char* argv[]) try {
 		throw std::runtime_error("No processors found, which is implausible.");
 	}
 
+	// NUMA nodes come from the OS, so only the live processors have them
+	const bool live = !std::holds_alternative<std::string>(args.at("--read-dump"));
+	const bool prefer_sysfs_caches = std::get<bool>(args.at("--prefer-sysfs-caches"));
+	const auto make_topology = [&logical_cpus, live, prefer_sysfs_caches] () {
+		cpuid::system_t machine = build_topology(logical_cpus);
+		// sub-NUMA domains are found from the L3s, so sysfs's caches have to be in place first
+		if(live && prefer_sysfs_caches) {
+			cpuid::check_sysfs_caches(machine, "/sys", true);
+		}
+		if(live && std::filesystem::is_directory("/sys/devices/system/node")) {
+			cpuid::add_numa_nodes(machine, "/sys");
+		}
+		return machine;
+	};
+
 	if(list_ids) {
-		fmt::memory_buffer out;
+		cpuid::output_sink_t sink;
 		for(const auto& p : logical_cpus) {
-			format_to(out, "{:#04x}\n", p.first);
+			if(p.second.os_index != cpuid::unknown_id) {
+				format_to(sink.buffer(), "{:#04x} {:d}\n", p.first, p.second.os_index);
+			} else {
+				format_to(sink.buffer(), "{:#04x} -\n", p.first);
+			}
+			sink.commit();
+		}
+		sink.flush();
+		return EXIT_SUCCESS;
+	}
+
+	if(std::get<bool>(args.at("--check-caches"))) {
+		if(!std::filesystem::is_directory("/sys/devices/system/cpu")) {
+			throw std::runtime_error("--check-caches needs Linux's sysfs");
 		}
-		std::cout << to_string(out) << std::flush;
+		cpuid::system_t machine = build_topology(logical_cpus);
+		const std::vector<cpuid::cache_disagreement_t> disagreements = cpuid::check_sysfs_caches(machine, "/sys", false);
+		cpuid::output_sink_t sink;
+		for(const cpuid::cache_disagreement_t& d : disagreements) {
+			format_to(sink.buffer(), "L{:d} {:s}: {:s}\n", d.level, d.type == 1_u32 ? "data" : d.type == 2_u32 ? "instruction" : "unified", d.description);
+		}
+		sink.flush();
+		return disagreements.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if(std::holds_alternative<std::string>(args.at("--export-placement"))) {
+		cpuid::placement_export kind = cpuid::placement_export::taskset;
+		const std::string kind_name = boost::to_lower_copy(std::get<std::string>(args.at("--export-placement")));
+		if("taskset" == kind_name) {
+			kind = cpuid::placement_export::taskset;
+		} else if("cpuset" == kind_name) {
+			kind = cpuid::placement_export::cpuset;
+		} else if("omp" == kind_name) {
+			kind = cpuid::placement_export::omp;
+		} else if("dpdk" == kind_name) {
+			kind = cpuid::placement_export::dpdk;
+		} else {
+			throw std::runtime_error(fmt::format("unknown placement kind {:s}", kind_name));
+		}
+		cpuid::placement_domain domain = cpuid::placement_domain::l3;
+		const std::string domain_name = boost::to_lower_copy(std::get<std::string>(args.at("--placement-domain")));
+		if("machine" == domain_name) {
+			domain = cpuid::placement_domain::machine;
+		} else if("package" == domain_name) {
+			domain = cpuid::placement_domain::package;
+		} else if("l3" == domain_name) {
+			domain = cpuid::placement_domain::l3;
+		} else {
+			throw std::runtime_error(fmt::format("unknown placement domain {:s}", domain_name));
+		}
+		cpuid::hybrid_core_type only_type = cpuid::hybrid_core_type::none;
+		const std::string type_name = boost::to_lower_copy(std::get<std::string>(args.at("--core-type")));
+		if("all" == type_name) {
+			only_type = cpuid::hybrid_core_type::none;
+		} else if("core" == type_name) {
+			only_type = cpuid::hybrid_core_type::core;
+		} else if("atom" == type_name) {
+			only_type = cpuid::hybrid_core_type::atom;
+		} else {
+			throw std::runtime_error(fmt::format("unknown core type {:s}", type_name));
+		}
+		cpuid::output_sink_t sink;
+		cpuid::print_placement(sink.buffer(), make_topology(), kind, domain, std::get<bool>(args.at("--no-smt-siblings")), only_type, std::get<bool>(args.at("--apic-ids")));
+		sink.flush();
 		return EXIT_SUCCESS;
 	}
 
@@ -123,6 +303,10 @@ int main(int argc, char* argv[]) try {
 			format = cpuid::file_format::aida64;
 		} else if("cpuinfo" == format_name) {
 			format = cpuid::file_format::cpuinfo;
+		} else if("folded" == format_name) {
+			format = cpuid::file_format::folded;
+		} else if("hwloc-xml" == format_name) {
+			format = cpuid::file_format::hwloc_xml;
 		} else {
 			throw std::runtime_error(fmt::format("unknown output format {:s}", format_name));
 		}
@@ -130,22 +314,23 @@ int main(int argc, char* argv[]) try {
 		if(std::holds_alternative<std::string>(args.at("--write-dump"))) {
 			filename = std::get<std::string>(args.at("--write-dump"));
 		}
-		std::ofstream fout;
-		if(filename != "-") {
-			fout.open(filename);
-			if(!fout) {
-				throw std::runtime_error(fmt::format("Could not open {:s} for output", filename));
-			}
+		cpuid::output_sink_t sink(filename);
+		if(use_baseline && !read_delta) {
+			cpuid::print_delta_dump(sink.buffer(), baseline, logical_cpus);
+			sink.flush();
+		} else if(format == cpuid::file_format::hwloc_xml) {
+			// print_dump can't see the OS's NUMA nodes
+			cpuid::print_hwloc_xml(sink.buffer(), make_topology());
+			sink.flush();
+		} else {
+			print_dump(sink, logical_cpus, format);
 		}
-		fmt::memory_buffer out;
-		print_dump(out, logical_cpus, format);
-		(filename != "-" ? fout : std::cout) << to_string(out) << std::flush;
 		return EXIT_SUCCESS;
 	}
 
 	std::vector<std::uint32_t> chosen_ids;
 
-	if(all_cpus) {
+	if(all_cpus || diff_cpus) {
 		for(const auto& p : logical_cpus) {
 			chosen_ids.push_back(p.second.apic_id);
 		}
@@ -158,46 +343,114 @@ int main(int argc, char* argv[]) try {
 		chosen_ids.push_back(chosen_id);
 	}
 
-	if(std::holds_alternative<std::string>(args.at("--single-value"))) {
-		const std::string flag_spec_raw = std::get<std::string>(args.at("--single-value"));
-		const cpuid::flag_spec_t flag_spec = cpuid::parse_flag_spec(flag_spec_raw);
-		for(const std::uint32_t chosen_id : chosen_ids) {
-			const cpuid::cpu_t& cpu = logical_cpus.at(chosen_id);
-			fmt::memory_buffer out;
-			cpuid::print_single_flag(out, cpu, flag_spec);
-			std::cout << to_string(out) << std::flush;
+	std::vector<std::string> flag_specs_raw = std::get<std::vector<std::string>>(args.at("--single-value"));
+	if(std::holds_alternative<std::string>(args.at("--spec-file"))) {
+		const std::string filename = std::get<std::string>(args.at("--spec-file"));
+		std::ifstream fin;
+		if(filename != "-") {
+			fin.open(filename);
+			if(!fin) {
+				throw std::runtime_error(fmt::format("Could not open {:s} for input", filename));
+			}
 		}
+		std::istream& specs_in = filename != "-" ? fin : std::cin;
+		for(std::string line; std::getline(specs_in, line); ) {
+			boost::algorithm::trim(line);
+			if(line != "" && line[0] != '#') {
+				flag_specs_raw.push_back(line);
+			}
+		}
+	}
+
+	if(!flag_specs_raw.empty()) {
+		cpuid::value_format format = cpuid::value_format::text;
+		const std::string format_name = boost::to_lower_copy(std::get<std::string>(args.at("--value-format")));
+		if("text" == format_name) {
+			format = cpuid::value_format::text;
+		} else if("table" == format_name) {
+			format = cpuid::value_format::table;
+		} else if("csv" == format_name) {
+			format = cpuid::value_format::csv;
+		} else {
+			throw std::runtime_error(fmt::format("unknown value format {:s}", format_name));
+		}
+		std::vector<cpuid::flag_spec_t> flag_specs;
+		flag_specs.reserve(flag_specs_raw.size());
+		for(const std::string& flag_spec_raw : flag_specs_raw) {
+			flag_specs.push_back(cpuid::parse_flag_spec(flag_spec_raw));
+		}
+		cpuid::output_sink_t sink;
+		cpuid::print_flag_values(sink.buffer(), logical_cpus, chosen_ids, flag_specs, format);
+		sink.flush();
 		return EXIT_SUCCESS;
 	}
 
+	if(std::holds_alternative<std::string>(args.at("--require"))) {
+		const cpuid::expression_t requirement = cpuid::compile_expression(std::get<std::string>(args.at("--require")));
+		const cpuid::system_t machine = make_topology();
+		std::vector<cpuid::expression_lane_t> lanes;
+		for(const std::uint32_t chosen_id : chosen_ids) {
+			lanes.push_back({ &logical_cpus.at(chosen_id), &machine });
+		}
+		const std::vector<bool> results = cpuid::evaluate_expression(requirement, lanes);
+		cpuid::output_sink_t sink;
+		for(std::size_t i = 0; i < chosen_ids.size(); ++i) {
+			format_to(sink.buffer(), "cpu {:#04x} {:s}: {:s}\n", chosen_ids[i], requirement.source, results[i] ? "true" : "false");
+			sink.commit();
+		}
+		sink.flush();
+		return std::all_of(results.begin(), results.end(), [](bool b) { return b; }) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	if(std::holds_alternative<std::string>(args.at("--single-leaf"))) {
 		const cpuid::leaf_type leaf = gsl::narrow_cast<cpuid::leaf_type>(std::stoull(std::get<std::string>(args.at("--single-leaf")), nullptr, 16));
+		cpuid::output_sink_t sink;
 		for(const std::uint32_t chosen_id : chosen_ids) {
 			const cpuid::cpu_t& cpu = logical_cpus.at(chosen_id);
 			if(cpu.leaves.find(leaf) != cpu.leaves.end()) {
-				fmt::memory_buffer out;
-				cpuid::print_leaf(out, cpu, leaf, skip_vendor_check, skip_feature_check);
-				std::cout << to_string(out) << std::flush;
+				cpuid::print_leaf(sink.buffer(), cpu, leaf, skip_vendor_check, skip_feature_check);
+				sink.commit();
 			}
 		}
+		sink.flush();
 		return EXIT_SUCCESS;
 	}
 
+	const std::string output_format_name = boost::to_lower_copy(std::get<std::string>(args.at("--format")));
+	if("json" == output_format_name) {
+		const cpuid::system_t machine = make_topology();
+		cpuid::output_sink_t sink;
+		cpuid::print_json(sink, logical_cpus, only_topology ? std::vector<std::uint32_t>{} : chosen_ids, no_topology ? nullptr : &machine, skip_vendor_check, skip_feature_check);
+		return EXIT_SUCCESS;
+	} else if("text" != output_format_name) {
+		throw std::runtime_error(fmt::format("unknown output format {:s}", output_format_name));
+	}
+
+	cpuid::output_sink_t sink;
 	if(!only_topology) {
-		for(const std::uint32_t chosen_id : chosen_ids) {
-			const cpuid::cpu_t& cpu = logical_cpus.at(chosen_id);
-			fmt::memory_buffer out;
-			cpuid::print_leaves(out, cpu, skip_vendor_check, skip_feature_check);
-			std::cout << to_string(out) << std::flush;
+		if(diff_cpus) {
+			cpuid::print_leaf_differences(sink.buffer(), logical_cpus, chosen_ids, skip_vendor_check, skip_feature_check);
+		} else {
+			cpuid::print_leaves(sink, logical_cpus, chosen_ids, skip_vendor_check, skip_feature_check);
 		}
 	}
 
 	if(!no_topology) {
-		fmt::memory_buffer out;
-		cpuid::system_t machine = build_topology(logical_cpus);
-		cpuid::print_topology(out, machine);
-		std::cout << to_string(out) << std::flush;
+		cpuid::system_t machine = make_topology();
+		const std::string style_name = boost::to_lower_copy(std::get<std::string>(args.at("--topology-style")));
+		if("auto" == style_name) {
+			cpuid::print_topology(sink.buffer(), machine);
+		} else if("bars" == style_name) {
+			cpuid::print_topology(sink.buffer(), machine, cpuid::topology_style::bars, false);
+		} else if("ranges" == style_name) {
+			cpuid::print_topology(sink.buffer(), machine, cpuid::topology_style::ranges, false);
+		} else if("folded" == style_name) {
+			cpuid::print_topology(sink.buffer(), machine, cpuid::topology_style::ranges, true);
+		} else {
+			throw std::runtime_error(fmt::format("unknown topology style {:s}", style_name));
+		}
 	}
+	sink.flush();
 
 	return EXIT_SUCCESS;
 } catch(const docopt::exit_help&) {
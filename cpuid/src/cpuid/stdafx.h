@@ -116,6 +116,7 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <filesystem>
 #include <iomanip>
 #include <type_traits>
 #include <utility>
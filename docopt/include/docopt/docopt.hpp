@@ -12,6 +12,7 @@
 #define docopt__docopt_h_
 
 #include <map>
+#include <memory>
 #include <vector>
 #include <string>
 #include <variant>
@@ -101,6 +102,23 @@ namespace docopt {
 	                                                             bool version = true,
 	                                                             bool options_first = false);
 	
+	/// A usage string parsed into its pattern tree.
+	struct grammar;
+
+	/// Parse the usage string once, so that argument vectors can be matched against it without re-parsing it.
+	///
+	/// @throws language_error if the doc usage string had errors itself
+	std::shared_ptr<const grammar> DOCOPT_API compile(std::string const& doc);
+
+	/// Parse user options against a compiled usage string. The grammar is not modified, so may be reused.
+	///
+	/// @throws exit_help, exit_version, argument_error as for the overload taking the usage string
+	std::map<std::string, docopt::value> DOCOPT_API docopt_parse(grammar const& usage,
+	                                                             std::vector<std::string> const& argv,
+	                                                             bool help = true,
+	                                                             bool version = true,
+	                                                             bool options_first = false);
+	
 	/// Parse user options from the given string, and exit appropriately
 	///
 	/// Calls 'docopt_parse' and will terminate the program if any of the exceptions above occur:
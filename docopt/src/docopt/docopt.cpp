@@ -22,6 +22,7 @@
 #include "docopt_private.h"
 
 #include <vector>
+#include <cctype>
 #include <unordered_set>
 #include <unordered_map>
 #include <map>
@@ -42,46 +43,77 @@ namespace {
 		}
 
 		static Tokens from_pattern(std::string const& source) {
-			static const xp::sregex re_separators(xp::sregex::compile(
-				"(?:\\s*)" // any spaces (non-matching subgroup)
-				"("
-				"[\\[\\]\\(\\)\\|]" // one character of brackets or parens or pipe character
-				"|"
-				"\\.\\.\\."  // elipsis
-				")", xp::sregex::optimize));
-
-			static const xp::sregex re_strings(xp::sregex::compile(
-				"(?:\\s*)" // any spaces (non-matching subgroup)
-				"("
-				"\\S*<.*?>"  // strings, but make sure to keep "< >" strings together
-				"|"
-				"[^<>\\s]+"     // string without <>
-				")", xp::sregex::optimize));
-
-			// We do two stages of regex matching. The '[]()' and '...' are strong delimeters
-			// and need to be split out anywhere they occur (even at the end of a token). We
-			// first split on those, and then parse the stuff between them to find the string
-			// tokens. This is a little harder than the python version, since they have regex.split
-			// and we dont have anything like that.
-
+			// The '[]()|' and '...' are strong delimiters and are split out anywhere they occur (even at the
+			// end of a token). Between them are string tokens, separated by whitespace, except that "< >"
+			// strings are kept together. This used to be two passes of regex matching; scanning by hand
+			// avoids compiling the regexes every time a program starts.
 			std::vector<std::string> tokens;
-			std::for_each(xp::sregex_iterator(source.begin(), source.end(), re_separators),
-			              xp::sregex_iterator(),
-			              [&](xp::smatch const& match) {
-				// handle anything before the separator (this is the "stuff" between the delimiters)
-				if(match.prefix().matched) {
-					std::for_each(xp::sregex_iterator(match.prefix().first, match.prefix().second, re_strings),
-					              xp::sregex_iterator(),
-					              [&](xp::smatch const& m) {
-						tokens.push_back(m[1].str());
-					});
+			const auto is_space = [](char ch) noexcept {
+				return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\v' || ch == '\f';
+			};
+			const auto add_strings = [&](std::size_t pos, std::size_t end) {
+				while(pos < end) {
+					if(is_space(source[pos])) {
+						++pos;
+						continue;
+					}
+					std::size_t run_end = pos;
+					while(run_end < end && !is_space(source[run_end])) {
+						++run_end;
+					}
+					// \S*<.*?> : the last '<' in the run that has a '>' after it on the same line
+					bool bracketed = false;
+					for(std::size_t lt = run_end; lt-- > pos; ) {
+						if(source[lt] != '<') {
+							continue;
+						}
+						std::size_t gt = lt + 1;
+						while(gt < end && source[gt] != '>' && source[gt] != '\n') {
+							++gt;
+						}
+						if(gt < end && source[gt] == '>') {
+							tokens.push_back(source.substr(pos, gt + 1 - pos));
+							pos = gt + 1;
+							bracketed = true;
+							break;
+						}
+					}
+					if(bracketed) {
+						continue;
+					}
+					// [^<>\s]+
+					std::size_t plain_end = pos;
+					while(plain_end < end && !is_space(source[plain_end]) && source[plain_end] != '<' && source[plain_end] != '>') {
+						++plain_end;
+					}
+					if(plain_end == pos) {
+						++pos;
+					} else {
+						tokens.push_back(source.substr(pos, plain_end - pos));
+						pos = plain_end;
+					}
 				}
-
-				// handle the delimter token itself
-				if(match[1].matched) {
-					tokens.push_back(match[1].str());
+			};
+
+			std::size_t start = 0;
+			for(std::size_t pos = 0; pos < source.size(); ) {
+				const char ch = source[pos];
+				std::size_t length = 0;
+				if(ch == '[' || ch == ']' || ch == '(' || ch == ')' || ch == '|') {
+					length = 1;
+				} else if(source.compare(pos, 3, "...") == 0) {
+					length = 3;
 				}
-			});
+				if(length == 0) {
+					++pos;
+					continue;
+				}
+				add_strings(start, pos);
+				tokens.push_back(source.substr(pos, length));
+				pos += length;
+				start = pos;
+			}
+			add_strings(start, source.size());
 
 			return Tokens(tokens, false);
 		}
@@ -124,25 +156,33 @@ namespace {
 	};
 
 	std::vector<std::string> parse_section(std::string const& name, std::string const& source) {
-		// ECMAScript regex only has "?=" for a non-matching lookahead. In order to make sure we always have
-		// a newline to anchor our matching, we have to avoid matching the final newline of each grouping.
-		// Therefore, our regex is adjusted from the docopt Python one to use ?= to match the newlines before
-		// the following lines, rather than after.
-		xp::sregex const re_section_pattern(xp::sregex::compile(
-			//"(?:^|\\n)"  // anchored at a linebreak (or start of string)
-			"("
-			"[^\\n]*" + name + "[^\\n]*\n?" // a line that contains the name
-			"(?:[ \\t].*?(?:\\n|$))*" // followed by any number of lines that are indented
-			")",
-			xp::sregex::icase | xp::sregex::optimize
-		));
+		// A section is a line that contains the name (case-insensitively), followed by any number of lines that are
+		// indented. Equivalent to the regex "[^\n]*name[^\n]*\n?(?:[ \t].*?(?:\n|$))*", without the cost of compiling it.
+		const auto find_name = [&](std::size_t pos) {
+			const auto it = std::search(source.begin() + static_cast<std::ptrdiff_t>(pos), source.end(), name.begin(), name.end(), [](char lhs, char rhs) noexcept {
+				return std::tolower(static_cast<unsigned char>(lhs)) == std::tolower(static_cast<unsigned char>(rhs));
+			});
+			return it == source.end() ? std::string::npos : static_cast<std::size_t>(it - source.begin());
+		};
 
 		std::vector<std::string> ret;
-		std::for_each(xp::sregex_iterator(source.begin(), source.end(), re_section_pattern),
-		              xp::sregex_iterator(),
-		              [&](xp::smatch const& match) {
-			ret.push_back(trim(match[1].str()));
-		});
+		std::size_t pos = 0;
+		for(std::size_t found = find_name(pos); found != std::string::npos; found = find_name(pos)) {
+			const std::size_t line_start = found == 0 ? 0 : source.rfind('\n', found - 1);
+			const std::size_t begin = line_start == std::string::npos ? pos : std::max(pos, line_start + 1);
+
+			const auto next_line = [&](std::size_t from) {
+				const std::size_t newline = source.find('\n', from);
+				return newline == std::string::npos ? source.size() : newline + 1;
+			};
+			std::size_t end = next_line(found);
+			while(end < source.size() && (source[end] == ' ' || source[end] == '\t')) {
+				end = next_line(end);
+			}
+
+			ret.push_back(trim(source.substr(begin, end - begin)));
+			pos = end;
+		}
 
 		return ret;
 	}
@@ -492,21 +532,32 @@ namespace {
 	}
 
 	std::vector<std::shared_ptr<docopt::Option>> parse_defaults(std::string const& doc) {
-		// This pattern is a delimiter by which we split the options.
-		// The delimiter is a new line followed by a whitespace(s) followed by one or two hyphens.
-		static xp::sregex const re_delimiter(xp::sregex::compile(
-			"(?:^|\\n)[ \\t]*"  // a new line with leading whitespace
-			"(?=-{1,2})"        // [split happens here] (positive lookahead) ... and followed by one or two hyphes
-		));
-
 		std::vector<std::shared_ptr<docopt::Option>> defaults;
 		for(auto s : parse_section("options:", doc)) {
 			s.erase(s.begin(), s.begin() + static_cast<std::ptrdiff_t>(s.find(':')) + 1); // get rid of "options:"
 
-			for(const auto& opt : regex_split(s, re_delimiter)) {
-				if(starts_with(opt, "-")) {
-					defaults.emplace_back(docopt::Option::parse(opt));
+			// each option starts on a new line, with leading whitespace, followed by one or two hyphens;
+			// any other lines continue the previous option's description
+			std::vector<std::string> split_options;
+			std::size_t option_start = std::string::npos;
+			for(std::size_t line = 0; line < s.size(); ) {
+				std::size_t next = s.find('\n', line);
+				next = next == std::string::npos ? s.size() : next;
+				const std::size_t first = s.find_first_not_of(" \t", line);
+				if(first < next && s[first] == '-') {
+					if(option_start != std::string::npos) {
+						split_options.push_back(s.substr(option_start, line - 1 - option_start));
+					}
+					option_start = first;
 				}
+				line = next + 1;
+			}
+			if(option_start != std::string::npos) {
+				split_options.push_back(s.substr(option_start));
+			}
+
+			for(const auto& opt : split_options) {
+				defaults.emplace_back(docopt::Option::parse(opt));
 			}
 		}
 
@@ -573,22 +624,34 @@ namespace {
 
 namespace docopt {
 
-	DOCOPT_INLINE
-	std::map<std::string, docopt::value>
-	docopt_parse(std::string const& doc,
-	             std::vector<std::string> const& argv,
-	             bool help,
-	             bool version,
-	             bool options_first)
+	struct grammar
 	{
 		std::shared_ptr<Required> pattern;
 		std::vector<std::shared_ptr<Option>> options;
+	};
+
+	DOCOPT_INLINE
+	std::shared_ptr<const grammar> compile(std::string const& doc) {
 		try {
-			std::tie(pattern, options) = create_pattern_tree(doc);
+			auto tree = create_pattern_tree(doc);
+			return std::make_shared<const grammar>(grammar{ std::move(tree.first), std::move(tree.second) });
 		} catch(Tokens::OptionError const& error) {
 			throw language_error(error.what());
 		}
-		
+	}
+
+	DOCOPT_INLINE
+	std::map<std::string, docopt::value>
+	docopt_parse(grammar const& usage,
+	             std::vector<std::string> const& argv,
+	             bool help,
+	             bool version,
+	             bool options_first)
+	{
+		// parsing argv may add options that the usage string did not mention, so it gets its own copy of the list
+		std::vector<std::shared_ptr<Option>> options = usage.options;
+		std::shared_ptr<Required> const& pattern = usage.pattern;
+
 		PatternList argv_patterns;
 		try {
 			argv_patterns = parse_argv(Tokens(argv), options, options_first);
@@ -627,6 +690,17 @@ namespace docopt {
 		throw argument_error("Arguments did not match expected patterns"); // BLEH. Bad error.
 	}
 	
+	DOCOPT_INLINE
+	std::map<std::string, docopt::value>
+	docopt_parse(std::string const& doc,
+	             std::vector<std::string> const& argv,
+	             bool help,
+	             bool version,
+	             bool options_first)
+	{
+		return docopt_parse(*compile(doc), argv, help, version, options_first);
+	}
+	
 	DOCOPT_INLINE
 	std::map<std::string, docopt::value>
 	docopt(std::string const& doc,
@@ -371,12 +371,17 @@ namespace docopt {
 			const bool all_children_repeat = dynamic_cast<OneOrMore*>(bp) != nullptr;
 			const bool no_children_repeat  = dynamic_cast<Either*>(bp) != nullptr;
 			const std::size_t child_count = bp->fChildren.size();
+			// flattening is comparatively expensive, so each child is only flattened once
+			std::vector<std::vector<std::shared_ptr<LeafPattern>>> leaves;
+			leaves.reserve(child_count);
+			for(const auto& child : bp->fChildren) {
+				leaves.push_back(child->flat<LeafPattern>());
+			}
 			for(std::size_t i = 0; i < child_count; ++i) {
 				auto& child = bp->fChildren.at(i);
 				if(all_children_repeat) {
 					// all children of a OneOrMore can be repeated
-					auto child_leaves = child->flat<LeafPattern>();
-					for(auto& child_leaf : child_leaves) {
+					for(auto& child_leaf : leaves[i]) {
 						make_leaf_repeatable(child_leaf);
 					}
 				} else if(!no_children_repeat) {
@@ -385,13 +390,8 @@ namespace docopt {
 						if(i == j) {
 							continue;
 						}
-						auto& sibling = bp->fChildren.at(j);
-
-						auto child_leaves = child->flat<LeafPattern>();
-						auto sibling_leaves = sibling->flat<LeafPattern>();
-
-						for(auto& child_leaf : child_leaves) {
-							for(auto& sibling_leaf : sibling_leaves) {
+						for(auto& child_leaf : leaves[i]) {
+							for(auto& sibling_leaf : leaves[j]) {
 								if(child_leaf == sibling_leaf) {
 									make_leaf_repeatable(child_leaf);
 								}
@@ -498,36 +498,35 @@ namespace docopt {
 			options_end = option_description.begin() + static_cast<std::ptrdiff_t>(double_space);
 		}
 
-		static const xp::sregex pattern(xp::sregex::compile("(-{1,2})?(.*?)([,= ]|$)"));
-		for(xp::sregex_iterator i(option_description.begin(), options_end, pattern, xp::regex_constants::match_not_null), e{};
-		    i != e;
-		    ++i) {
-			xp::smatch const& match = *i;
-			if(match[1].matched) { // [1] is optional.
-				if(match[1].length() == 1) {
-					shortOption = "-" + match[2].str();
-				} else {
-					longOption = "--" + match[2].str();
-				}
-			} else if(match[2].length() > 0) { // [2] always matches.
-				std::string m = match[2];
+		// the option names and argument are separated by commas, equals signs, or spaces
+		for(auto begin = option_description.begin(); begin != options_end; ) {
+			const auto end = std::find_if(begin, options_end, [](char ch) noexcept {
+				return ch == ',' || ch == '=' || ch == ' ';
+			});
+			const std::string part(begin, end);
+			if(part.compare(0, 2, "--") == 0) {
+				longOption = part;
+			} else if(part.compare(0, 1, "-") == 0) {
+				shortOption = part;
+			} else if(!part.empty()) {
 				argcount = 1;
-			} else {
-				// delimeter
-			}
-
-			if(match[3].length() == 0) { // [3] always matches.
-				                         // Hit end of string. For some reason 'match_not_null' will let us match empty
-				                         // at the end, and then we'll spin in an infinite loop. So, if we hit an empty
-				                         // match, we know we must be at the end.
-				break;
 			}
+			begin = end == options_end ? end : end + 1;
 		}
 
 		if(argcount) {
-			xp::smatch match;
-			if(xp::regex_search(options_end, option_description.end(), match, xp::sregex(xp::sregex::compile("\\[default: (.*)\\]", xp::sregex::icase)))) {
-				val = match[1].str();
+			// [default: value], with the value running to the last ']'
+			const std::string description(options_end, option_description.end());
+			const std::string marker = "[default: ";
+			const auto found = std::search(description.begin(), description.end(), marker.begin(), marker.end(), [](char lhs, char rhs) noexcept {
+				return std::tolower(static_cast<unsigned char>(lhs)) == std::tolower(static_cast<unsigned char>(rhs));
+			});
+			if(found != description.end()) {
+				const std::size_t value_start = static_cast<std::size_t>(found - description.begin()) + marker.size();
+				const std::size_t close = description.rfind(']');
+				if(close != std::string::npos && close >= value_start) {
+					val = description.substr(value_start, close - value_start);
+				}
 			}
 		}
 
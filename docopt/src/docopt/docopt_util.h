@@ -12,8 +12,9 @@
 #define docopt_docopt_util_h
 
 #include <string>
-#include <boost/xpressive/xpressive.hpp>
-namespace xp = boost::xpressive;
+#include <vector>
+#include <tuple>
+#include <algorithm>
 
 namespace {
 	bool starts_with(std::string const& str, std::string const& prefix) {
@@ -86,16 +87,6 @@ namespace {
 		}
 		return ret;
 	}
-
-	std::vector<std::string> regex_split(std::string const& text, xp::sregex const& re) {
-		std::vector<std::string> ret;
-		for(auto it = xp::sregex_token_iterator(text.begin(), text.end(), re, -1);
-			it != xp::sregex_token_iterator();
-			++it) {
-			ret.emplace_back(*it);
-		}
-		return ret;
-	}
 }
 
 #endif
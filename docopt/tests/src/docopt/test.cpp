@@ -26,7 +26,7 @@ namespace
 		std::size_t subtest_number;
 	};
 
-	const auto results_to_json = [&] (const std::map<std::string, docopt::value>& results) {
+	const auto results_to_json = [] (const std::map<std::string, docopt::value>& results) {
 		bool first = true;
 		std::string json;
 		json += "{";
@@ -156,6 +156,46 @@ TEST_P(DocoptTest, ParserTest) {
 	}
 }
 
+TEST_P(DocoptTest, CompiledParserTest) {
+	docopt_test_data data = GetParam();
+	try {
+		const std::shared_ptr<const docopt::grammar> usage = docopt::compile(data.usage);
+		const std::string json = results_to_json(docopt::docopt_parse(*usage, data.argv, false, false));
+		EXPECT_EQ(data.expected_result, json);
+		// matching doesn't change the grammar, so it can be matched again
+		EXPECT_EQ(json, results_to_json(docopt::docopt_parse(*usage, data.argv, false, false)));
+	}
+	catch (const std::exception & e) {
+		EXPECT_EQ(data.expected_result, e.what());
+	}
+}
+
+TEST(DocoptGrammarTest, ReuseTest) {
+	// every invocation of a section is matched against one grammar, in order, as well as against the usage string
+	std::map<std::size_t, std::shared_ptr<const docopt::grammar>> grammars;
+	for(const docopt_test_data& data : command_lines) {
+		std::string from_usage;
+		try {
+			from_usage = results_to_json(docopt::docopt_parse(data.usage, data.argv, false, false));
+		}
+		catch (const std::exception & e) {
+			from_usage = e.what();
+		}
+		std::string from_grammar;
+		try {
+			auto it = grammars.find(data.test_number);
+			if(it == grammars.end()) {
+				it = grammars.insert({ data.test_number, docopt::compile(data.usage) }).first;
+			}
+			from_grammar = results_to_json(docopt::docopt_parse(*it->second, data.argv, false, false));
+		}
+		catch (const std::exception & e) {
+			from_grammar = e.what();
+		}
+		EXPECT_EQ(from_usage, from_grammar) << "section " << data.test_number << ", invocation " << data.subtest_number;
+	}
+}
+
 INSTANTIATE_TEST_SUITE_P(DocoptFullTests, DocoptTest, ::testing::ValuesIn(command_lines), param_printer);
 
 #if defined(_MSC_VER)
@@ -0,0 +1,339 @@
+#include "stdafx.h"
+
+#include "cpuid/cpuid.hpp"
+#include "docopt/docopt.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <sstream>
+
+static const char usage_message[] =
+R"(libcpuid-bench.
+
+Usage:
+	libcpuid-bench [--dumps <directory>] [--iterations <count>] [--output <filename>]
+	libcpuid-bench --help
+
+Options:
+	--dumps=<directory>        Root of the dump corpus [default: libcpuid/tests/data/dumps]
+	--iterations=<count>       Number of times each measurement is repeated; the fastest run is reported [default: 5]
+	--output=<filename>        Write the JSON report to <filename> rather than stdout
+	--help                     Show this text
+
+Every file under the corpus is parsed with the format named by its top-level directory
+(aida64, libcpuid, intel-sde is etallen, anything else is native). Parser throughput is
+reported per format in MB/s and lines/s, and each file additionally reports the time taken
+by build_topology, print_leaves, print_topology, and print_dump in every output format.
+)";
+
+namespace
+{
+	using clock_type = std::chrono::steady_clock;
+
+	struct corpus_file_t
+	{
+		std::filesystem::path file_name;
+		cpuid::file_format format;
+		std::string content;
+		std::size_t lines;
+	};
+
+	struct file_result_t
+	{
+		std::filesystem::path file_name;
+		cpuid::file_format format;
+		std::size_t bytes;
+		std::size_t lines;
+		std::size_t cpus;
+		double parse_seconds;
+		double build_topology_seconds;
+		double print_leaves_seconds;
+		double print_topology_seconds;
+		std::map<cpuid::file_format, double> print_dump_seconds;
+		std::string error;
+	};
+
+	struct format_total_t
+	{
+		std::size_t files = 0;
+		std::size_t bytes = 0;
+		std::size_t lines = 0;
+		double seconds = 0.0;
+	};
+
+	const std::vector<cpuid::file_format> all_formats = {
+		cpuid::file_format::native,
+		cpuid::file_format::etallen,
+		cpuid::file_format::libcpuid,
+		cpuid::file_format::aida64,
+		cpuid::file_format::cpuinfo,
+		cpuid::file_format::folded,
+		cpuid::file_format::hwloc_xml
+	};
+
+	const char* to_string(cpuid::file_format format) noexcept {
+		switch(format) {
+		case cpuid::file_format::native:
+			return "native";
+		case cpuid::file_format::etallen:
+			return "etallen";
+		case cpuid::file_format::libcpuid:
+			return "libcpuid";
+		case cpuid::file_format::aida64:
+			return "aida64";
+		case cpuid::file_format::cpuinfo:
+			return "cpuinfo";
+		case cpuid::file_format::folded:
+			return "folded";
+		case cpuid::file_format::hwloc_xml:
+			return "hwloc-xml";
+		default:
+			UNREACHABLE();
+		}
+	}
+
+	cpuid::file_format string_to_format(const std::string& str) noexcept {
+		if(str == "etallen" || str == "intel-sde") {
+			return cpuid::file_format::etallen;
+		} else if(str == "libcpuid") {
+			return cpuid::file_format::libcpuid;
+		} else if(str == "aida64") {
+			return cpuid::file_format::aida64;
+		} else {
+			return cpuid::file_format::native;
+		}
+	}
+
+	std::string escape_json(const std::string& input) {
+		std::string output;
+		output.reserve(input.size());
+		for(const char ch : input) {
+			switch(ch) {
+			case '\\':
+			case '"':
+				output += '\\';
+				output += ch;
+				break;
+			case '\n':
+				output += "\\n";
+				break;
+			case '\t':
+				output += "\\t";
+				break;
+			default:
+				if(static_cast<unsigned char>(ch) < 0x20) {
+					output += fmt::format("\\u{:04x}", static_cast<unsigned int>(ch));
+				} else {
+					output += ch;
+				}
+				break;
+			}
+		}
+		return output;
+	}
+
+	std::vector<corpus_file_t> load_corpus(const std::filesystem::path& root) {
+		namespace fs = std::filesystem;
+
+		std::vector<corpus_file_t> corpus;
+		for(const auto& d : fs::directory_iterator(root)) {
+			if(!d.is_directory()) {
+				continue;
+			}
+			const cpuid::file_format format = string_to_format(d.path().filename().string());
+			for(const auto& f : fs::recursive_directory_iterator(d.path())) {
+				if(!f.is_regular_file() || f.path().filename() == "source.txt") {
+					continue;
+				}
+				std::ifstream fin(f.path(), std::ios::binary);
+				std::string content{ std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>() };
+				const std::size_t lines = gsl::narrow_cast<std::size_t>(std::count(content.begin(), content.end(), '\n'));
+				corpus.push_back({ f.path(), format, std::move(content), lines });
+			}
+		}
+		std::sort(corpus.begin(), corpus.end(), [](const corpus_file_t& lhs, const corpus_file_t& rhs) {
+			return lhs.file_name < rhs.file_name;
+		});
+		return corpus;
+	}
+
+	// runs fn the requested number of times, and returns the fastest run in seconds
+	template<typename Fn>
+	double measure(std::uint32_t iterations, Fn&& fn) {
+		double best = std::numeric_limits<double>::max();
+		for(std::uint32_t i = 0_u32; i < iterations; ++i) {
+			const clock_type::time_point start = clock_type::now();
+			fn();
+			const clock_type::time_point end = clock_type::now();
+			best = std::min(best, std::chrono::duration<double>(end - start).count());
+		}
+		return best;
+	}
+
+	file_result_t benchmark_file(const corpus_file_t& file, std::uint32_t iterations) {
+		file_result_t result = { file.file_name, file.format, file.content.size(), file.lines, 0, 0.0, 0.0, 0.0, 0.0, {}, "" };
+
+		std::map<std::uint32_t, cpuid::cpu_t> logical_cpus;
+		try {
+			result.parse_seconds = measure(iterations, [&] () {
+				std::istringstream fin(file.content);
+				logical_cpus = cpuid::enumerate_file(fin, file.format);
+			});
+		} catch(const std::exception& e) {
+			result.error = e.what();
+			return result;
+		}
+		result.cpus = logical_cpus.size();
+		if(logical_cpus.empty()) {
+			return result;
+		}
+
+		try {
+			cpuid::system_t machine = {};
+			result.build_topology_seconds = measure(iterations, [&] () {
+				machine = cpuid::build_topology(logical_cpus);
+			});
+
+			result.print_leaves_seconds = measure(iterations, [&] () {
+				for(const auto& p : logical_cpus) {
+					fmt::memory_buffer out;
+					cpuid::print_leaves(out, p.second, false, false);
+				}
+			});
+
+			result.print_topology_seconds = measure(iterations, [&] () {
+				fmt::memory_buffer out;
+				cpuid::print_topology(out, machine);
+			});
+		} catch(const std::exception& e) {
+			result.error = e.what();
+			return result;
+		}
+
+		for(const cpuid::file_format format : all_formats) {
+			try {
+				result.print_dump_seconds[format] = measure(iterations, [&] () {
+					fmt::memory_buffer out;
+					cpuid::print_dump(out, logical_cpus, format);
+				});
+			} catch(const std::exception&) {
+				// some old processors lack the leaves that some formats (notably cpuinfo) require
+			}
+		}
+		return result;
+	}
+
+	void print_report(fmt::memory_buffer& out, const std::filesystem::path& root, std::uint32_t iterations, const std::vector<file_result_t>& results) {
+		std::map<cpuid::file_format, format_total_t> totals;
+		for(const file_result_t& r : results) {
+			if(r.error.empty()) {
+				format_total_t& total = totals[r.format];
+				++total.files;
+				total.bytes   += r.bytes;
+				total.lines   += r.lines;
+				total.seconds += r.parse_seconds;
+			}
+		}
+
+		format_to(out, "{{\n");
+		format_to(out, "\t\"corpus\": \"{:s}\",\n", escape_json(root.string()));
+		format_to(out, "\t\"iterations\": {:d},\n", iterations);
+		format_to(out, "\t\"parsers\": {{");
+		bool first = true;
+		for(const auto& p : totals) {
+			const format_total_t& total = p.second;
+			const double seconds = total.seconds > 0.0 ? total.seconds : std::numeric_limits<double>::min();
+			format_to(out, "{:s}\n\t\t\"{:s}\": {{ \"files\": {:d}, \"bytes\": {:d}, \"lines\": {:d}, \"seconds\": {:.9f}, \"mb_per_second\": {:.3f}, \"lines_per_second\": {:.1f} }}",
+			          first ? "" : ",",
+			          to_string(p.first),
+			          total.files,
+			          total.bytes,
+			          total.lines,
+			          total.seconds,
+			          (total.bytes / (1'024.0 * 1'024.0)) / seconds,
+			          total.lines / seconds);
+			first = false;
+		}
+		format_to(out, "\n\t}},\n");
+		format_to(out, "\t\"files\": [");
+		first = true;
+		for(const file_result_t& r : results) {
+			format_to(out, "{:s}\n\t\t{{ \"file\": \"{:s}\", \"format\": \"{:s}\", \"bytes\": {:d}, \"lines\": {:d}, \"cpus\": {:d}",
+			          first ? "" : ",",
+			          escape_json(r.file_name.generic_string()),
+			          to_string(r.format),
+			          r.bytes,
+			          r.lines,
+			          r.cpus);
+			first = false;
+			if(!r.error.empty()) {
+				format_to(out, ", \"error\": \"{:s}\" }}", escape_json(r.error));
+				continue;
+			}
+			format_to(out, ", \"parse_seconds\": {:.9f}, \"build_topology_seconds\": {:.9f}, \"print_leaves_seconds\": {:.9f}, \"print_topology_seconds\": {:.9f}",
+			          r.parse_seconds,
+			          r.build_topology_seconds,
+			          r.print_leaves_seconds,
+			          r.print_topology_seconds);
+			format_to(out, ", \"print_dump_seconds\": {{");
+			bool first_dump = true;
+			for(const cpuid::file_format format : all_formats) {
+				const auto it = r.print_dump_seconds.find(format);
+				format_to(out, "{:s} \"{:s}\": ", first_dump ? "" : ",", to_string(format));
+				if(it != r.print_dump_seconds.end()) {
+					format_to(out, "{:.9f}", it->second);
+				} else {
+					format_to(out, "null");
+				}
+				first_dump = false;
+			}
+			format_to(out, " }} }}");
+		}
+		format_to(out, "\n\t]\n");
+		format_to(out, "}}\n");
+	}
+}
+
+int main(int argc, char* argv[]) try {
+	const std::shared_ptr<const docopt::grammar> usage_grammar = docopt::compile(usage_message);
+	const std::map<std::string, docopt::value> args = docopt::docopt_parse(*usage_grammar, { argv + 1, argv + argc }, true, false);
+	const std::filesystem::path root = std::get<std::string>(args.at("--dumps"));
+	const std::uint32_t iterations   = std::max(1_u32, gsl::narrow<std::uint32_t>(std::stoul(std::get<std::string>(args.at("--iterations")))));
+
+	if(!std::filesystem::is_directory(root)) {
+		throw std::runtime_error(fmt::format("{:s} is not a directory", root.string()));
+	}
+
+	const std::vector<corpus_file_t> corpus = load_corpus(root);
+	std::vector<file_result_t> results;
+	results.reserve(corpus.size());
+	for(const corpus_file_t& file : corpus) {
+		results.push_back(benchmark_file(file, iterations));
+	}
+
+	fmt::memory_buffer out;
+	print_report(out, root, iterations, results);
+
+	if(std::holds_alternative<std::string>(args.at("--output"))) {
+		const std::string filename = std::get<std::string>(args.at("--output"));
+		std::ofstream fout(filename, std::ios::binary);
+		if(!fout) {
+			throw std::runtime_error(fmt::format("Could not open {:s} for output", filename));
+		}
+		fout << to_string(out) << std::flush;
+	} else {
+		std::cout << to_string(out) << std::flush;
+	}
+	return EXIT_SUCCESS;
+} catch(const docopt::exit_help&) {
+	std::cout << usage_message << std::endl;
+	return EXIT_SUCCESS;
+} catch(const docopt::argument_error& e) {
+	std::cerr << e.what() << std::endl;
+	std::cerr << usage_message << std::endl;
+	return EXIT_FAILURE;
+} catch(const std::exception& e) {
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -3,7 +3,11 @@
 
 #include <cstddef>
 #include <array>
+#include <filesystem>
 #include <map>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
 
 #include <gsl/gsl>
 #include <fmt/format.h>
@@ -46,7 +50,7 @@ namespace cpuid {
 		system_on_chip_vendor             = 0x0000'0017_u32,
 		deterministic_tlb                 = 0x0000'0018_u32,
 		reserved_6                        = 0x0000'0019_u32,
-		reserved_7                        = 0x0000'001a_u32,
+		hybrid_information                = 0x0000'001a_u32,
 		pconfig                           = 0x0000'001b_u32,
 		reserved_8                        = 0x0000'001c_u32,
 		reserved_9                        = 0x0000'001d_u32,
@@ -178,6 +182,8 @@ namespace cpuid {
 		return lhs;
 	}
 
+	std::string to_string(register_type reg);
+
 	enum vendor_type : std::uint32_t
 	{
 		unknown        = 0x0000'0000_u32,
@@ -334,19 +340,25 @@ namespace cpuid {
 		    && lhs.family   == rhs.family;
 	}
 
+	// an OS CPU number or APIC ID that isn't known, such as the OS CPU numbers of most dumps
+	constexpr std::uint32_t unknown_id = 0xffff'ffff_u32;
+
 	struct cpu_t
 	{
 		std::uint32_t apic_id = 0_u32;
+		// the OS's number for the CPU, as sched_setaffinity, taskset, and cgroups use
+		std::uint32_t os_index = unknown_id;
 		vendor_type vendor    = vendor_type::unknown;
 		model_t model;
 		leaves_t leaves;
 	};
 
 	inline bool operator==(const cpu_t& lhs, const cpu_t& rhs) {
-		return lhs.apic_id == rhs.apic_id
-		    && lhs.vendor  == rhs.vendor
-		    && lhs.model   == rhs.model
-		    && lhs.leaves  == rhs.leaves;
+		return lhs.apic_id  == rhs.apic_id
+		    && lhs.os_index == rhs.os_index
+		    && lhs.vendor   == rhs.vendor
+		    && lhs.model    == rhs.model
+		    && lhs.leaves   == rhs.leaves;
 	}
 
 	register_set_t cpuid(leaf_type leaf, subleaf_type subleaf) noexcept;
@@ -359,15 +371,33 @@ namespace cpuid {
 		etallen,
 		libcpuid,
 		aida64,
-		cpuinfo
+		cpuinfo,
+		folded,    // native, with each distinct register set written once for a list of APIC IDs
+		hwloc_xml  // the topology in hwloc's XML schema; write-only, like cpuinfo
 	};
 
 	std::map<std::uint32_t, cpu_t> enumerate_file(std::istream& fin, file_format format);
+	// applies a delta written by print_delta_dump to the baseline it was taken against; throws if the baseline's hash doesn't match
+	std::map<std::uint32_t, cpu_t> enumerate_file(std::istream& fin, const std::map<std::uint32_t, cpu_t>& baseline);
 	std::map<std::uint32_t, cpu_t> enumerate_processors(bool brute_force, bool skip_vendor_check, bool skip_feature_check);
 
-	void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_cpus, file_format format);
+	class output_sink_t;
+
+	void print_dump(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, file_format format);
+	// writes each CPU out as soon as a chunk's worth has been formatted, then flushes the rest
+	void print_dump(output_sink_t& sink, const std::map<std::uint32_t, cpu_t>& logical_cpus, file_format format);
+	// a hash of the native dump, so the same CPUs hash the same whichever format they were read from
+	std::uint64_t dump_hash(const std::map<std::uint32_t, cpu_t>& logical_cpus);
+	// writes the baseline's hash, then only the OS numbers and register sets that were added or changed, and the leaves
+	// and CPUs that were removed, relative to baseline; when nothing has changed, that is just the hash
+	void print_delta_dump(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& baseline, const std::map<std::uint32_t, cpu_t>& logical_cpus);
 	void print_leaf(fmt::memory_buffer& out, const cpu_t& cpu, leaf_type leaf, bool skip_vendor_check, bool skip_feature_check);
 	void print_leaves(fmt::memory_buffer& out, const cpu_t& cpu, bool skip_vendor_check, bool skip_feature_check);
+	// formats the chosen CPUs concurrently, and writes them out in the order given
+	void print_leaves(output_sink_t& sink, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, bool skip_vendor_check, bool skip_feature_check);
+	// prints the leaves that every chosen CPU shares once, then each leaf that isn't shared once per distinct value,
+	// with the CPUs that report it, and the subleaves and registers that differ
+	void print_leaf_differences(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, bool skip_vendor_check, bool skip_feature_check);
 
 	struct flag_spec_t
 	{
@@ -388,6 +418,40 @@ namespace cpuid {
 		    == std::tie(rhs.selector_eax, rhs.selector_ecx, rhs.flag_register, rhs.flag_name, rhs.flag_start, rhs.flag_end);
 	}
 
+	// where a flag lives; a mask of zero means the flag could not be found
+	struct flag_location_t
+	{
+		leaf_type     leaf    = leaf_type::basic_info;
+		subleaf_type  subleaf = subleaf_type::main;
+		register_type reg     = eax;
+		std::uint32_t mask    = 0_u32;
+	};
+
+	inline bool operator==(const flag_location_t& lhs, const flag_location_t& rhs) noexcept {
+		return std::tie(lhs.leaf, lhs.subleaf, lhs.reg, lhs.mask)
+		    == std::tie(rhs.leaf, rhs.subleaf, rhs.reg, rhs.mask);
+	}
+
+	// looks up named flags in the feature tables, so that repeated queries need not
+	flag_location_t resolve_flag_spec(const flag_spec_t& spec);
+	// the flag's value, shifted down to bit 0, if the CPU reported the leaf
+	std::optional<std::uint32_t> get_flag_value(const cpu_t& cpu, const flag_location_t& location) noexcept;
+
+	// one row per CPU, one column per spec; a column is empty when the CPU lacks the leaf, or the flag is unknown
+	using flag_values_t = std::vector<std::vector<std::optional<std::uint32_t>>>;
+
+	// resolves every spec once, then visits each chosen CPU's leaves once
+	flag_values_t evaluate_flag_specs(const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const std::vector<flag_spec_t>& specs);
+
+	enum struct value_format
+	{
+		text,
+		table,
+		csv
+	};
+
+	void print_flag_values(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const std::vector<flag_spec_t>& specs, value_format format);
+
 	struct cache_instance_t
 	{
 		std::vector<std::uint32_t> sharing_ids;
@@ -421,14 +485,15 @@ namespace cpuid {
 
 	enum class level_type : std::uint32_t
 	{
-		invalid =           0_u32,
-		smt     =           1_u32,
-		core    =           2_u32,
-		module  =           3_u32,
-		tile    =           4_u32,
-		die     =           5_u32,
-		node    = 0xffff'fffe_u32,
-		package = 0xffff'ffff_u32
+		invalid  =           0_u32,
+		smt      =           1_u32,
+		core     =           2_u32,
+		module   =           3_u32,
+		tile     =           4_u32,
+		die      =           5_u32,
+		sub_numa = 0xffff'fffd_u32,
+		node     = 0xffff'fffe_u32,
+		package  = 0xffff'ffff_u32
 	};
 
 	struct level_description_t
@@ -438,13 +503,29 @@ namespace cpuid {
 		std::uint32_t select_mask;
 	};
 
+	// leaf 0x1a's core type; non-hybrid processors report none
+	enum struct hybrid_core_type : std::uint32_t
+	{
+		none = 0x00_u32,
+		atom = 0x20_u32,
+		core = 0x40_u32
+	};
+
 	struct logical_core_t
 	{
 		std::uint32_t full_apic_id = 0_u32;
+		std::uint32_t os_index     = unknown_id;
 
 		std::uint32_t smt_id       = 0_u32;
+		// the core's number within its package, rather than within its module, so that it is unique in the package
 		std::uint32_t core_id      = 0_u32;
+		std::uint32_t module_id    = 0_u32;
+		std::uint32_t tile_id      = 0_u32;
+		std::uint32_t die_id       = 0_u32;
 		std::uint32_t package_id   = 0_u32;
+		// the NUMA node, when the OS has said; unknown_id otherwise
+		std::uint32_t node_id      = unknown_id;
+		hybrid_core_type core_type = hybrid_core_type::none;
 
 		std::vector<std::uint32_t> non_shared_cache_ids;
 		std::vector<std::uint32_t> shared_cache_ids;
@@ -475,18 +556,21 @@ namespace cpuid {
 		std::map<std::uint32_t, physical_core_t> physical_cores;
 	};
 
+	// every package has at least one die, tile, and module; levels the processor doesn't report have a single member, with ID 0
 	struct package_t
 	{
 		std::map<std::uint32_t, physical_core_t> physical_cores;
 
-		//std::map<std::uint32_t, die_t> dies;
-		//std::map<std::uint32_t, node_t> nodes;
+		std::map<std::uint32_t, die_t> dies;
+		// empty unless the NUMA nodes were read from the OS
+		std::map<std::uint32_t, node_t> nodes;
 	};
 
 	struct system_t
 	{
 		vendor_type vendor;
 
+		// each width covers its level and all those below it, so die_mask_width is where the package ID starts
 		std::uint32_t smt_mask_width;
 		std::uint32_t core_mask_width;
 		std::uint32_t module_mask_width;
@@ -499,13 +583,112 @@ namespace cpuid {
 
 		std::map<std::uint32_t, package_t> packages;
 
+		// the levels reported by leaf 0x1f or 0xb, or inferred from older leaves
 		std::set<level_type> valid_levels;
+
+		// translation between OS CPU numbers and APIC IDs, for the CPUs whose OS number is known; gaps in
+		// apic_id_by_os_index, such as offline CPUs, hold unknown_id
+		std::vector<std::uint32_t> apic_id_by_os_index;
+		std::unordered_map<std::uint32_t, std::uint32_t> os_index_by_apic_id;
+
+		// each NUMA node's distance to every node, in node ID order, as Linux reports them
+		std::map<std::uint32_t, std::vector<std::uint32_t>> node_distances;
+
+		// the nodes of each package that split an L3 between them, as sub-NUMA clustering and cluster-on-die do
+		std::map<std::uint32_t, std::vector<std::uint32_t>> sub_numa_domains;
 	};
 
 	system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus);
 
+	// whether the machine has every CPU's OS number, which live runs do and only some dumps record
+	bool knows_os_numbers(const system_t& machine) noexcept;
+
+	// Reads the NUMA nodes under <sysfs_root>/devices/system/node, and files every core under its node, with
+	// level_type::node made valid. Linux lists each node's CPUs by OS CPU number, so only CPUs in the machine's
+	// apic_id_by_os_index are placed. A missing or empty node directory leaves the machine unchanged.
+	// Nodes that share an L3 instance, and are closer to each other than to any node outside it, are sub-NUMA
+	// domains, and make level_type::sub_numa valid.
+	void add_numa_nodes(system_t& machine, const std::filesystem::path& sysfs_root);
+
+	// a cache that CPUID and Linux's sysfs describe differently; type is as in cache_t, 1 for data, 2 for
+	// instructions, and 3 for unified
+	struct cache_disagreement_t
+	{
+		std::uint32_t level;
+		std::uint32_t type;
+		std::string description;
+	};
+
+	// Reads the caches under <sysfs_root>/devices/system/cpu/cpu*/cache, and compares each level and type with the
+	// machine's: its size, and which APIC IDs share each instance. Hypervisors often report sharing that doesn't
+	// match the guest's vCPUs, and some vendors report no caches at all. With prefer_sysfs, the caches that
+	// disagree take sysfs's geometry and instances, and those that only sysfs reports are added, with every core's
+	// cache IDs to match. As with add_numa_nodes, only CPUs in the machine's apic_id_by_os_index are used, and a
+	// missing cpu directory finds no disagreements.
+	std::vector<cache_disagreement_t> check_sysfs_caches(system_t& machine, const std::filesystem::path& sysfs_root, bool prefer_sysfs);
+
+	// a Linux-style CPU list, such as 0-27,224-251
+	std::string to_cpulist(std::vector<std::uint32_t> ids);
+	std::vector<std::uint32_t> from_cpulist(std::string_view list);
+
+	enum struct topology_style
+	{
+		bars,  // one row per cache instance and per logical, physical, and package entry, each as wide as the machine
+		ranges // the same rows, listing the APIC IDs each one covers
+	};
+
+	// bars are quadratic in the number of CPUs, so beyond this the auto style uses ranges
+	constexpr std::size_t bar_style_limit = 64;
+
+	// folding (ranges only) merges runs of cache instances and physical cores with the same number of threads
+	void print_topology(fmt::memory_buffer& out, const system_t& machine, topology_style style, bool fold);
 	void print_topology(fmt::memory_buffer& out, const system_t& machine);
 
+	// a JSON document with the registers and set features of each chosen CPU, in the order given, and each leaf
+	// decoded as print_leaf would print it, followed by the caches and topology if machine is non-null
+	void print_json(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const system_t* machine, bool skip_vendor_check, bool skip_feature_check);
+	void print_json(output_sink_t& sink, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const system_t* machine, bool skip_vendor_check, bool skip_feature_check);
+
+	// an hwloc v2 XML topology that lstopo and hwloc_topology_set_xml can load: packages, caches, cores,
+	// PUs, and the NUMA nodes and their distances when the machine has them, or a single node otherwise. PUs
+	// are numbered as the OS does; a machine without every OS number has them in APIC ID order instead, and
+	// says so with a CPUIDUnbound info on the Machine object
+	void print_hwloc_xml(fmt::memory_buffer& out, const system_t& machine);
+
+	// a register whose value differs between two dumps of the same CPU
+	struct register_change_t
+	{
+		leaf_type     leaf;
+		subleaf_type  subleaf;
+		register_type reg;
+		std::uint32_t before;
+		std::uint32_t after;
+	};
+
+	struct cpu_diff_t
+	{
+		std::uint32_t apic_id;
+		std::vector<std::pair<leaf_type, subleaf_type>> added;
+		std::vector<std::pair<leaf_type, subleaf_type>> removed;
+		std::vector<register_change_t> changed;
+	};
+
+	// CPUs are matched by APIC ID, so host-vs-host comparisons need the same numbering on both sides
+	struct dump_diff_t
+	{
+		std::vector<std::uint32_t> added_cpus;
+		std::vector<std::uint32_t> removed_cpus;
+		std::vector<cpu_diff_t> changed_cpus;
+	};
+
+	// both walk the sorted maps in step, so the cost is linear in the size of the dumps
+	cpu_diff_t diff_cpus(const cpu_t& before, const cpu_t& after);
+	dump_diff_t diff_dumps(const std::map<std::uint32_t, cpu_t>& before, const std::map<std::uint32_t, cpu_t>& after);
+
+	// prints the added and removed CPUs, then each distinct set of changes once with the CPUs it applies to,
+	// naming changed feature bits, then any differences in the topology and caches
+	void print_dump_diff(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& before, const std::map<std::uint32_t, cpu_t>& after);
+
 	}
 
 #endif
@@ -0,0 +1,87 @@
+#ifndef EXPORT_HPP
+#define EXPORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cpuid.hpp"
+
+namespace cpuid {
+
+	enum struct export_table
+	{
+		leaves,   // host, apic_id, leaf, subleaf, eax, ebx, ecx, edx
+		features, // host, apic_id, then one 0/1 column per feature mnemonic
+		machines  // host, then counts, cache sizes, and cache instance counts from build_topology
+	};
+
+	enum struct table_format
+	{
+		csv,
+		arrow // an Arrow IPC stream: the schema, a record batch per host, and the end-of-stream marker
+	};
+
+	// Writes one table for any number of hosts. The header (or schema) is written up front, and each host's rows are
+	// committed to the sink as soon as they're formatted, so only one host need be in memory at a time.
+	class table_exporter_t
+	{
+	public:
+		table_exporter_t(output_sink_t& sink_, export_table table_, table_format format_ = table_format::csv);
+
+		void add_host(std::string_view host, const std::map<std::uint32_t, cpu_t>& logical_cpus);
+
+		// writes the end of the table, which an Arrow stream needs to be complete
+		void finish();
+
+	private:
+		enum struct column_type
+		{
+			utf8,
+			uint32,
+			boolean
+		};
+
+		struct column_t
+		{
+			std::string_view name;
+			column_type type;
+			// the values of the current batch, for Arrow: utf8 bytes, little-endian uint32s, or packed bits
+			std::vector<std::uint8_t> values;
+			// utf8 only: where each value starts in values, and where the last one ends, as little-endian int32s
+			std::vector<std::uint8_t> offsets;
+		};
+
+		struct feature_bit_t
+		{
+			leaf_type     leaf;
+			subleaf_type  subleaf;
+			register_type reg;
+			std::uint32_t mask;
+			vendor_type   vendor;
+			std::size_t   column;
+		};
+
+		void add_column(std::string_view name, column_type type);
+		void write_string(std::string_view value);
+		void write_uint32(std::uint32_t value);
+		void write_boolean(bool value);
+		void end_row();
+		void write_record_batch();
+
+		output_sink_t& sink;
+		export_table table;
+		table_format format;
+		std::vector<column_t> columns;
+		std::size_t next_column = 0;
+		std::size_t rows = 0;
+		std::vector<std::string_view> feature_names;
+		std::vector<feature_bit_t> feature_bits;
+		std::vector<bool> feature_values;
+	};
+}
+
+#endif
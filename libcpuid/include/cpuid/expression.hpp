@@ -0,0 +1,78 @@
+#ifndef EXPRESSION_HPP
+#define EXPRESSION_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "cpuid.hpp"
+
+namespace cpuid {
+
+	// Boolean requirements over feature flags, register fields, and cache sizes, such as
+	//   AVX512F && AVX512BW && (VPCLMULQDQ || !VAES) && L3 >= 32M
+	// Operands are feature mnemonics (as used by --single-value), CPUID specs without spaces or parentheses
+	// (CPUID.07H.0H:EBX[5], CPUID.1.EBX[23:16]), the caches L1D, L1I, L2, L3, and L4 (the size of one instance,
+	// in bytes, or zero if there is no such cache), and decimal or hexadecimal numbers, optionally suffixed
+	// with K, M, or G. A numeric operand used as a condition is true when it is non-zero, and a parenthesized
+	// expression can be compared when it is numeric, as in (L3) >= 32M.
+	enum struct expression_opcode : std::uint8_t
+	{
+		load_flag,
+		load_cache,
+		load_constant,
+		test,
+		equal,
+		not_equal,
+		less,
+		less_equal,
+		greater,
+		greater_equal,
+		logical_and,
+		logical_or,
+		logical_not
+	};
+
+	struct expression_instruction_t
+	{
+		expression_opcode opcode;
+		std::uint32_t operand;
+	};
+
+	// a named feature can live in different places for different vendors; the first that applies to a CPU is used
+	struct expression_flag_t
+	{
+		std::vector<std::pair<vendor_type, flag_location_t>> candidates;
+	};
+
+	struct expression_cache_t
+	{
+		std::uint32_t level;
+		bool instructions;
+	};
+
+	struct expression_t
+	{
+		std::string source;
+		std::vector<expression_instruction_t> program;
+		std::vector<expression_flag_t> flags;
+		std::vector<expression_cache_t> caches;
+		std::vector<std::uint64_t> constants;
+	};
+
+	// compiles the expression into a stack program, resolving every flag name up front
+	expression_t compile_expression(const std::string& source);
+
+	struct expression_lane_t
+	{
+		const cpu_t* cpu;
+		const system_t* machine;
+	};
+
+	// evaluates the program once for all lanes, 64 lanes per word, returning one result per lane
+	std::vector<bool> evaluate_expression(const expression_t& expression, const std::vector<expression_lane_t>& lanes);
+	// one result per CPU, in APIC ID order
+	std::vector<bool> evaluate_expression(const expression_t& expression, const std::map<std::uint32_t, cpu_t>& logical_cpus, const system_t& machine);
+}
+
+#endif
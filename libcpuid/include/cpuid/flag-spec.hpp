@@ -0,0 +1,321 @@
+#ifndef FLAG_SPEC_HPP
+#define FLAG_SPEC_HPP
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#include "cpuid.hpp"
+
+namespace cpuid {
+
+	// A flag_spec_t that can be built and inspected at compile time. The flag name refers to the original
+	// text (so must outlive the spec), and keeps its original case; converting to a flag_spec_t lowercases it.
+	struct constant_flag_spec_t
+	{
+		std::uint32_t    selector_eax  = 0_u32;
+		std::uint32_t    selector_ecx  = 0_u32;
+		register_type    flag_register = eax;
+		std::string_view flag_name     = "";
+		std::uint32_t    flag_start    = 0xffff'ffff_u32;
+		std::uint32_t    flag_end      = 0xffff'ffff_u32;
+
+		constexpr bool has_bits() const noexcept {
+			return flag_start != 0xffff'ffff_u32 && flag_end != 0xffff'ffff_u32;
+		}
+
+		// the mask implied by the spec's bit range; whole-register specs cover every bit, and
+		// named flags without a bit range have to be resolved against the feature table (see resolve_flag_spec)
+		constexpr std::uint32_t mask() const noexcept {
+			if(has_bits()) {
+				const std::uint32_t low  = flag_start < flag_end ? flag_start : flag_end;
+				const std::uint32_t high = flag_start < flag_end ? flag_end   : flag_start;
+				const std::uint32_t top  = high >= 31_u32 ? 0xffff'ffff_u32 : (1_u32 << (high + 1_u32)) - 1_u32;
+				const std::uint32_t bottom = low >= 32_u32 ? 0xffff'ffff_u32 : (1_u32 << low) - 1_u32;
+				return top & ~bottom;
+			}
+			return flag_name.empty() ? 0xffff'ffff_u32 : 0_u32;
+		}
+
+		constexpr bool is_resolved() const noexcept {
+			return mask() != 0_u32;
+		}
+
+		constexpr flag_location_t location() const noexcept {
+			return { static_cast<leaf_type>(selector_eax), static_cast<subleaf_type>(selector_ecx), flag_register, mask() };
+		}
+
+		operator flag_spec_t() const {
+			flag_spec_t spec = { selector_eax, selector_ecx, flag_register, std::string(flag_name), flag_start, flag_end };
+			for(char& ch : spec.flag_name) {
+				if('A' <= ch && ch <= 'Z') {
+					ch = static_cast<char>(ch - 'A' + 'a');
+				}
+			}
+			return spec;
+		}
+	};
+
+	namespace detail {
+		// A hand-rolled equivalent of the regular expression that parse_flag_spec used to build:
+		//   CPUID\.{selector}(?:\.|:){reg}{field}
+		// where selector is one of EAX=nnH, (EAX=nnH, ECX=nnH), or nnH.nnH, and field is one of .name[bits],
+		// .name, [bits], or [name]. Alternatives are tried in the same order as the regex did, so that the
+		// two parsers agree on every spec.
+		constexpr std::size_t no_match = static_cast<std::size_t>(-1);
+
+		constexpr char lower(char ch) noexcept {
+			return ('A' <= ch && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch;
+		}
+
+		constexpr bool is_digit(char ch) noexcept {
+			return '0' <= ch && ch <= '9';
+		}
+
+		constexpr bool is_xdigit(char ch) noexcept {
+			return is_digit(ch) || ('a' <= lower(ch) && lower(ch) <= 'f');
+		}
+
+		constexpr bool is_flag_character(char ch) noexcept {
+			return is_digit(ch) || ('a' <= lower(ch) && lower(ch) <= 'z') || ch == '.' || ch == '_' || ch == '-';
+		}
+
+		constexpr std::uint32_t xdigit_value(char ch) noexcept {
+			return is_digit(ch) ? static_cast<std::uint32_t>(ch - '0') : static_cast<std::uint32_t>(lower(ch) - 'a' + 10);
+		}
+
+		// case-insensitively matches literal at pos, returning the position after it
+		constexpr std::size_t match(std::string_view s, std::size_t pos, std::string_view literal) noexcept {
+			if(pos == no_match || s.size() - pos < literal.size()) {
+				return no_match;
+			}
+			for(std::size_t i = 0; i < literal.size(); ++i) {
+				if(lower(s[pos + i]) != lower(literal[i])) {
+					return no_match;
+				}
+			}
+			return pos + literal.size();
+		}
+
+		constexpr std::size_t match_one_of(std::string_view s, std::size_t pos, std::string_view characters) noexcept {
+			if(pos == no_match || pos >= s.size() || characters.find(s[pos]) == std::string_view::npos) {
+				return no_match;
+			}
+			return pos + 1;
+		}
+
+		constexpr std::size_t match_optional(std::string_view s, std::size_t pos, std::string_view literal) noexcept {
+			const std::size_t next = match(s, pos, literal);
+			return next != no_match ? next : pos;
+		}
+
+		struct number_t
+		{
+			std::uint32_t value;
+			std::size_t end;
+		};
+
+		// (?:0x)?([[:xdigit:]]+)H?
+		constexpr number_t hex_number(std::string_view s, std::size_t pos) noexcept {
+			if(pos == no_match) {
+				return { 0_u32, no_match };
+			}
+			const std::size_t prefixed = match(s, pos, "0x");
+			for(const std::size_t start : { prefixed, pos }) {
+				if(start == no_match) {
+					continue;
+				}
+				std::uint32_t value = 0_u32;
+				std::size_t i = start;
+				for(; i < s.size() && is_xdigit(s[i]); ++i) {
+					if(i - start == 8) {
+						return { 0_u32, no_match };
+					}
+					value = (value << 4_u32) | xdigit_value(s[i]);
+				}
+				if(i != start) {
+					return { value, match_optional(s, i, "h") };
+				}
+			}
+			return { 0_u32, no_match };
+		}
+
+		// [[:digit:]]+
+		constexpr number_t decimal_number(std::string_view s, std::size_t pos) noexcept {
+			if(pos == no_match) {
+				return { 0_u32, no_match };
+			}
+			std::uint32_t value = 0_u32;
+			std::size_t i = pos;
+			for(; i < s.size() && is_digit(s[i]); ++i) {
+				if(i - pos == 9) {
+					return { 0_u32, no_match };
+				}
+				value = value * 10_u32 + static_cast<std::uint32_t>(s[i] - '0');
+			}
+			return { value, i != pos ? i : no_match };
+		}
+
+		// (?:bit )?n | (?:bits )?n[-:]n, followed by a closing bracket
+		constexpr std::size_t bracketed_bits(std::string_view s, std::size_t pos, constant_flag_spec_t& spec) noexcept {
+			const std::size_t open = match_one_of(s, pos, "([");
+			if(open == no_match) {
+				return no_match;
+			}
+			for(const std::size_t start : { match(s, open, "bit "), open }) {
+				const number_t bit = decimal_number(s, start);
+				const std::size_t close = match_one_of(s, bit.end, ")]");
+				if(close != no_match) {
+					spec.flag_start = bit.value;
+					spec.flag_end   = bit.value;
+					return close;
+				}
+			}
+			for(const std::size_t start : { match(s, open, "bits "), open }) {
+				const number_t high = decimal_number(s, start);
+				const number_t low  = decimal_number(s, match_one_of(s, high.end, "-:"));
+				const std::size_t close = match_one_of(s, low.end, ")]");
+				if(close != no_match) {
+					spec.flag_start = low.value;
+					spec.flag_end   = high.value;
+					return close;
+				}
+			}
+			return no_match;
+		}
+
+		// [[:alnum:]\._-]+
+		constexpr std::size_t flag_name(std::string_view s, std::size_t pos, constant_flag_spec_t& spec) noexcept {
+			if(pos == no_match) {
+				return no_match;
+			}
+			std::size_t i = pos;
+			while(i < s.size() && is_flag_character(s[i])) {
+				++i;
+			}
+			if(i == pos) {
+				return no_match;
+			}
+			spec.flag_name = s.substr(pos, i - pos);
+			return i;
+		}
+
+		constexpr void field(std::string_view s, std::size_t pos, constant_flag_spec_t& spec) noexcept {
+			constant_flag_spec_t candidate = spec;
+			// .name[bits]
+			std::size_t next = flag_name(s, match(s, pos, "."), candidate);
+			if(next != no_match && bracketed_bits(s, match_optional(s, next, " "), candidate) != no_match) {
+				spec = candidate;
+				return;
+			}
+			// .name
+			candidate = spec;
+			if(flag_name(s, match(s, pos, "."), candidate) != no_match) {
+				spec = candidate;
+				return;
+			}
+			// [bits]
+			candidate = spec;
+			if(bracketed_bits(s, pos, candidate) != no_match) {
+				spec = candidate;
+				return;
+			}
+			// [name]
+			candidate = spec;
+			next = flag_name(s, match_one_of(s, pos, "(["), candidate);
+			if(match_one_of(s, next, ")]") != no_match) {
+				spec = candidate;
+			}
+		}
+
+		// (?:\.|:)(EAX|EBX|ECX|EDX){field}
+		constexpr bool register_and_field(std::string_view s, std::size_t pos, constant_flag_spec_t& spec) noexcept {
+			pos = match_one_of(s, pos, ".:");
+			if(pos == no_match) {
+				return false;
+			}
+			constexpr std::string_view names[] = { "eax", "ebx", "ecx", "edx" };
+			for(register_type reg = eax; reg <= edx; ++reg) {
+				const std::size_t next = match(s, pos, names[reg]);
+				if(next != no_match) {
+					spec.flag_register = reg;
+					field(s, next, spec);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		constexpr bool flag_spec_at(std::string_view s, std::size_t pos, constant_flag_spec_t& spec) noexcept {
+			pos = match(s, pos, "CPUID.");
+			if(pos == no_match) {
+				return false;
+			}
+			// EAX=nnH
+			for(const std::size_t start : { match(s, pos, "EAX="), pos }) {
+				const number_t leaf = hex_number(s, start);
+				spec = {};
+				spec.selector_eax = leaf.value;
+				if(leaf.end != no_match && register_and_field(s, leaf.end, spec)) {
+					return true;
+				}
+			}
+			// (EAX=nnH, ECX=nnH)
+			{
+				const number_t leaf    = hex_number(s, match(s, pos, "(EAX="));
+				const number_t subleaf = hex_number(s, match(s, match_optional(s, match(s, leaf.end, ","), " "), "ECX="));
+				spec = {};
+				spec.selector_eax = leaf.value;
+				spec.selector_ecx = subleaf.value;
+				if(subleaf.end != no_match && register_and_field(s, match(s, subleaf.end, ")"), spec)) {
+					return true;
+				}
+			}
+			// nnH.nnH
+			{
+				const number_t leaf    = hex_number(s, pos);
+				const number_t subleaf = hex_number(s, match(s, leaf.end, "."));
+				spec = {};
+				spec.selector_eax = leaf.value;
+				spec.selector_ecx = subleaf.value;
+				if(subleaf.end != no_match && register_and_field(s, subleaf.end, spec)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// not constexpr, so that a malformed _cpuid literal fails to compile, and names the problem
+		inline void malformed_flag_spec() {
+			throw std::invalid_argument("malformed CPUID flag specification");
+		}
+	}
+
+	// Parses Intel's syntax for describing CPUID flags, such as CPUID.(EAX=07H, ECX=0H):EBX.AVX2[bit 5],
+	// accepting the same wide variety of forms as parse_flag_spec. The spec may be embedded in other text.
+	constexpr std::optional<constant_flag_spec_t> try_parse_flag_spec(std::string_view flag_description) noexcept {
+		for(std::size_t pos = flag_description.find_first_of("Cc"); pos != std::string_view::npos; pos = flag_description.find_first_of("Cc", pos + 1)) {
+			constant_flag_spec_t spec = {};
+			if(detail::flag_spec_at(flag_description, pos, spec)) {
+				return spec;
+			}
+		}
+		return std::nullopt;
+	}
+
+	constexpr constant_flag_spec_t parse_constant_flag_spec(std::string_view flag_description) {
+		const std::optional<constant_flag_spec_t> spec = try_parse_flag_spec(flag_description);
+		if(!spec) {
+			detail::malformed_flag_spec();
+		}
+		return *spec;
+	}
+}
+
+// "CPUID.01H:ECX.SSE4.2"_cpuid is parsed (and rejected, if malformed) at compile time
+consteval cpuid::constant_flag_spec_t operator "" _cpuid(const char* str, std::size_t len) {
+	return cpuid::parse_constant_flag_spec({ str, len });
+}
+
+#endif
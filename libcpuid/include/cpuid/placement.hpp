@@ -0,0 +1,59 @@
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "cpuid.hpp"
+
+namespace cpuid {
+
+	enum struct placement_policy
+	{
+		compact,   // fill each core's SMT siblings before moving on to the next core
+		scatter,   // round-robin over the L3 domains, alternating packages, using every core once before any sibling
+		physical,  // one worker per physical core, leaving the SMT siblings idle
+		l3_helper  // workers_per_l3 workers in each L3 domain in turn, each with a helper on its SMT sibling
+	};
+
+	// An L3 domain is an instance of the machine's last level cache, or a package if there are no caches.
+	// The result has the OS CPU numbers for each worker, as affinity APIs take them; for l3_helper, the worker's
+	// own thread comes first, then its helper's. On hybrid parts, Core cores are used before Atom cores, and
+	// only_type restricts the placement to one type. Throws if the machine doesn't know every CPU's OS number,
+	// or if there aren't enough threads or cores for the policy; oversubscription is left to the caller.
+	std::vector<std::vector<std::uint32_t>> place_workers(const system_t& machine, std::size_t workers, placement_policy policy, std::size_t workers_per_l3 = 1, hybrid_core_type only_type = hybrid_core_type::none);
+
+#if defined(__linux__)
+	// a worker's CPUs, ready for sched_setaffinity or pthread_setaffinity_np; throws if one is past CPU_SETSIZE
+	cpu_set_t to_cpu_set(const std::vector<std::uint32_t>& os_cpus);
+#endif
+
+	enum struct placement_export
+	{
+		taskset, // taskset -c lists
+		cpuset,  // commands to make a cgroup v2 cpuset partition for each domain
+		omp,     // OMP_PLACES with one place per physical core, and OMP_PROC_BIND
+		dpdk     // EAL -l lists and -c hex coremasks
+	};
+
+	enum struct placement_domain
+	{
+		machine,
+		package,
+		l3
+	};
+
+	// Prints one entry of the given kind for each domain, under a "# <domain>" comment. With skip_siblings,
+	// only the first thread of each physical core is used, and only_type leaves out the cores of other types,
+	// along with any domain left empty; throws if no domain has any CPUs. CPUs are numbered as the OS does, so
+	// this throws if the machine doesn't know every CPU's OS number, unless apic_ids allows numbering them by
+	// APIC ID instead, under a warning comment.
+	void print_placement(fmt::memory_buffer& out, const system_t& machine, placement_export kind, placement_domain domain, bool skip_siblings, hybrid_core_type only_type = hybrid_core_type::none, bool apic_ids = false);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SINK_HPP
+#define SINK_HPP
+
+#include <cstddef>
+#include <string>
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+	// Collects formatted output in a memory_buffer, and hands it to a file descriptor a chunk at a time,
+	// so that printing every CPU of a large machine needs memory proportional to the chunk, not the output.
+	// Printers format into buffer(), and call commit() at convenient boundaries (such as after each CPU).
+	class output_sink_t
+	{
+	public:
+		static constexpr std::size_t default_chunk_size = 64 * 1024;
+
+		// standard output
+		explicit output_sink_t(std::size_t chunk_size = default_chunk_size);
+		// the named file, truncated; "-" is standard output
+		explicit output_sink_t(const std::string& filename, std::size_t chunk_size = default_chunk_size);
+
+		output_sink_t(const output_sink_t&) = delete;
+		output_sink_t& operator=(const output_sink_t&) = delete;
+
+		// flushes whatever is left, but swallows errors; call flush() to see them
+		~output_sink_t();
+
+		fmt::memory_buffer& buffer() noexcept {
+			return out;
+		}
+
+		// writes out the buffer once it holds at least a chunk
+		void commit() {
+			if(out.size() >= chunk_size) {
+				flush();
+			}
+		}
+
+		// writes out the buffer, however much it holds
+		void flush();
+
+	private:
+		int fd;
+		bool owns_fd;
+		std::size_t chunk_size;
+		fmt::memory_buffer out;
+	};
+}
+
+#endif
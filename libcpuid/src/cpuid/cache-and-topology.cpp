@@ -4,6 +4,9 @@
 
 #include "utility.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <thread>
 
 #include <fmt/format.h>
@@ -1207,6 +1210,16 @@ constexpr full_apic_id_t split_apic_id(std::uint32_t id,
 	return { smt_id, core_id, module_id, tile_id, die_id, package_id };
 }
 
+// the number of bits needed to hold IDs up to max_id
+std::uint32_t significant_bits(std::uint32_t max_id) noexcept {
+	if(max_id == 0_u32) {
+		return 0_u32;
+	}
+	unsigned long idx = 0;
+	bit_scan_reverse(&idx, max_id);
+	return gsl::narrow_cast<std::uint32_t>(idx) + 1_u32;
+}
+
 std::pair<std::uint32_t, std::uint32_t> generate_mask(std::uint32_t entries) noexcept {
 	if(entries > 0x7fff'ffff_u32) {
 		return std::make_pair(0xffff'ffff_u32, 32_u32);
@@ -1222,18 +1235,35 @@ std::pair<std::uint32_t, std::uint32_t> generate_mask(std::uint32_t entries) noe
 system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 	system_t machine = {};
 	bool enumerated_caches = false;
-	std::for_each(std::begin(logical_cpus), std::end(logical_cpus), [&machine, &enumerated_caches](const std::pair<std::uint32_t, cpu_t>& p) {
+	std::unordered_map<std::uint32_t, hybrid_core_type> core_types;
+	std::for_each(std::begin(logical_cpus), std::end(logical_cpus), [&machine, &enumerated_caches, &core_types](const std::pair<std::uint32_t, cpu_t>& p) {
 		const cpu_t cpu = p.second;
 		machine.x2_apic_ids.push_back(cpu.apic_id);
+		if(cpu.leaves.find(leaf_type::hybrid_information) != cpu.leaves.end()) {
+			core_types[cpu.apic_id] = static_cast<hybrid_core_type>(cpu.leaves.at(leaf_type::hybrid_information).at(subleaf_type::main)[eax] >> 24_u32);
+		}
+		if(cpu.os_index != unknown_id) {
+			if(machine.apic_id_by_os_index.size() <= cpu.os_index) {
+				machine.apic_id_by_os_index.resize(cpu.os_index + 1_u32, unknown_id);
+			}
+			machine.apic_id_by_os_index[cpu.os_index] = cpu.apic_id;
+			machine.os_index_by_apic_id[cpu.apic_id] = cpu.os_index;
+		}
 		if(enumerated_caches) {
 			return;
 		}
 		enumerated_caches = true;
 		machine.vendor = cpu.vendor;
+		// AMD's node and CCX widths
+		std::uint32_t node_width = 0_u32;
+		std::optional<std::uint32_t> l3_width;
 		switch(cpu.vendor & vendor_type::any_silicon) {
 		case vendor_type::intel:
-			if(cpu.leaves.find(leaf_type::extended_topology) != cpu.leaves.end()) {
-				for(const auto& sub : cpu.leaves.at(leaf_type::extended_topology)) {
+			// leaf 0x1f supersedes leaf 0xb, adding module, tile, and die levels
+			if(const auto topology = cpu.leaves.find(leaf_type::extended_topology_v2) != cpu.leaves.end() ? cpu.leaves.find(leaf_type::extended_topology_v2)
+			                                                                                            : cpu.leaves.find(leaf_type::extended_topology);
+			   topology != cpu.leaves.end()) {
+				for(const auto& sub : topology->second) {
 					const register_set_t& regs = sub.second;
 
 					const struct
@@ -1254,11 +1284,31 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 						if(machine.smt_mask_width == 0_u32) {
 							machine.smt_mask_width = a.shift_distance;
 						}
+						machine.valid_levels.insert(level_type::smt);
 						break;
 					case 2:
 						if(machine.core_mask_width == 0_u32) {
 							machine.core_mask_width = a.shift_distance;
 						}
+						machine.valid_levels.insert(level_type::core);
+						break;
+					case 3:
+						if(machine.module_mask_width == 0_u32) {
+							machine.module_mask_width = a.shift_distance;
+						}
+						machine.valid_levels.insert(level_type::module);
+						break;
+					case 4:
+						if(machine.tile_mask_width == 0_u32) {
+							machine.tile_mask_width = a.shift_distance;
+						}
+						machine.valid_levels.insert(level_type::tile);
+						break;
+					case 5:
+						if(machine.die_mask_width == 0_u32) {
+							machine.die_mask_width = a.shift_distance;
+						}
+						machine.valid_levels.insert(level_type::die);
 						break;
 					default:
 						break;
@@ -1308,6 +1358,7 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 							machine.smt_mask_width = logical_mask.second;
 							const auto physical_mask = generate_mask(total_cores_in_package);
 							machine.core_mask_width = physical_mask.second;
+							machine.valid_levels.insert({ level_type::smt, level_type::core });
 						}
 
 						[[fallthrough]];
@@ -1362,7 +1413,8 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 					                         : desc->associativity == fully_associative ? 0xff_u32
 					                         :                                            static_cast<std::uint32_t>(desc->associativity);
 
-					const std::uint32_t sets = desc->size / (ways * desc->line_size);
+					// trace caches have no line size
+					const std::uint32_t sets = desc->line_size != 0_u32 ? desc->size / (ways * desc->line_size) : 0_u32;
 
 					const cache_t cache = {
 						level,
@@ -1385,6 +1437,9 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 			}
 			break;
 		case vendor_type::amd:
+			// from Zen on, APIC IDs hold, from the least significant bit up, the thread, the core within its CCX, the CCX,
+			// the node, and the package; a CCX is the cores sharing an L3, and starts at a fixed width for each family.
+			// earlier families lay out nodes differently, so for them everything above the thread is the core
 			if(cpu.leaves.find(leaf_type::extended_apic) != cpu.leaves.end()) {
 				const register_set_t& regs = cpu.leaves.at(leaf_type::extended_apic).at(subleaf_type::main);
 				const struct
@@ -1394,16 +1449,16 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 					std::uint32_t reserved_1       : 16;
 				} b = bit_cast<decltype(b)>(regs[ebx]);
 
-				//// the node_id and nodes_per_processor should surely be mapped somehow...
-				//const struct
-				//{
-				//	std::uint32_t node_id             : 8;
-				//	std::uint32_t nodes_per_processor : 3;
-				//	std::uint32_t reserved_1          : 21;
-				//} c = bit_cast<decltype(c)>(regs[ecx]);
-
-				machine.smt_mask_width = generate_mask(b.threads_per_core).second;
+				const struct
+				{
+					std::uint32_t node_id             : 8;
+					std::uint32_t nodes_per_processor : 3;
+					std::uint32_t reserved_1          : 21;
+				} c = bit_cast<decltype(c)>(regs[ecx]);
 
+				machine.smt_mask_width = significant_bits(b.threads_per_core);
+				machine.valid_levels.insert(level_type::smt);
+				node_width = significant_bits(c.nodes_per_processor);
 			}
 			if(cpu.leaves.find(leaf_type::cache_properties) != cpu.leaves.end()) {
 				for(const auto& sub : cpu.leaves.at(leaf_type::cache_properties)) {
@@ -1453,9 +1508,13 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 						a.self_initializing != 0,
 						d.writeback_invalidates != 0,
 						d.cache_inclusive != 0,
-						a.maximum_addressable_thread_ids
+						// this is the number of threads sharing the cache, less one, so round it up to a mask
+						~(0xffff'ffff_u32 << significant_bits(a.maximum_addressable_thread_ids))
 					};
 					machine.all_caches.push_back(cache);
+					if(a.level == 3_u32) {
+						l3_width = significant_bits(a.maximum_addressable_thread_ids);
+					}
 				}
 			}
 			if(cpu.leaves.find(leaf_type::address_limits) != cpu.leaves.end()) {
@@ -1469,7 +1528,29 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 					std::uint32_t reserved_2      : 14;
 				} c = bit_cast<decltype(c)>(regs[ecx]);
 
-				machine.core_mask_width = c.apic_id_size;
+				const std::uint32_t package_width = c.apic_id_size;
+				if(cpu.model.family < 0x17_u32) {
+					node_width = 0_u32;
+					l3_width = std::nullopt;
+				} else {
+					// the L3's sharing count is of enabled threads, but each CCX has room in the APIC ID for four cores
+					// on family 17h and eight after, so a 2+2 part's CCXs are wider than their L3s say.
+					// Zen 2's CCDs hold two CCXs each, but have no field of their own, so they aren't a level here
+					const std::uint32_t ccx_core_width = cpu.model.family == 0x17_u32 ? 2_u32 : 3_u32;
+					l3_width = std::max(l3_width.value_or(0_u32), machine.smt_mask_width + ccx_core_width);
+				}
+				const std::uint32_t node_start = package_width - std::min(node_width, package_width);
+				machine.core_mask_width   = l3_width ? std::min(*l3_width, node_start) : node_start;
+				machine.module_mask_width = machine.core_mask_width;
+				machine.tile_mask_width   = node_start;
+				machine.die_mask_width    = package_width;
+				machine.valid_levels.insert(level_type::core);
+				if(machine.tile_mask_width > machine.core_mask_width) {
+					machine.valid_levels.insert(level_type::tile);
+				}
+				if(machine.die_mask_width > machine.tile_mask_width) {
+					machine.valid_levels.insert(level_type::die);
+				}
 			}
 			break;
 		default:
@@ -1477,13 +1558,33 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 		}
 	});
 
+	// a level that isn't reported takes no bits of the APIC ID
+	machine.module_mask_width = std::max(machine.module_mask_width, machine.core_mask_width);
+	machine.tile_mask_width   = std::max(machine.tile_mask_width  , machine.module_mask_width);
+	machine.die_mask_width    = std::max(machine.die_mask_width   , machine.tile_mask_width);
+
+	const auto make_core = [&machine, &core_types] (std::uint32_t id) {
+		const full_apic_id_t split = split_apic_id(id, machine.smt_mask_width, machine.core_mask_width, machine.module_mask_width, machine.tile_mask_width, machine.die_mask_width);
+		const std::uint32_t core_in_package = (id & ~(0xffff'ffff_u32 << machine.die_mask_width)) >> machine.smt_mask_width;
+		const auto os_index = machine.os_index_by_apic_id.find(id);
+		const auto core_type = core_types.find(id);
+		logical_core_t core = { id, os_index != machine.os_index_by_apic_id.end() ? os_index->second : unknown_id, split.smt_id, core_in_package, split.module_id, split.tile_id, split.die_id, split.package_id };
+		core.core_type = core_type != core_types.end() ? core_type->second : hybrid_core_type::none;
+		return core;
+	};
+	const auto place_core = [&machine] (const logical_core_t& core) {
+		package_t& package = machine.packages[core.package_id];
+		package.physical_cores[core.core_id].logical_cores[core.smt_id] = core;
+		package.dies[core.die_id].tiles[core.tile_id].modules[core.module_id].physical_cores[core.core_id].logical_cores[core.smt_id] = core;
+	};
+
 	switch(machine.vendor & vendor_type::any_silicon) {
 	case vendor_type::intel:
+	case vendor_type::amd:
 		// per the utterly miserable source code at https://software.intel.com/en-us/articles/intel-64-architecture-processor-topology-enumeration
+		// AMD has the same scheme, though with the sharing masks rounded up from thread counts
 		for(const std::uint32_t id : machine.x2_apic_ids) {
-			const full_apic_id_t split = split_apic_id(id, machine.smt_mask_width, machine.core_mask_width);
-		
-			logical_core_t core = { id, split.smt_id, split.core_id, split.package_id };
+			logical_core_t core = make_core(id);
 
 			for(const cache_t& cache : machine.all_caches) {
 				core.shared_cache_ids.push_back(id & cache.sharing_mask);
@@ -1491,7 +1592,7 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 			}
 
 			machine.all_cores.push_back(core);
-			machine.packages[split.package_id].physical_cores[split.core_id].logical_cores[split.smt_id] = core;
+			place_core(core);
 		}
 		for(std::size_t i = 0; i < machine.all_caches.size(); ++i) {
 			cache_t& cache = machine.all_caches[i];
@@ -1500,22 +1601,6 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 			}
 		}
 		break;
-	case vendor_type::amd:
-		// pure guesswork, since AMD does not appear to document its algorithm anywhere
-		for(const std::uint32_t id : machine.x2_apic_ids) {
-			const full_apic_id_t split = split_apic_id(id, machine.smt_mask_width, machine.core_mask_width);
-		
-			logical_core_t core = { id, split.smt_id, split.core_id, split.package_id };
-			machine.all_cores.push_back(core);
-			machine.packages[split.package_id].physical_cores[split.core_id].logical_cores[split.smt_id] = core;
-		}
-		for(std::size_t i = 0; i < machine.all_caches.size(); ++i) {
-			cache_t& cache = machine.all_caches[i];
-			for(std::size_t j = 0; j < machine.all_cores.size(); ++j) {
-				cache.instances[gsl::narrow<std::uint32_t>(j) / (cache.sharing_mask + 1_u32)].sharing_ids.push_back(machine.all_cores[j].full_apic_id);
-			}
-		}
-		break;
 	default:
 		break;
 	}
@@ -1523,81 +1608,311 @@ system_t build_topology(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
 	return machine;
 }
 
-void print_topology(fmt::memory_buffer& out, const system_t& machine) {
-	const std::uint32_t total_addressable_cores = gsl::narrow_cast<std::uint32_t>(machine.all_cores.size());
+bool knows_os_numbers(const system_t& machine) noexcept {
+	return !machine.all_cores.empty() && machine.os_index_by_apic_id.size() == machine.all_cores.size();
+}
+
+std::string to_cpulist(std::vector<std::uint32_t> ids) {
+	if(!std::is_sorted(ids.begin(), ids.end())) {
+		std::sort(ids.begin(), ids.end());
+	}
+	fmt::memory_buffer out;
+	for(std::size_t i = 0; i < ids.size(); ) {
+		std::size_t j = i;
+		while(j + 1 < ids.size() && ids[j + 1] <= ids[j] + 1_u32) {
+			++j;
+		}
+		if(i != 0) {
+			format_to(out, ",");
+		}
+		if(ids[j] == ids[i]) {
+			format_to(out, "{:d}", ids[i]);
+		} else {
+			format_to(out, "{:d}-{:d}", ids[i], ids[j]);
+		}
+		i = j + 1;
+	}
+	return to_string(out);
+}
+
+std::vector<std::uint32_t> from_cpulist(std::string_view list) {
+	const auto parse_id = [list] (std::string_view text) {
+		std::uint32_t id = 0_u32;
+		const auto result = std::from_chars(text.data(), text.data() + text.size(), id);
+		if(text.empty() || result.ec != std::errc{} || result.ptr != text.data() + text.size()) {
+			throw std::runtime_error(fmt::format("bad CPU list {:s}", list));
+		}
+		return id;
+	};
+
+	while(!list.empty() && std::isspace(static_cast<unsigned char>(list.back()))) {
+		list.remove_suffix(1);
+	}
+	std::vector<std::uint32_t> ids;
+	for(std::size_t start = 0; start < list.size(); ) {
+		const std::size_t end = std::min(list.find(',', start), list.size());
+		const std::string_view range = list.substr(start, end - start);
+		const std::size_t dash = range.find('-');
+		const std::uint32_t first = parse_id(range.substr(0, dash));
+		const std::uint32_t last  = dash != std::string_view::npos ? parse_id(range.substr(dash + 1)) : first;
+		if(last < first) {
+			throw std::runtime_error(fmt::format("bad CPU list {:s}", list));
+		}
+		for(std::uint32_t id = first; ; ++id) {
+			ids.push_back(id);
+			if(id == last) {
+				break;
+			}
+		}
+		start = end + 1;
+	}
+	return ids;
+}
+
+namespace {
+
+// before dashes, then covered stars, then dashes out to the full width
+void print_bar(fmt::memory_buffer& out, std::size_t before, std::size_t covered, std::size_t width) {
+	const std::size_t start = out.size();
+	const std::size_t length = std::max(width, before + covered);
+	out.resize(start + length);
+	char* const bar = out.data() + start;
+	std::fill_n(bar                   , before                   , '-');
+	std::fill_n(bar + before          , covered                  , '*');
+	std::fill_n(bar + before + covered, length - before - covered, '-');
+}
+
+std::string os_cpu_suffix(const logical_core_t& core) {
+	return core.os_index != unknown_id ? fmt::format(" os cpu: {:d}", core.os_index) : std::string{};
+}
+
+// a list of APIC IDs, followed by the OS's numbers for the same CPUs when the machine has them all
+std::string describe_cpus(const system_t& machine, const std::vector<std::uint32_t>& apic_ids) {
+	if(!knows_os_numbers(machine)) {
+		return to_cpulist(apic_ids);
+	}
+	std::vector<std::uint32_t> os_cpus;
+	os_cpus.reserve(apic_ids.size());
+	for(const std::uint32_t id : apic_ids) {
+		os_cpus.push_back(machine.os_index_by_apic_id.at(id));
+	}
+	return fmt::format("{:s} os cpus: {:s}", to_cpulist(apic_ids), to_cpulist(std::move(os_cpus)));
+}
+
+hybrid_core_type core_type_of(const physical_core_t& physical) noexcept {
+	return physical.logical_cores.empty() ? hybrid_core_type::none : physical.logical_cores.begin()->second.core_type;
+}
+
+std::string_view core_type_suffix(const physical_core_t& physical) noexcept {
+	switch(core_type_of(physical)) {
+	case hybrid_core_type::atom:
+		return " (Atom)";
+	case hybrid_core_type::core:
+		return " (Core)";
+	default:
+		return "";
+	}
+}
 
-	std::multimap<std::uint32_t, std::string> cache_output;
+void print_topology_bars(fmt::memory_buffer& out, const system_t& machine) {
+	const std::size_t total_addressable_cores = machine.all_cores.size();
+
+	// caches are ordered by the last core they cover
+	std::multimap<std::size_t, std::pair<std::size_t, const cache_t*>> cache_output;
 	for(const cache_t& cache : machine.all_caches) {
-		std::uint32_t cores_covered = 0_u32;
+		std::size_t cores_covered = 0;
 		for(const auto& instance : cache.instances) {
-			std::string line;
-			for(std::uint32_t i = 0; i < cores_covered; ++i) {
-				line += "-";
-			}
-			for(std::uint32_t i = 0; i < instance.second.sharing_ids.size(); ++i) {
-				line += "*";
-				++cores_covered;
-			}
-			for(std::uint32_t i = cores_covered; i < total_addressable_cores; ++i) {
-				line += "-";
-			}
-			line += " ";
-			line += to_short_string(cache);
-			cache_output.insert(std::make_pair(cores_covered, line));
+			const std::size_t before = cores_covered;
+			cores_covered += instance.second.sharing_ids.size();
+			cache_output.insert(std::make_pair(cores_covered, std::make_pair(before, &cache)));
 		}
 	}
 
 	for(const auto& p : cache_output) {
-		format_to(out, "{:s}\n", p.second);
+		print_bar(out, p.second.first, p.first - p.second.first, total_addressable_cores);
+		format_to(out, " {:s}\n", to_short_string(*p.second.second));
 	}
 	format_to(out, "\n");
 
-	std::uint32_t cores_covered_package  = 0_u32;
-	std::uint32_t cores_covered_physical = 0_u32;
-	std::uint32_t cores_covered_logical  = 0_u32;
+	const bool show_modules = machine.valid_levels.count(level_type::module) != 0;
+	const bool show_tiles   = machine.valid_levels.count(level_type::tile  ) != 0;
+	const bool show_dies    = machine.valid_levels.count(level_type::die   ) != 0;
+	// AMD's equivalent of a tile is the CCX
+	const std::string_view tile_name = (machine.vendor & vendor_type::amd) != vendor_type::unknown ? "ccx " : "tile";
+
+	// logical cores are in APIC ID order, so each level covers a contiguous run of them
+	std::size_t cores_covered = 0;
 	for(const auto& package : machine.packages) {
-		std::uint32_t logical_per_package = 0_u32;
-		for(const auto& physical : package.second.physical_cores) {
-			std::uint32_t logical_per_physical = 0_u32;
-			for(const auto& logical : physical.second.logical_cores) {
-				for(std::uint32_t i = 0; i < cores_covered_logical; ++i) {
-					format_to(out, "-");
-				}
-				for(std::uint32_t i = 0; i < 1; ++i) {
-					format_to(out, "*");
-					++cores_covered_logical;
-					++logical_per_physical;
-					++logical_per_package;
+		const std::size_t package_start = cores_covered;
+		for(const auto& die : package.second.dies) {
+			const std::size_t die_start = cores_covered;
+			for(const auto& tile : die.second.tiles) {
+				const std::size_t tile_start = cores_covered;
+				for(const auto& module : tile.second.modules) {
+					const std::size_t module_start = cores_covered;
+					for(const auto& physical : module.second.physical_cores) {
+						const std::size_t physical_start = cores_covered;
+						for(const auto& logical : physical.second.logical_cores) {
+							print_bar(out, cores_covered, 1, total_addressable_cores);
+							++cores_covered;
+							format_to(out, " logical  {:d}:{:d}:{:d} apic id: {:#04x}{:s}\n", package.first, physical.first, logical.first, logical.second.full_apic_id, os_cpu_suffix(logical.second));
+						}
+						print_bar(out, physical_start, cores_covered - physical_start, total_addressable_cores);
+						format_to(out, " physical {:d}:{:d}{:s}\n", package.first, physical.first, core_type_suffix(physical.second));
+					}
+					if(show_modules) {
+						print_bar(out, module_start, cores_covered - module_start, total_addressable_cores);
+						format_to(out, " module   {:d}:{:d}:{:d}:{:d}\n", package.first, die.first, tile.first, module.first);
+					}
 				}
-				for(std::uint32_t i = cores_covered_logical; i < total_addressable_cores; ++i) {
-					format_to(out, "-");
+				if(show_tiles) {
+					print_bar(out, tile_start, cores_covered - tile_start, total_addressable_cores);
+					format_to(out, " {:s}     {:d}:{:d}:{:d}\n", tile_name, package.first, die.first, tile.first);
 				}
-				format_to(out, " logical  {:d}:{:d}:{:d} apic id: {:#04x}\n", package.first, physical.first, logical.first, logical.second.full_apic_id);
-			}
-			for(std::uint32_t i = 0; i < cores_covered_physical; ++i) {
-				format_to(out, "-");
 			}
-			for(std::uint32_t i = 0; i < logical_per_physical; ++i) {
-				format_to(out, "*");
-				++cores_covered_physical;
+			if(show_dies) {
+				print_bar(out, die_start, cores_covered - die_start, total_addressable_cores);
+				format_to(out, " die      {:d}:{:d}\n", package.first, die.first);
 			}
-			for(std::uint32_t i = cores_covered_physical; i < total_addressable_cores; ++i) {
-				format_to(out, "-");
+		}
+		print_bar(out, package_start, cores_covered - package_start, total_addressable_cores);
+		format_to(out, " package  {:d}\n", package.first);
+	}
+}
+
+std::vector<std::uint32_t> apic_ids_of(const physical_core_t& physical) {
+	std::vector<std::uint32_t> ids;
+	ids.reserve(physical.logical_cores.size());
+	for(const auto& logical : physical.logical_cores) {
+		ids.push_back(logical.second.full_apic_id);
+	}
+	return ids;
+}
+
+// nodes can span packages, so they're listed after the packages rather than within them; sub-NUMA domains
+// can't, so they're listed by package first
+void print_numa_nodes(fmt::memory_buffer& out, const system_t& machine) {
+	const auto node_apic_ids = [&machine] (std::uint32_t node_id) {
+		std::vector<std::uint32_t> ids;
+		for(const auto& package : machine.packages) {
+			const auto node = package.second.nodes.find(node_id);
+			if(node != package.second.nodes.end()) {
+				for(const auto& physical : node->second.physical_cores) {
+					const std::vector<std::uint32_t> more = apic_ids_of(physical.second);
+					ids.insert(ids.end(), more.begin(), more.end());
+				}
 			}
-			format_to(out, " physical {:d}:{:d}\n", package.first, physical.first);
 		}
-		for(std::uint32_t i = 0; i < cores_covered_package; ++i) {
-			format_to(out, "-");
+		return ids;
+	};
+	for(const auto& domains : machine.sub_numa_domains) {
+		for(const std::uint32_t node : domains.second) {
+			format_to(out, "sub-numa {:d}:{:d} apic ids: {:s}\n", domains.first, node, describe_cpus(machine, node_apic_ids(node)));
+		}
+	}
+	for(const auto& distances : machine.node_distances) {
+		const std::vector<std::uint32_t> ids = node_apic_ids(distances.first);
+		format_to(out, "node     {:d} apic ids: {:s} distances:", distances.first, ids.empty() ? std::string("none") : describe_cpus(machine, ids));
+		for(const std::uint32_t distance : distances.second) {
+			format_to(out, " {:d}", distance);
 		}
-		for(std::uint32_t i = 0; i < logical_per_package; ++i) {
-			format_to(out, "*");
-			++cores_covered_package;
+		format_to(out, "\n");
+	}
+}
+
+void print_topology_ranges(fmt::memory_buffer& out, const system_t& machine, bool fold) {
+	for(const cache_t& cache : machine.all_caches) {
+		const std::string description = to_short_string(cache);
+		for(auto it = cache.instances.begin(); it != cache.instances.end(); ) {
+			std::vector<std::uint32_t> ids = it->second.sharing_ids;
+			std::size_t folded = 1;
+			auto next = std::next(it);
+			if(fold) {
+				for(; next != cache.instances.end() && next->second.sharing_ids.size() == it->second.sharing_ids.size(); ++next, ++folded) {
+					ids.insert(ids.end(), next->second.sharing_ids.begin(), next->second.sharing_ids.end());
+				}
+			}
+			if(folded > 1) {
+				format_to(out, "{:s} \u00d7 {:d} apic ids: {:s}\n", description, folded, to_cpulist(std::move(ids)));
+			} else {
+				format_to(out, "{:s} apic ids: {:s}\n", description, to_cpulist(std::move(ids)));
+			}
+			it = next;
 		}
-		for(std::uint32_t i = cores_covered_package; i < total_addressable_cores; ++i) {
-			format_to(out, "-");
+	}
+	format_to(out, "\n");
+
+	const bool show_modules = machine.valid_levels.count(level_type::module) != 0;
+	const bool show_tiles   = machine.valid_levels.count(level_type::tile  ) != 0;
+	const bool show_dies    = machine.valid_levels.count(level_type::die   ) != 0;
+	// AMD's equivalent of a tile is the CCX
+	const std::string_view tile_name = (machine.vendor & vendor_type::amd) != vendor_type::unknown ? "ccx " : "tile";
+
+	for(const auto& package : machine.packages) {
+		// each level's IDs are the run appended to the package's since the level began
+		std::vector<std::uint32_t> package_ids;
+		const auto ids_since = [&machine, &package_ids] (std::size_t start) {
+			return describe_cpus(machine, std::vector<std::uint32_t>(package_ids.begin() + static_cast<std::ptrdiff_t>(start), package_ids.end()));
+		};
+		for(const auto& die : package.second.dies) {
+			const std::size_t die_start = package_ids.size();
+			for(const auto& tile : die.second.tiles) {
+				const std::size_t tile_start = package_ids.size();
+				for(const auto& module : tile.second.modules) {
+					const std::size_t module_start = package_ids.size();
+					const auto& physical_cores = module.second.physical_cores;
+					for(auto it = physical_cores.begin(); it != physical_cores.end(); ) {
+						std::vector<std::uint32_t> ids = apic_ids_of(it->second);
+						auto next = std::next(it);
+						if(fold) {
+							std::vector<std::uint32_t> core_ids = { it->first };
+							for(; next != physical_cores.end() && next->second.logical_cores.size() == it->second.logical_cores.size() && core_type_of(next->second) == core_type_of(it->second); ++next) {
+								const std::vector<std::uint32_t> more = apic_ids_of(next->second);
+								ids.insert(ids.end(), more.begin(), more.end());
+								core_ids.push_back(next->first);
+							}
+							format_to(out, "physical {:d}:{:s} \u00d7 {:d} threads{:s} apic ids: {:s}\n", package.first, to_cpulist(std::move(core_ids)), it->second.logical_cores.size(), core_type_suffix(it->second), describe_cpus(machine, ids));
+						} else {
+							for(const auto& logical : it->second.logical_cores) {
+								format_to(out, "logical  {:d}:{:d}:{:d} apic id: {:#04x}{:s}\n", package.first, it->first, logical.first, logical.second.full_apic_id, os_cpu_suffix(logical.second));
+							}
+							format_to(out, "physical {:d}:{:d}{:s} apic ids: {:s}\n", package.first, it->first, core_type_suffix(it->second), describe_cpus(machine, ids));
+						}
+						package_ids.insert(package_ids.end(), ids.begin(), ids.end());
+						it = next;
+					}
+					if(show_modules) {
+						format_to(out, "module   {:d}:{:d}:{:d}:{:d} apic ids: {:s}\n", package.first, die.first, tile.first, module.first, ids_since(module_start));
+					}
+				}
+				if(show_tiles) {
+					format_to(out, "{:s}     {:d}:{:d}:{:d} apic ids: {:s}\n", tile_name, package.first, die.first, tile.first, ids_since(tile_start));
+				}
+			}
+			if(show_dies) {
+				format_to(out, "die      {:d}:{:d} apic ids: {:s}\n", package.first, die.first, ids_since(die_start));
+			}
 		}
-		format_to(out, " package  {:d}\n", package.first);
+		format_to(out, "package  {:d} apic ids: {:s}\n", package.first, describe_cpus(machine, package_ids));
+	}
+}
+
+}
+
+void print_topology(fmt::memory_buffer& out, const system_t& machine, topology_style style, bool fold) {
+	switch(style) {
+	case topology_style::bars:
+		print_topology_bars(out, machine);
+		break;
+	case topology_style::ranges:
+		print_topology_ranges(out, machine, fold);
+		break;
 	}
+	print_numa_nodes(out, machine);
+}
+
+void print_topology(fmt::memory_buffer& out, const system_t& machine) {
+	print_topology(out, machine, machine.all_cores.size() <= bar_style_limit ? topology_style::bars : topology_style::ranges, false);
 }
 
 }
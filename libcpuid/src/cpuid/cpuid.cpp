@@ -1,6 +1,8 @@
 ﻿#include "stdafx.h"
 
 #include "cpuid/cpuid.hpp"
+#include "cpuid/flag-spec.hpp"
+#include "cpuid/sink.hpp"
 #include "cache-and-topology.hpp"
 #include "features.hpp"
 #include "standard.hpp"
@@ -9,10 +11,13 @@
 #include "utility.hpp"
 
 #include <map>
+#include <set>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
 #include <tuple>
+#include <numeric>
+#include <unordered_map>
 
 #include <boost/algorithm/string.hpp>
 
@@ -234,7 +239,7 @@ const std::multimap<leaf_type, leaf_descriptor_t> descriptors = {
 	{ leaf_type::system_on_chip_vendor          , { intel                  , enumerate_system_on_chip_vendor, print_system_on_chip_vendor          , {} } },
 	{ leaf_type::deterministic_tlb              , { intel                  , enumerate_deterministic_tlb    , print_deterministic_tlb              , {} } },
 	{ leaf_type::reserved_6                     , { any                    , enumerate_null                 , print_null                           , {} } },
-	{ leaf_type::reserved_7                     , { any                    , enumerate_null                 , print_null                           , {} } },
+	{ leaf_type::hybrid_information             , { intel                  , nullptr                        , print_hybrid_information             , { leaf_type::extended_features              , subleaf_type::main, edx, 0x0000'8000_u32 } } },
 	{ leaf_type::pconfig                        , { any                    , enumerate_pconfig              , print_pconfig                        , { leaf_type::extended_features              , subleaf_type::main, edx, 0x0004'0000_u32 } } },
 	{ leaf_type::reserved_8                     , { any                    , enumerate_null                 , print_null                           , {} } },
 	{ leaf_type::reserved_9                     , { any                    , enumerate_null                 , print_null                           , {} } },
@@ -369,33 +374,134 @@ void enumerate_leaf(cpu_t& cpu, leaf_type leaf, bool brute_force, bool skip_vend
 	}
 }
 
+namespace {
+
+// a list of APIC IDs and ranges, such as 0x00000000-0x0000000d,0x00000010
+const std::string apic_list_pattern = "(0[xX][[:xdigit:]]{1,8}(?:[-,]0[xX][[:xdigit:]]{1,8})*)";
+
+// a range covers CPUs that are all present, so one spanning more than any real machine has is a corrupt dump,
+// not something to spend minutes and gigabytes expanding
+constexpr std::uint32_t max_apic_range = 0x1'0000_u32;
+
+template<typename Fn>
+void for_each_apic_id(const std::string& apic_ids, const std::string& line, Fn&& fn) {
+	for(std::size_t pos = 0; pos < apic_ids.size(); ) {
+		std::size_t end = 0;
+		const std::uint32_t first = gsl::narrow_cast<std::uint32_t>(std::stoul(apic_ids.substr(pos), &end, 16));
+		pos += end;
+		std::uint32_t last = first;
+		if(pos < apic_ids.size() && apic_ids[pos] == '-') {
+			last = gsl::narrow_cast<std::uint32_t>(std::stoul(apic_ids.substr(pos + 1), &end, 16));
+			pos += end + 1;
+			if(last < first) {
+				throw std::runtime_error(fmt::format("bad APIC ID range in {:s}", line));
+			}
+			if(last - first >= max_apic_range) {
+				throw std::runtime_error(fmt::format("APIC ID range of more than {:d} CPUs in {:s}", max_apic_range, line));
+			}
+		}
+		for(std::uint64_t apic_id = first; apic_id <= last; ++apic_id) {
+			fn(gsl::narrow_cast<std::uint32_t>(apic_id));
+		}
+		if(pos < apic_ids.size() && apic_ids[pos] == ',') {
+			++pos;
+		}
+	}
+}
+
+void print_apic_list(fmt::memory_buffer& out, const std::vector<std::uint32_t>& ids) {
+	for(std::size_t i = 0; i < ids.size(); ) {
+		std::size_t j = i;
+		while(j + 1 < ids.size() && ids[j + 1] == ids[j] + 1_u32) {
+			++j;
+		}
+		format_to(out, i == 0 ? "{:#010x}" : ",{:#010x}", ids[i]);
+		if(j != i) {
+			format_to(out, "-{:#010x}", ids[j]);
+		}
+		i = j + 1;
+	}
+}
+
+// reads a line of the native or folded format into logical_cpus, returning false if it isn't one
+bool parse_native_line(const std::string& line, std::map<std::uint32_t, cpu_t>& logical_cpus) {
+	const std::string single_element = "(0[xX][[:xdigit:]]{1,8})";
+	static const xp::sregex data_line(xp::sregex::compile(fmt::format("{} {} {}: {} {} {} {}", apic_list_pattern, single_element, single_element, single_element, single_element, single_element, single_element)));
+
+	xp::smatch m;
+	if(!xp::regex_search(line, m, data_line)) {
+		return false;
+	}
+	const leaf_type     leaf    = static_cast<leaf_type   >(std::stoul(m[2].str(), nullptr, 16));
+	const subleaf_type  subleaf = static_cast<subleaf_type>(std::stoul(m[3].str(), nullptr, 16));
+	const register_set_t regs   = {
+		gsl::narrow_cast<std::uint32_t>(std::stoul(m[4].str(), nullptr, 16)),
+		gsl::narrow_cast<std::uint32_t>(std::stoul(m[5].str(), nullptr, 16)),
+		gsl::narrow_cast<std::uint32_t>(std::stoul(m[6].str(), nullptr, 16)),
+		gsl::narrow_cast<std::uint32_t>(std::stoul(m[7].str(), nullptr, 16))
+	};
+	for_each_apic_id(m[1].str(), line, [&] (std::uint32_t apic_id) {
+		logical_cpus[apic_id].leaves[leaf][subleaf] = regs;
+	});
+	return true;
+}
+
+// fills in the vendor, model, and APIC ID from the leaves
+void identify_cpu(cpu_t& cpu) {
+	register_set_t regs = {};
+
+	regs = cpu.leaves.at(leaf_type::basic_info).at(subleaf_type::main);
+	cpu.vendor = get_vendor_from_name(regs);
+
+	regs = cpu.leaves.at(leaf_type::version_info).at(subleaf_type::main);
+	cpu.model = get_model(cpu.vendor, regs);
+
+	if(cpu.leaves.find(leaf_type::hypervisor_limit) != cpu.leaves.end()) {
+		regs = cpu.leaves.at(leaf_type::hypervisor_limit).at(subleaf_type::main);
+		if(regs[eax] != 0_u32) {
+			const vendor_type hypervisor = get_hypervisor_from_name(regs);
+			// something is set, and it looks like a hypervisor
+			if((hypervisor & vendor_type::any_hypervisor) != vendor_type::unknown) {
+				cpu.vendor = cpu.vendor | hypervisor;
+
+				if((hypervisor & vendor_type::hyper_v) != vendor_type::unknown) {
+					// xen with viridian extensions masquerades as hyper-v, and puts its own cpuid leaves 0x100 further up
+					if(cpu.leaves.find(leaf_type::xen_limit_offset) != cpu.leaves.end()) {
+						regs = cpu.leaves.at(leaf_type::xen_limit_offset).at(subleaf_type::main);
+						const vendor_type xen_hypervisor = get_hypervisor_from_name(regs);
+
+						if((xen_hypervisor & vendor_type::xen_hvm) != vendor_type::unknown) {
+							cpu.vendor = cpu.vendor | xen_hypervisor;
+						}
+					}
+				}
+			}
+		}
+	}
+	cpu.apic_id = get_apic_id(cpu);
+}
+
+}
+
 std::map<std::uint32_t, cpu_t> enumerate_file(std::istream& fin, file_format format) {
 	std::map<std::uint32_t, cpu_t> logical_cpus;
 
 	switch(format) {
 	case file_format::native:
+	case file_format::folded:
 		{
 			static const xp::sregex comment_line(xp::sregex::compile("#.*"));
-			const std::string single_element = "(0[xX][[:xdigit:]]{1,8})";
-			const std::string multiple_elements = fmt::format("{} {} {}: {} {} {} {}", single_element, single_element, single_element, single_element, single_element, single_element, single_element);
-			static const xp::sregex data_line(xp::sregex::compile(multiple_elements));
+			static const xp::sregex os_index_line(xp::sregex::compile("#os (0[xX][[:xdigit:]]{1,8}) ([[:digit:]]+)"));
 
 			std::string line;
 			while(std::getline(fin, line)) {
 				xp::smatch m;
-				if(xp::regex_search(line, m, comment_line) || line == "") {
+				if(xp::regex_search(line, m, os_index_line)) {
+					logical_cpus[std::stoul(m[1].str(), nullptr, 16)].os_index = std::stoul(m[2].str());
+				} else if(xp::regex_search(line, m, comment_line) || line == "") {
+					continue;
+				} else if(parse_native_line(line, logical_cpus)) {
 					continue;
-				} else if(xp::regex_search(line, m, data_line)) {
-					const std::uint32_t apic_id =                           std::stoul(m[1].str(), nullptr, 16) ;
-					const leaf_type     leaf    = static_cast<leaf_type   >(std::stoul(m[2].str(), nullptr, 16));
-					const subleaf_type  subleaf = static_cast<subleaf_type>(std::stoul(m[3].str(), nullptr, 16));
-					const register_set_t regs   = {
-						gsl::narrow_cast<std::uint32_t>(std::stoul(m[4].str(), nullptr, 16)),
-						gsl::narrow_cast<std::uint32_t>(std::stoul(m[5].str(), nullptr, 16)),
-						gsl::narrow_cast<std::uint32_t>(std::stoul(m[6].str(), nullptr, 16)),
-						gsl::narrow_cast<std::uint32_t>(std::stoul(m[7].str(), nullptr, 16))
-					};
-					logical_cpus[apic_id].leaves[leaf][subleaf] = regs;
 				} else {
 					//std::cerr << "Unrecognized line: " << line << std::endl;
 				}
@@ -419,7 +525,9 @@ std::map<std::uint32_t, cpu_t> enumerate_file(std::istream& fin, file_format for
 				} else if(xp::regex_search(line, m, solo_cpu_line)) {
 					++current_cpu;
 				} else if(xp::regex_search(line, m, cpu_line)) {
+					// etallen numbers the CPUs as the OS does
 					current_cpu = std::stoul(m[1].str());
+					logical_cpus[current_cpu].os_index = current_cpu;
 				} else if(xp::regex_search(line, m, data_line)) {
 					const leaf_type      leaf    = static_cast<leaf_type   >(std::stoul(m[1].str(), nullptr, 16));
 					const subleaf_type   subleaf = static_cast<subleaf_type>(std::stoul(m[2].str(), nullptr, 16));
@@ -578,41 +686,13 @@ std::map<std::uint32_t, cpu_t> enumerate_file(std::istream& fin, file_format for
 	case file_format::cpuinfo:
 		throw std::runtime_error("/proc/cpuinfo is not allowed as an input format");
 		break;
+	case file_format::hwloc_xml:
+		throw std::runtime_error("hwloc XML is not allowed as an input format");
+		break;
 	}
 
 	for(auto& c: logical_cpus) {
-		cpu_t& cpu = c.second;
-		register_set_t regs = {};
-
-		regs = cpu.leaves.at(leaf_type::basic_info).at(subleaf_type::main);
-		cpu.vendor = get_vendor_from_name(regs);
-
-		regs = cpu.leaves.at(leaf_type::version_info).at(subleaf_type::main);
-		cpu.model = get_model(cpu.vendor, regs);
-
-		if(cpu.leaves.find(leaf_type::hypervisor_limit) != cpu.leaves.end()) {
-			regs = cpu.leaves.at(leaf_type::hypervisor_limit).at(subleaf_type::main);
-			if(regs[eax] != 0_u32) {
-				const vendor_type hypervisor = get_hypervisor_from_name(regs);
-				// something is set, and it looks like a hypervisor
-				if((hypervisor & vendor_type::any_hypervisor) != vendor_type::unknown) {
-					cpu.vendor = cpu.vendor | hypervisor;
-
-					if((hypervisor & vendor_type::hyper_v) != vendor_type::unknown) {
-						// xen with viridian extensions masquerades as hyper-v, and puts its own cpuid leaves 0x100 further up
-						if(cpu.leaves.find(leaf_type::xen_limit_offset) != cpu.leaves.end()) {
-							regs = cpu.leaves.at(leaf_type::xen_limit_offset).at(subleaf_type::main);
-							const vendor_type xen_hypervisor = get_hypervisor_from_name(regs);
-
-							if((xen_hypervisor & vendor_type::xen_hvm) != vendor_type::unknown) {
-								cpu.vendor = cpu.vendor | xen_hypervisor;
-							}
-						}
-					}
-				}
-			}
-		}
-		cpu.apic_id = get_apic_id(cpu);
+		identify_cpu(c.second);
 	}
 	if(format != file_format::native) {
 		std::map<std::uint32_t, cpu_t> corrected_ids;
@@ -631,8 +711,9 @@ std::map<std::uint32_t, cpu_t> enumerate_file(std::istream& fin, file_format for
 
 std::map<std::uint32_t, cpu_t> enumerate_processors(bool brute_force, bool skip_vendor_check, bool skip_feature_check) {
 	std::map<std::uint32_t, cpu_t> logical_cpus;
-	run_on_every_core([=, &logical_cpus]() {
+	run_on_every_core([=, &logical_cpus](std::uint32_t os_index) {
 		cpu_t cpu = {};
+		cpu.os_index = os_index;
 		register_set_t regs = cpuid(leaf_type::basic_info, subleaf_type::main);
 		const leaf_type highest_leaf = leaf_type{ regs[eax] };
 		cpu.vendor = get_vendor_from_name(regs);
@@ -687,85 +768,11 @@ std::map<std::uint32_t, cpu_t> enumerate_processors(bool brute_force, bool skip_
 }
 
 flag_spec_t parse_flag_spec(const std::string& flag_description) {
-	const std::string hex_number       = "(?:0x)?([[:xdigit:]]+)H?";
-
-	const std::string simple_selector  = "(?:(?:EAX=)?{hex_number:s})";
-	const std::string complex_selector = R"((?:(?:\(EAX={hex_number:s}, ?ECX={hex_number:s}\))|(?:{hex_number:s}\.{hex_number:s})))";
-	const std::string selector         = "(?:{simple_selector:s}|{complex_selector:s})";
-	const std::string full_selector    = fmt::format(fmt::format(selector, fmt::arg("simple_selector", simple_selector),
-	                                                                       fmt::arg("complex_selector", complex_selector)), fmt::arg("hex_number", hex_number));
-
-	const std::string reg              = "(EAX|EBX|ECX|EDX)";
-
-	const std::string flagname         = "([[:alnum:]\\._-]+)";
-	const std::string single_bit       = "(?:bit )?([[:digit:]]+)";
-	const std::string bit_range        = "(?:bits )?([[:digit:]]+)[-:]([[:digit:]]+)";
-	const std::string bitspec          = "(?:{single_bit:s}|{bit_range:s})";
-	const std::string full_bitspec     = fmt::format(bitspec, fmt::arg("single_bit", single_bit), fmt::arg("bit_range", bit_range));
-	const std::string open_bracket     = R"((?:\(|\[))";
-	const std::string close_bracket    = R"((?:\)|\]))";
-	const std::string field            = R"((?:(\.{flagname:s} ?{open_bracket:s}{bitspec:s}{close_bracket:s})|(?:\.{flagname:s})|({open_bracket:s}{bitspec:s}{close_bracket:s})|(?:{open_bracket:s}{flagname:s}{close_bracket:s}))?)";
-	const std::string full_field       = fmt::format(field, fmt::arg("flagname", flagname), fmt::arg("bitspec", full_bitspec), fmt::arg("open_bracket", open_bracket), fmt::arg("close_bracket", close_bracket));
-
-	const std::string pattern          = R"(CPUID\.{selector:s}(?:\.|:){reg:s}{field:s})";
-
-	const std::string full_pattern     = fmt::format(pattern, fmt::arg("selector", full_selector), fmt::arg("reg", reg), fmt::arg("field", full_field));
-
-	static xp::sregex re_pattern(xp::sregex::compile(full_pattern, xp::sregex::optimize | xp::sregex::icase));
-	xp::smatch m;
-	if(!xp::regex_search(flag_description, m, re_pattern)) {
+	const std::optional<constant_flag_spec_t> spec = try_parse_flag_spec(flag_description);
+	if(!spec) {
 		throw std::runtime_error(fmt::format("Bad pattern: {:s}", flag_description));
 	}
-
-	flag_spec_t spec = {};
-
-	if(m[1].matched) {
-		spec.selector_eax = std::stoul(m[1].str(), nullptr, 16);
-	} else if(m[2].matched) {
-		spec.selector_eax = std::stoul(m[2].str(), nullptr, 16);
-		spec.selector_ecx = m[3].matched ? std::stoul(m[3].str(), nullptr, 16) : 0_u32;
-	} else if(m[4].matched) {
-		spec.selector_eax = std::stoul(m[4].str(), nullptr, 16);
-		spec.selector_ecx = m[5].matched ? std::stoul(m[5].str(), nullptr, 16) : 0_u32;
-	}
-
-	const std::string reg_name = boost::algorithm::to_lower_copy(m[6].str());
-	if(reg_name == "eax") {
-		spec.flag_register = eax;
-	} else if(reg_name == "ebx") {
-		spec.flag_register = ebx;
-	} else if(reg_name == "ecx") {
-		spec.flag_register = ecx;
-	} else if(reg_name == "edx") {
-		spec.flag_register = edx;
-	}
-
-	if(m[7].matched) {
-		spec.flag_name = m[8].str();
-		if(m[9].matched) {
-			spec.flag_start = std::stoul(m[9].str());
-			spec.flag_end   = spec.flag_start;
-		} else if(m[10].matched) {
-			spec.flag_start = std::stoul(m[11].str());
-			spec.flag_end   = std::stoul(m[10].str());
-		}
-	} else if(m[12].matched) {
-		spec.flag_name = m[12].str();
-	} else if(m[13].matched) {
-		if(m[14].matched) {
-			spec.flag_start = std::stoul(m[14].str());
-			spec.flag_end   = spec.flag_start;
-		} else if(m[15].matched) {
-			spec.flag_start = std::stoul(m[16].str());
-			spec.flag_end   = std::stoul(m[15].str());
-		}
-	}
-	else if(m[17].matched) {
-		spec.flag_name = m[17].str();
-	}
-	boost::algorithm::to_lower(spec.flag_name);
-
-	return spec;
+	return *spec;
 }
 
 std::string to_string(register_type reg) {
@@ -815,57 +822,182 @@ std::string to_string(const flag_spec_t& spec) {
 	}
 }
 
+flag_location_t resolve_flag_spec(const flag_spec_t& spec) {
+	flag_location_t location = { static_cast<leaf_type>(spec.selector_eax), static_cast<subleaf_type>(spec.selector_ecx), spec.flag_register, 0_u32 };
+	if(spec.flag_name == "" && spec.flag_start == 0xffff'ffff_u32 && spec.flag_end == 0xffff'ffff_u32) {
+		location.mask = 0xffff'ffff_u32;
+		return location;
+	}
+	if(spec.flag_name != "") {
+		const std::string flag_name_alternative = boost::algorithm::replace_all_copy(spec.flag_name, "_", ".");
+		const auto range = all_features.equal_range(location.leaf);
+		for(auto it = range.first; it != range.second; ++it) {
+			const auto sub = it->second.find(location.subleaf);
+			if(sub == it->second.end()) {
+				continue;
+			}
+			const auto reg = sub->second.find(location.reg);
+			if(reg == sub->second.end()) {
+				continue;
+			}
+			for(const feature_t& feature : reg->second) {
+				const std::string lower_mnemonic = boost::algorithm::to_lower_copy(feature.mnemonic);
+				if(lower_mnemonic == spec.flag_name
+				|| lower_mnemonic == flag_name_alternative) {
+					location.mask = feature.mask;
+					return location;
+				}
+			}
+		}
+	}
+	if(spec.flag_start != 0xffff'ffff_u32 && spec.flag_end != 0xffff'ffff_u32) {
+		location.mask = range_mask(spec.flag_start, spec.flag_end);
+	}
+	return location;
+}
+
+std::optional<std::uint32_t> get_flag_value(const cpu_t& cpu, const flag_location_t& location) noexcept {
+	if(location.mask == 0_u32) {
+		return std::nullopt;
+	}
+	const auto leaf = cpu.leaves.find(location.leaf);
+	if(leaf == cpu.leaves.end()) {
+		return std::nullopt;
+	}
+	const auto subleaf = leaf->second.find(location.subleaf);
+	if(subleaf == leaf->second.end()) {
+		return std::nullopt;
+	}
+	unsigned long shift_amount = 0;
+	bit_scan_forward(&shift_amount, location.mask);
+	return (subleaf->second[location.reg] & location.mask) >> shift_amount;
+}
+
 void print_single_flag(fmt::memory_buffer& out, const cpu_t& cpu, const flag_spec_t& spec) {
 	const std::string flag_description = to_string(spec);
-	const std::string flag_name_alternative = boost::algorithm::replace_all_copy(spec.flag_name, "_", ".");
-
-	const leaf_type    leaf    = static_cast<leaf_type   >(spec.selector_eax);
-	const subleaf_type subleaf = static_cast<subleaf_type>(spec.selector_ecx);
-	bool handled = false;
-	if(cpu.leaves.find(leaf) != cpu.leaves.end()
-	&& cpu.leaves.at(leaf).find(subleaf) != cpu.leaves.at(leaf).end()) {
-		const std::uint32_t value = cpu.leaves.at(leaf).at(subleaf).at(spec.flag_register);
-		if(spec.flag_name == "" && spec.flag_start == 0xffff'ffff_u32 && spec.flag_end == 0xffff'ffff_u32) {
-			format_to(out, "cpu {:#04x} {:s}: {:#010x}\n", cpu.apic_id, flag_description, value);
-			handled = true;
-		}
-		if(spec.flag_name != "") {
-			const auto range = all_features.equal_range(leaf);
-			for(auto it = range.first; it != range.second; ++it) {
-				if(it->second.find(subleaf) == it->second.end()) {
-					continue;
-				}
-				auto sub = it->second.at(subleaf);
-				if(sub.find(spec.flag_register) == sub.end()) {
-					continue;
-				}
-				for(const feature_t& feature : sub.at(spec.flag_register)) {
-					const std::string lower_mnemonic = boost::algorithm::to_lower_copy(feature.mnemonic);
-					if(lower_mnemonic == spec.flag_name
-					|| lower_mnemonic == flag_name_alternative) {
-						unsigned long shift_amount = 0;
-						bit_scan_forward(&shift_amount, feature.mask);
-						const std::uint32_t result = (value & feature.mask) >> shift_amount;
-
-						format_to(out, "cpu {:#04x} {:s}: {:#010x}\n", cpu.apic_id, flag_description, result);
-						handled = true;
-						break;
+	const std::optional<std::uint32_t> value = get_flag_value(cpu, resolve_flag_spec(spec));
+	if(value) {
+		format_to(out, "cpu {:#04x} {:s}: {:#010x}\n", cpu.apic_id, flag_description, *value);
+	} else {
+		format_to(out, "No data found for {:s}\n", flag_description);
+	}
+}
+
+flag_values_t evaluate_flag_specs(const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const std::vector<flag_spec_t>& specs) {
+	std::vector<flag_location_t> locations;
+	locations.reserve(specs.size());
+	for(const flag_spec_t& spec : specs) {
+		locations.push_back(resolve_flag_spec(spec));
+	}
+
+	// visit the specs in leaf order, so that each leaf is looked up once per CPU no matter how many specs refer to it
+	std::vector<std::size_t> order(specs.size());
+	std::iota(order.begin(), order.end(), std::size_t{ 0 });
+	std::stable_sort(order.begin(), order.end(), [&locations](std::size_t lhs, std::size_t rhs) {
+		return std::tie(locations[lhs].leaf, locations[lhs].subleaf) < std::tie(locations[rhs].leaf, locations[rhs].subleaf);
+	});
+
+	flag_values_t values;
+	values.reserve(apic_ids.size());
+	for(const std::uint32_t apic_id : apic_ids) {
+		const cpu_t& cpu = logical_cpus.at(apic_id);
+		std::vector<std::optional<std::uint32_t>> row(specs.size());
+		const register_set_t* regs = nullptr;
+		for(std::size_t i = 0; i < order.size(); ++i) {
+			const flag_location_t& location = locations[order[i]];
+			if(i == 0
+			|| location.leaf    != locations[order[i - 1]].leaf
+			|| location.subleaf != locations[order[i - 1]].subleaf) {
+				regs = nullptr;
+				const auto leaf = cpu.leaves.find(location.leaf);
+				if(leaf != cpu.leaves.end()) {
+					const auto subleaf = leaf->second.find(location.subleaf);
+					if(subleaf != leaf->second.end()) {
+						regs = &subleaf->second;
 					}
 				}
 			}
+			if(regs != nullptr && location.mask != 0_u32) {
+				unsigned long shift_amount = 0;
+				bit_scan_forward(&shift_amount, location.mask);
+				row[order[i]] = ((*regs)[location.reg] & location.mask) >> shift_amount;
+			}
 		}
-		if(!handled && spec.flag_start != 0xffff'ffff_u32 && spec.flag_end != 0xffff'ffff_u32) {
-			const std::uint32_t mask = range_mask(spec.flag_start, spec.flag_end);
-			unsigned long shift_amount = 0;
-			bit_scan_forward(&shift_amount, mask);
-			const std::uint32_t result = (value & mask) >> shift_amount;
-			format_to(out, "cpu {:#04x} {:s}: {:#010x}\n", cpu.apic_id, flag_description, result);
-			handled = true;
-		}
+		values.push_back(std::move(row));
 	}
+	return values;
+}
 
-	if(!handled) {
-		format_to(out, "No data found for {:s}\n", flag_description);
+void print_flag_values(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const std::vector<flag_spec_t>& specs, value_format format) {
+	const flag_values_t values = evaluate_flag_specs(logical_cpus, apic_ids, specs);
+	std::vector<std::string> descriptions;
+	descriptions.reserve(specs.size());
+	for(const flag_spec_t& spec : specs) {
+		descriptions.push_back(to_string(spec));
+	}
+
+	switch(format) {
+	case value_format::text:
+		for(std::size_t row = 0; row < apic_ids.size(); ++row) {
+			for(std::size_t column = 0; column < specs.size(); ++column) {
+				if(values[row][column]) {
+					format_to(out, "cpu {:#04x} {:s}: {:#010x}\n", apic_ids[row], descriptions[column], *values[row][column]);
+				} else {
+					format_to(out, "No data found for {:s}\n", descriptions[column]);
+				}
+			}
+		}
+		break;
+	case value_format::table:
+		{
+			std::vector<std::size_t> widths;
+			for(const std::string& description : descriptions) {
+				widths.push_back(std::max(description.size(), std::size_t{ 10 }));
+			}
+			// the last column is left unpadded, to avoid trailing whitespace
+			const auto print_cell = [&out, &widths](std::size_t column, const std::string& cell) {
+				format_to(out, "  {:<{}s}", cell, column + 1 == widths.size() ? 0 : widths[column]);
+			};
+			// x2APIC IDs run past 0xff, so the first column is as wide as the widest of them
+			std::vector<std::string> cpus;
+			cpus.reserve(apic_ids.size());
+			std::size_t cpu_width = 4;
+			for(const std::uint32_t apic_id : apic_ids) {
+				cpus.push_back(fmt::format("{:#04x}", apic_id));
+				cpu_width = std::max(cpu_width, cpus.back().size());
+			}
+			format_to(out, "{:<{}s}", "cpu", cpu_width);
+			for(std::size_t column = 0; column < specs.size(); ++column) {
+				print_cell(column, descriptions[column]);
+			}
+			format_to(out, "\n");
+			for(std::size_t row = 0; row < apic_ids.size(); ++row) {
+				format_to(out, "{:<{}s}", cpus[row], cpu_width);
+				for(std::size_t column = 0; column < specs.size(); ++column) {
+					print_cell(column, values[row][column] ? fmt::format("{:#010x}", *values[row][column]) : "-");
+				}
+				format_to(out, "\n");
+			}
+		}
+		break;
+	case value_format::csv:
+		format_to(out, "apic_id");
+		for(const std::string& description : descriptions) {
+			format_to(out, ",\"{:s}\"", description);
+		}
+		format_to(out, "\n");
+		for(std::size_t row = 0; row < apic_ids.size(); ++row) {
+			format_to(out, "{:#04x}", apic_ids[row]);
+			for(std::size_t column = 0; column < specs.size(); ++column) {
+				if(values[row][column]) {
+					format_to(out, ",{:#010x}", *values[row][column]);
+				} else {
+					format_to(out, ",");
+				}
+			}
+			format_to(out, "\n");
+		}
+		break;
 	}
 }
 
@@ -898,13 +1030,204 @@ void print_leaves(fmt::memory_buffer& out, const cpu_t& cpu, bool skip_vendor_ch
 	}
 }
 
-void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_cpus, file_format format) {
+void print_leaves(output_sink_t& sink, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, bool skip_vendor_check, bool skip_feature_check) {
+	format_in_parallel(apic_ids.size(), [&] (fmt::memory_buffer& buffer, std::size_t i) {
+		print_leaves(buffer, logical_cpus.at(apic_ids[i]), skip_vendor_check, skip_feature_check);
+	}, [&] (const fmt::memory_buffer& buffer) {
+		sink.buffer().append(buffer.data(), buffer.data() + buffer.size());
+		sink.commit();
+	});
+}
+
+void print_leaf_differences(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, bool skip_vendor_check, bool skip_feature_check) {
+	struct leaf_class_t
+	{
+		const cpu_t* representative;
+		std::vector<std::uint32_t> apic_ids;
+	};
+
+	constexpr std::size_t decoded_class_limit = 4;
+
+	struct subleaves_less
+	{
+		bool operator()(const subleaves_t* lhs, const subleaves_t* rhs) const {
+			return *lhs < *rhs;
+		}
+	};
+
+	std::set<leaf_type> all_leaves;
+	for(const std::uint32_t apic_id : apic_ids) {
+		for(const auto& leaf : logical_cpus.at(apic_id).leaves) {
+			all_leaves.insert(leaf.first);
+		}
+	}
+
+	// CPUs are grouped by the contents of each leaf, with classes in the order their first CPU was chosen
+	std::map<leaf_type, std::vector<leaf_class_t>> leaf_classes;
+	std::map<leaf_type, std::vector<std::uint32_t>> missing;
+	for(const leaf_type leaf : all_leaves) {
+		std::vector<leaf_class_t>& classes = leaf_classes[leaf];
+		std::map<const subleaves_t*, std::size_t, subleaves_less> class_of;
+		for(const std::uint32_t apic_id : apic_ids) {
+			const cpu_t& cpu = logical_cpus.at(apic_id);
+			const auto it = cpu.leaves.find(leaf);
+			if(it == cpu.leaves.end()) {
+				missing[leaf].push_back(apic_id);
+				continue;
+			}
+			const auto c = class_of.insert({ &it->second, classes.size() });
+			if(c.second) {
+				classes.push_back({ &cpu, {} });
+			}
+			classes[c.first->second].apic_ids.push_back(apic_id);
+		}
+	}
+
+	format_to(out, "Identical on all {:d} CPUs:\n\n", apic_ids.size());
+	for(const auto& l : leaf_classes) {
+		if(l.second.size() == 1 && missing.find(l.first) == missing.end()) {
+			print_leaf(out, *l.second.front().representative, l.first, skip_vendor_check, skip_feature_check);
+		}
+	}
+
+	for(const auto& l : leaf_classes) {
+		const leaf_type leaf = l.first;
+		const std::vector<leaf_class_t>& classes = l.second;
+		if(classes.size() == 1 && missing.find(leaf) == missing.end()) {
+			continue;
+		}
+
+		// every subleaf and register whose value is not the same for all the classes
+		std::set<subleaf_type> subleaves;
+		for(const leaf_class_t& c : classes) {
+			for(const auto& sub : c.representative->leaves.at(leaf)) {
+				subleaves.insert(sub.first);
+			}
+		}
+		std::vector<std::pair<subleaf_type, register_type>> varying;
+		for(const subleaf_type subleaf : subleaves) {
+			for(register_type reg = eax; reg <= edx; ++reg) {
+				std::optional<std::uint32_t> first_value;
+				bool varies = false;
+				for(const leaf_class_t& c : classes) {
+					const subleaves_t& subs = c.representative->leaves.at(leaf);
+					const auto sub = subs.find(subleaf);
+					const std::optional<std::uint32_t> value = sub != subs.end() ? std::optional<std::uint32_t>(sub->second[reg]) : std::nullopt;
+					if(&c == &classes.front()) {
+						first_value = value;
+					} else if(value != first_value) {
+						varies = true;
+						break;
+					}
+				}
+				if(varies) {
+					varying.push_back({ subleaf, reg });
+				}
+			}
+		}
+
+		format_to(out, "\x1b[33;1mLeaf {:#010x} differs in", static_cast<std::uint32_t>(leaf));
+		for(const auto& v : varying) {
+			format_to(out, " {:#x}:{:s}", static_cast<std::uint32_t>(v.first), to_string(v.second));
+		}
+		if(varying.empty()) {
+			format_to(out, " presence");
+		}
+		format_to(out, "\x1b[0m\n");
+		const auto absent = missing.find(leaf);
+		if(absent != missing.end()) {
+			format_to(out, "absent on apic ids {:s}\n", to_cpulist(absent->second));
+		}
+		// when every CPU is different (as with APIC IDs), decoding each one would be no better than --all-cpus,
+		// so beyond a handful of classes, only the first is decoded, and the rest show just the differing registers
+		for(std::size_t i = 0; i < classes.size(); ++i) {
+			const leaf_class_t& c = classes[i];
+			if(i < decoded_class_limit) {
+				format_to(out, "apic ids {:s}:\n", to_cpulist(c.apic_ids));
+				print_leaf(out, *c.representative, leaf, skip_vendor_check, skip_feature_check);
+			} else {
+				format_to(out, "apic ids {:s}:", to_cpulist(c.apic_ids));
+				const subleaves_t& subs = c.representative->leaves.at(leaf);
+				for(const auto& v : varying) {
+					const auto sub = subs.find(v.first);
+					if(sub != subs.end()) {
+						format_to(out, " {:#x}:{:s}={:#010x}", static_cast<std::uint32_t>(v.first), to_string(v.second), sub->second[v.second]);
+					}
+				}
+				format_to(out, "\n");
+			}
+		}
+		if(classes.size() > decoded_class_limit) {
+			format_to(out, "\n");
+		}
+	}
+}
+
+namespace {
+
+// when there is a sink, its buffer is out, and each CPU's output is committed once it's formatted
+void print_dump(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, file_format format, output_sink_t* sink) {
+	const auto checkpoint = [sink] () {
+		if(sink) {
+			sink->commit();
+		}
+	};
+
 	switch(format) {
 	case file_format::native:
 		format_to(out, "#apic eax ecx: eax ebx ecx edx\n");
 		for(const auto& p : logical_cpus) {
+			// older readers take this for a comment
+			if(p.second.os_index != unknown_id) {
+				format_to(out, "#os {:#010x} {:d}\n", p.second.apic_id, p.second.os_index);
+			}
 			print_generic(out, p.second);
 			format_to(out, "\n");
+			checkpoint();
+		}
+		break;
+	case file_format::folded:
+		{
+			// each distinct register set is written once, with every CPU that reports it, so only
+			// the leaves that vary between CPUs take more than a line; lines are ordered by leaf,
+			// subleaf, then first APIC ID
+			std::map<std::pair<leaf_type, subleaf_type>, std::map<register_set_t, std::vector<std::uint32_t>>> groups;
+			for(const auto& c : logical_cpus) {
+				for(const auto& l : c.second.leaves) {
+					for(const auto& s : l.second) {
+						groups[{ l.first, s.first }][s.second].push_back(c.first);
+					}
+				}
+			}
+
+			format_to(out, "#apic eax ecx: eax ebx ecx edx\n");
+			format_to(out, "#apic may be a list of IDs and ranges, such as 0x00000000-0x0000000d,0x00000010\n");
+			for(const auto& c : logical_cpus) {
+				if(c.second.os_index != unknown_id) {
+					format_to(out, "#os {:#010x} {:d}\n", c.first, c.second.os_index);
+				}
+			}
+			std::vector<std::pair<const std::vector<std::uint32_t>*, const register_set_t*>> lines;
+			for(const auto& g : groups) {
+				lines.clear();
+				for(const auto& r : g.second) {
+					lines.push_back({ &r.second, &r.first });
+				}
+				std::sort(lines.begin(), lines.end(), [] (const auto& lhs, const auto& rhs) {
+					return lhs.first->front() < rhs.first->front();
+				});
+				for(const auto& line : lines) {
+					print_apic_list(out, *line.first);
+					const register_set_t& regs = *line.second;
+					format_to(out, " {:#010x} {:#010x}: {:#010x} {:#010x} {:#010x} {:#010x}\n", static_cast<std::uint32_t>(g.first.first),
+					                                                                          static_cast<std::uint32_t>(g.first.second),
+					                                                                          regs[eax],
+					                                                                          regs[ebx],
+					                                                                          regs[ecx],
+					                                                                          regs[edx]);
+				}
+				checkpoint();
+			}
 		}
 		break;
 	case file_format::etallen:
@@ -926,6 +1249,7 @@ void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_
 						                                                                                             regs[edx]);
 					}
 				}
+				checkpoint();
 				++count;
 			}
 		}
@@ -1005,17 +1329,114 @@ void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_
 					}
 				}
 				format_to(out, "\n");
+				checkpoint();
 				++count;
 			}
 		}
 		break;
 	case file_format::cpuinfo:
 		{
-			system_t system = build_topology(logical_cpus);
+			const system_t system = build_topology(logical_cpus);
 
-			std::uint32_t count = 0_u32;
+			// everything that depends only on the machine or the package is worked out once, up front
+			const std::uint32_t cache_size = [&] () {
+				std::map<std::uint32_t, std::uint32_t> max_sizes;
+				for(const auto& cache : system.all_caches) {
+					max_sizes[cache.level] = std::max(max_sizes[cache.level], cache.total_size);
+				}
+				return max_sizes.empty() ? 0_u32 : std::prev(max_sizes.end())->second;
+			}();
+
+			struct placement_t
+			{
+				std::uint32_t core_id;
+				std::uint32_t package_id;
+			};
+
+			std::unordered_map<std::uint32_t, placement_t> placements;
+			std::map<std::uint32_t, std::uint32_t> logicals_per_package;
+			placements.reserve(system.all_cores.size());
+			for(const auto& core : system.all_cores) {
+				placements.insert({ core.full_apic_id, { core.core_id, core.package_id } });
+				++logicals_per_package[core.package_id];
+			}
+
+			// the brand string, and the frequency written in it, are the same for every CPU with the same brand leaves,
+			// so each distinct one is parsed once
+			struct brand_t
+			{
+				std::string name;
+				std::uint32_t mhz;
+			};
+
+			// dumps needn't have the brand leaves at all
+			const auto find_brand_leaf = [] (const cpu_t& cpu, std::size_t i) -> const register_set_t* {
+				const auto l = cpu.leaves.find(static_cast<leaf_type>(static_cast<std::uint32_t>(leaf_type::brand_string_0) + i));
+				if(l == cpu.leaves.end() || l->second.find(subleaf_type::main) == l->second.end()) {
+					return nullptr;
+				}
+				return &l->second.at(subleaf_type::main);
+			};
+
+			const auto get_mhz_from_brand = [] (const std::string& brand) {
+				const std::string::size_type hertz = brand.rfind("Hz");
+				if(hertz == std::string::npos || hertz == 0) {
+					return 0_u32;
+				}
+				std::uint32_t to_megahertz = 1_u32;
+				switch(brand[hertz - 1]) {
+				case 'T': to_megahertz *= 1'000_u32; [[fallthrough]];
+				case 'G': to_megahertz *= 1'000_u32; [[fallthrough]];
+				case 'M':
+					{
+						const std::string::size_type freq_pos = brand.rfind(' ', hertz - 1);
+						if(freq_pos == std::string::npos) {
+							return 0_u32;
+						}
+						// strtod gives 0 rather than throwing when there's no number, as in "2.40 GHz"
+						const std::string freq_str = brand.substr(freq_pos + 1, hertz - 1 - freq_pos - 1);
+						return gsl::narrow_cast<std::uint32_t>(std::strtod(freq_str.c_str(), nullptr) * to_megahertz);
+					}
+				default:
+					return 0_u32;
+				}
+			};
+
+			const auto parse_brand = [&] (const cpu_t& cpu) {
+				std::string raw;
+				for(std::size_t i = 0; i < 3; ++i) {
+					if(const register_set_t* regs = find_brand_leaf(cpu, i)) {
+						const std::array<char, 16> part = bit_cast<decltype(part)>(*regs);
+						raw.append(part.begin(), part.end());
+					}
+				}
+				brand_t brand = { raw, get_mhz_from_brand(raw) };
+				// the padding isn't printed
+				brand.name.erase(std::remove(brand.name.begin(), brand.name.end(), '\0'), brand.name.end());
+				return brand;
+			};
+
+			std::vector<const cpu_t*> cpus;
+			std::vector<const brand_t*> brand_of;
+			std::map<std::array<register_set_t, 3>, brand_t> brands;
+			cpus.reserve(logical_cpus.size());
+			brand_of.reserve(logical_cpus.size());
 			for(const auto& c : logical_cpus) {
-				const auto& cpu = c.second;
+				std::array<register_set_t, 3> key = {};
+				for(std::size_t i = 0; i < key.size(); ++i) {
+					if(const register_set_t* regs = find_brand_leaf(c.second, i)) {
+						key[i] = *regs;
+					}
+				}
+				auto it = brands.find(key);
+				if(it == brands.end()) {
+					it = brands.insert({ key, parse_brand(c.second) }).first;
+				}
+				cpus.push_back(&c.second);
+				brand_of.push_back(&it->second);
+			}
+
+			const auto format_cpu = [&] (fmt::memory_buffer& buffer, std::uint32_t count, const cpu_t& cpu, const brand_t& brand) {
 				const auto get_vendor_id = [&] () {
 					const register_set_t& regs = cpu.leaves.at(leaf_type::basic_info).at(subleaf_type::main);
 					const std::array<char, 12> vndr = bit_cast<decltype(vndr)>(
@@ -1028,17 +1449,6 @@ void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_
 					return vndr;
 				};
 
-				const auto get_brand_string = [&] () {
-					const std::array<char, 48> brand = bit_cast<decltype(brand)>(
-						std::array<register_set_t, 3> {
-							cpu.leaves.at(leaf_type::brand_string_0).at(subleaf_type::main),
-							cpu.leaves.at(leaf_type::brand_string_1).at(subleaf_type::main),
-							cpu.leaves.at(leaf_type::brand_string_2).at(subleaf_type::main)
-						}
-					);
-					return brand;
-				};
-
 				const auto get_mhz = [&] () {
 					switch(cpu.vendor & vendor_type::any_silicon) {
 					case vendor_type::intel:
@@ -1053,35 +1463,9 @@ void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_
 
 								const frequency_t a = bit_cast<decltype(a)>(regs[eax]);
 								return a.frequency;
-							} else if(cpu.leaves.find(leaf_type::brand_string_2) != cpu.leaves.end()) {
-								const auto raw_brand = get_brand_string();
-								const std::string brand(std::begin(raw_brand), std::end(raw_brand));
-								const std::string::size_type hertz = brand.rfind("Hz");
-								if(hertz == std::string::npos) {
-									return 0_u32;
-								}
-								std::size_t to_megahertz = 1_u64;
-								switch(brand.at(hertz - 1)) {
-								case 'T': to_megahertz *= 1'000_u64; [[fallthrough]];
-								case 'G': to_megahertz *= 1'000_u64; [[fallthrough]];
-								case 'M':
-									{
-										const std::string::size_type freq_pos = brand.rfind(' ', hertz - 1);
-										if(freq_pos == std::string::npos) {
-											return 0_u32;
-										}
-										const std::string freq_str = brand.substr(freq_pos + 1, hertz - 1 - freq_pos - 1);
-										const double raw_freq = std::stod(freq_str);
-										const std::uint32_t frequency = gsl::narrow_cast<std::uint32_t>(raw_freq * to_megahertz);
-										return frequency;
-									}
-									break;
-								default:
-									return 0_u32;
-								}
 							}
+							return brand.mhz;
 						}
-						break;
 					case vendor_type::amd:
 						break;
 					default:
@@ -1090,42 +1474,13 @@ void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_
 					return 0_u32;
 				};
 
-				const auto get_cache_size = [&] () {
-					std::map<std::uint32_t, std::uint32_t> max_sizes;
-					for(const auto& cache : system.all_caches) {
-						max_sizes[cache.level] = std::max(max_sizes[cache.level], cache.total_size);
-					}
-					return max_sizes.empty() ? 0_u32 : std::prev(max_sizes.end())->second;
-				};
-
-				const auto get_core_id = [&] () noexcept {
-					for(const auto& core : system.all_cores) {
-						if(core.full_apic_id == cpu.apic_id) {
-							return core.core_id;
-						}
-					}
-					return 0_u32;
-				};
-
-				const auto get_package_id = [&] () noexcept {
-					for(const auto& core : system.all_cores) {
-						if(core.full_apic_id == cpu.apic_id) {
-							return core.package_id;
-						}
-					}
-					return 0_u32;
-				};
-
-				const auto get_logical_core_count = [&] () noexcept {
-					const std::uint32_t package_id = get_package_id();
-					std::uint32_t logicals = 0_u32;
-					for(const auto& core : system.all_cores) {
-						if(core.package_id == package_id) {
-							++logicals;
-						}
-					}
-					return logicals;
-				};
+				const auto placement = placements.find(cpu.apic_id);
+				const std::uint32_t core_id    = placement != placements.end() ? placement->second.core_id    : 0_u32;
+				const std::uint32_t package_id = placement != placements.end() ? placement->second.package_id : 0_u32;
+				const auto logicals = logicals_per_package.find(package_id);
+				const auto package  = system.packages.find(package_id);
+				const std::uint32_t logical_core_count  = logicals != logicals_per_package.end() ? logicals->second : 0_u32;
+				const std::size_t   physical_core_count = package  != system.packages.end()      ? package->second.physical_cores.size() : 0;
 
 				const auto has_feature = [&] (leaf_type leaf, subleaf_type subleaf, register_type reg, std::uint32_t bit) {
 					if(cpu.leaves.find(leaf) != cpu.leaves.end()) {
@@ -1168,9 +1523,9 @@ void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_
 				};
 
 				const auto get_flush_size = [&] () {
-					const register_set_t& regs = cpu.leaves.at(leaf_type::version_info).at(subleaf_type::main);
-					const id_info_t b = bit_cast<decltype(b)>(regs[ebx]);
 					if(has_feature(leaf_type::version_info, subleaf_type::main, ecx, 19_u32)) {
+						const register_set_t& regs = cpu.leaves.at(leaf_type::version_info).at(subleaf_type::main);
+						const id_info_t b = bit_cast<decltype(b)>(regs[ebx]);
 						return b.cache_line_size * 8_u32;
 					}
 					return 0_u32;
@@ -1204,41 +1559,205 @@ void print_dump(fmt::memory_buffer& out, std::map<std::uint32_t, cpu_t> logical_
 				const std::string bugs  = boost::algorithm::join(get_linux_bugs            (cpu), " ");
 				const std::string pm    = boost::algorithm::join(get_linux_power_management(cpu), " ");
 
-				format_to(out, "processor       : {:d}\n", count);
-				format_to(out, "vendor_id       : {}\n", get_vendor_id());
-				format_to(out, "cpu family      : {:d}\n", cpu.model.family);
-				format_to(out, "model           : {:d}\n", cpu.model.model);
-				format_to(out, "model name      : {}\n", get_brand_string());
-				format_to(out, "stepping        : {:d}\n", cpu.model.stepping);
-				format_to(out, "microcode       : {:#x}\n", 0xffff'ffff_u32);
-				format_to(out, "cpu MHz         : {:d} MHz\n", get_mhz());
-				format_to(out, "cache size      : {:d} KB\n", get_cache_size() / 1'024_u32);
-				format_to(out, "physical id     : {:d}\n", get_package_id());
-				format_to(out, "siblings        : {:d}\n", get_logical_core_count());
-				format_to(out, "core id         : {:d}\n", get_core_id());
-				format_to(out, "cpu cores       : {:d}\n", system.packages[get_package_id()].physical_cores.size());
-				format_to(out, "apicid          : {:d}\n", get_apic_id(cpu));
-				format_to(out, "initial apicid  : {:d}\n", get_initial_apic_id(cpu));
-				format_to(out, "fpu             : {:s}\n", get_feature(leaf_type::version_info, edx, 0_u32, "yes"));
-				format_to(out, "fpu_exception   : {:s}\n", get_feature(leaf_type::version_info, edx, 0_u32, "yes"));
-				format_to(out, "cpuid level     : {:d}\n", cpu.leaves.at(leaf_type::basic_info).at(subleaf_type::main).at(eax));
-				format_to(out, "wp              : yes\n");
-				format_to(out, "flags           : {:s}\n", flags);
-				format_to(out, "bugs            : {:s}\n", bugs);
-				format_to(out, "bogomips        : \n");
+				format_to(buffer, "processor       : {:d}\n", count);
+				format_to(buffer, "vendor_id       : {}\n", get_vendor_id());
+				format_to(buffer, "cpu family      : {:d}\n", cpu.model.family);
+				format_to(buffer, "model           : {:d}\n", cpu.model.model);
+				format_to(buffer, "model name      : {:s}\n", brand.name);
+				format_to(buffer, "stepping        : {:d}\n", cpu.model.stepping);
+				format_to(buffer, "microcode       : {:#x}\n", 0xffff'ffff_u32);
+				format_to(buffer, "cpu MHz         : {:d} MHz\n", get_mhz());
+				format_to(buffer, "cache size      : {:d} KB\n", cache_size / 1'024_u32);
+				format_to(buffer, "physical id     : {:d}\n", package_id);
+				format_to(buffer, "siblings        : {:d}\n", logical_core_count);
+				format_to(buffer, "core id         : {:d}\n", core_id);
+				format_to(buffer, "cpu cores       : {:d}\n", physical_core_count);
+				format_to(buffer, "apicid          : {:d}\n", get_apic_id(cpu));
+				format_to(buffer, "initial apicid  : {:d}\n", get_initial_apic_id(cpu));
+				format_to(buffer, "fpu             : {:s}\n", get_feature(leaf_type::version_info, edx, 0_u32, "yes"));
+				format_to(buffer, "fpu_exception   : {:s}\n", get_feature(leaf_type::version_info, edx, 0_u32, "yes"));
+				format_to(buffer, "cpuid level     : {:d}\n", cpu.leaves.at(leaf_type::basic_info).at(subleaf_type::main).at(eax));
+				format_to(buffer, "wp              : yes\n");
+				format_to(buffer, "flags           : {:s}\n", flags);
+				format_to(buffer, "bugs            : {:s}\n", bugs);
+				format_to(buffer, "bogomips        : \n");
 				if(tlb_size != 0_u32) {
-					format_to(out, "TLB size        : {:d} 4K pages\n", tlb_size);
+					format_to(buffer, "TLB size        : {:d} 4K pages\n", tlb_size);
 				}
-				format_to(out, "clflush size    : {:d}\n", flush_size);
-				format_to(out, "cache_alignment : {:d}\n", flush_size);
-				format_to(out, "address sizes   : {:d} bits physical, {:d} bits virtual\n", physical_bits, virtual_bits);
-				format_to(out, "power management: {:s}\n", pm);
-				format_to(out, "\n");
-				++count;
-			}
+				format_to(buffer, "clflush size    : {:d}\n", flush_size);
+				format_to(buffer, "cache_alignment : {:d}\n", flush_size);
+				format_to(buffer, "address sizes   : {:d} bits physical, {:d} bits virtual\n", physical_bits, virtual_bits);
+				format_to(buffer, "power management: {:s}\n", pm);
+				format_to(buffer, "\n");
+			};
+
+			format_in_parallel(cpus.size(), [&] (fmt::memory_buffer& buffer, std::size_t i) {
+				format_cpu(buffer, gsl::narrow_cast<std::uint32_t>(i), *cpus[i], *brand_of[i]);
+			}, [&] (const fmt::memory_buffer& buffer) {
+				out.append(buffer.data(), buffer.data() + buffer.size());
+				checkpoint();
+			});
 		}
 		break;
+	case file_format::hwloc_xml:
+		print_hwloc_xml(out, build_topology(logical_cpus));
+		checkpoint();
+		break;
 	}
 }
 
 }
+
+void print_dump(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, file_format format) {
+	print_dump(out, logical_cpus, format, nullptr);
+}
+
+void print_dump(output_sink_t& sink, const std::map<std::uint32_t, cpu_t>& logical_cpus, file_format format) {
+	print_dump(sink.buffer(), logical_cpus, format, &sink);
+	sink.flush();
+}
+
+std::uint64_t dump_hash(const std::map<std::uint32_t, cpu_t>& logical_cpus) {
+	// FNV-1a over the native dump
+	fmt::memory_buffer out;
+	print_dump(out, logical_cpus, file_format::native);
+	std::uint64_t hash = 0xcbf2'9ce4'8422'2325_u64;
+	for(std::size_t i = 0; i < out.size(); ++i) {
+		hash ^= static_cast<std::uint8_t>(out.data()[i]);
+		hash *= 0x0000'0100'0000'01b3_u64;
+	}
+	return hash;
+}
+
+void print_delta_dump(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& baseline, const std::map<std::uint32_t, cpu_t>& logical_cpus) {
+	// as in the folded format, each register set is written once with every CPU that reports it
+	std::map<std::pair<leaf_type, subleaf_type>, std::map<register_set_t, std::vector<std::uint32_t>>> written;
+	std::map<std::pair<leaf_type, subleaf_type>, std::vector<std::uint32_t>> removed_leaves;
+	std::vector<std::uint32_t> removed_cpus;
+	std::map<std::uint32_t, std::uint32_t> renumbered;
+	for(const auto& c : logical_cpus) {
+		const auto it = baseline.find(c.first);
+		if(it == baseline.end() ? c.second.os_index != unknown_id : c.second.os_index != it->second.os_index) {
+			renumbered[c.first] = c.second.os_index;
+		}
+		if(it == baseline.end()) {
+			for(const auto& l : c.second.leaves) {
+				for(const auto& s : l.second) {
+					written[{ l.first, s.first }][s.second].push_back(c.first);
+				}
+			}
+			continue;
+		}
+		const cpu_diff_t diff = diff_cpus(it->second, c.second);
+		for(const auto& l : diff.added) {
+			written[l][c.second.leaves.at(l.first).at(l.second)].push_back(c.first);
+		}
+		// there is a change for each register that differs, but the set is written once
+		for(std::size_t i = 0; i < diff.changed.size(); ++i) {
+			const register_change_t& change = diff.changed[i];
+			if(i == 0 || change.leaf != diff.changed[i - 1].leaf || change.subleaf != diff.changed[i - 1].subleaf) {
+				written[{ change.leaf, change.subleaf }][c.second.leaves.at(change.leaf).at(change.subleaf)].push_back(c.first);
+			}
+		}
+		for(const auto& l : diff.removed) {
+			removed_leaves[l].push_back(c.first);
+		}
+	}
+	for(const auto& c : baseline) {
+		if(logical_cpus.find(c.first) == logical_cpus.end()) {
+			removed_cpus.push_back(c.first);
+		}
+	}
+
+	format_to(out, "#cpuid delta: apply to the baseline dump with this hash\n");
+	format_to(out, "baseline {:016x}\n", dump_hash(baseline));
+	// OS numbers that were learned, changed, or lost; - is a number that's no longer known
+	for(const auto& r : renumbered) {
+		if(r.second != unknown_id) {
+			format_to(out, "#os {:#010x} {:d}\n", r.first, r.second);
+		} else {
+			format_to(out, "#os {:#010x} -\n", r.first);
+		}
+	}
+	for(const auto& g : written) {
+		for(const auto& r : g.second) {
+			print_apic_list(out, r.second);
+			format_to(out, " {:#010x} {:#010x}: {:#010x} {:#010x} {:#010x} {:#010x}\n", static_cast<std::uint32_t>(g.first.first),
+			                                                                          static_cast<std::uint32_t>(g.first.second),
+			                                                                          r.first[eax],
+			                                                                          r.first[ebx],
+			                                                                          r.first[ecx],
+			                                                                          r.first[edx]);
+		}
+	}
+	for(const auto& g : removed_leaves) {
+		format_to(out, "removed ");
+		print_apic_list(out, g.second);
+		format_to(out, " {:#010x} {:#010x}\n", static_cast<std::uint32_t>(g.first.first), static_cast<std::uint32_t>(g.first.second));
+	}
+	if(!removed_cpus.empty()) {
+		format_to(out, "removed ");
+		print_apic_list(out, removed_cpus);
+		format_to(out, "\n");
+	}
+}
+
+std::map<std::uint32_t, cpu_t> enumerate_file(std::istream& fin, const std::map<std::uint32_t, cpu_t>& baseline) {
+	static const xp::sregex comment_line(xp::sregex::compile("#.*"));
+	static const xp::sregex os_index_line(xp::sregex::compile("#os (0[xX][[:xdigit:]]{1,8}) ([[:digit:]]+|-)"));
+	static const xp::sregex baseline_line(xp::sregex::compile("baseline ([[:xdigit:]]{16})"));
+	static const xp::sregex removed_line(xp::sregex::compile(fmt::format("removed {}(?: (0[xX][[:xdigit:]]{{1,8}}) (0[xX][[:xdigit:]]{{1,8}}))?", apic_list_pattern)));
+
+	std::map<std::uint32_t, cpu_t> logical_cpus = baseline;
+	bool seen_baseline = false;
+	std::string line;
+	while(std::getline(fin, line)) {
+		xp::smatch m;
+		if(xp::regex_match(line, m, os_index_line)) {
+			logical_cpus[std::stoul(m[1].str(), nullptr, 16)].os_index = m[2].str() == "-" ? unknown_id : static_cast<std::uint32_t>(std::stoul(m[2].str()));
+		} else if(xp::regex_search(line, m, comment_line) || line == "") {
+			continue;
+		} else if(xp::regex_match(line, m, baseline_line)) {
+			const std::uint64_t expected = std::stoull(m[1].str(), nullptr, 16);
+			const std::uint64_t actual = dump_hash(baseline);
+			if(expected != actual) {
+				throw std::runtime_error(fmt::format("delta was taken against baseline {:016x}, but the baseline given is {:016x}", expected, actual));
+			}
+			seen_baseline = true;
+		} else if(xp::regex_match(line, m, removed_line)) {
+			if(m[2].matched) {
+				const leaf_type    leaf    = static_cast<leaf_type   >(std::stoul(m[2].str(), nullptr, 16));
+				const subleaf_type subleaf = static_cast<subleaf_type>(std::stoul(m[3].str(), nullptr, 16));
+				for_each_apic_id(m[1].str(), line, [&] (std::uint32_t apic_id) {
+					auto it = logical_cpus.find(apic_id);
+					if(it != logical_cpus.end()) {
+						auto leaf_it = it->second.leaves.find(leaf);
+						if(leaf_it != it->second.leaves.end()) {
+							leaf_it->second.erase(subleaf);
+							if(leaf_it->second.empty()) {
+								it->second.leaves.erase(leaf_it);
+							}
+						}
+					}
+				});
+			} else {
+				for_each_apic_id(m[1].str(), line, [&] (std::uint32_t apic_id) {
+					logical_cpus.erase(apic_id);
+				});
+			}
+		} else if(parse_native_line(line, logical_cpus)) {
+			continue;
+		} else {
+			//std::cerr << "Unrecognized line: " << line << std::endl;
+		}
+	}
+	if(!seen_baseline) {
+		throw std::runtime_error("not a delta dump: there is no baseline hash");
+	}
+	for(auto& c : logical_cpus) {
+		identify_cpu(c.second);
+	}
+	return logical_cpus;
+}
+
+}
@@ -0,0 +1,201 @@
+#include "stdafx.h"
+
+#include "cpuid/cpuid.hpp"
+#include "features.hpp"
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+namespace {
+
+// walks two sorted maps in step, calling only_lhs, only_rhs, or both for each key
+template<typename Map, typename OnlyLhsFn, typename OnlyRhsFn, typename BothFn>
+void merge_walk(const Map& lhs, const Map& rhs, OnlyLhsFn&& only_lhs, OnlyRhsFn&& only_rhs, BothFn&& both) {
+	auto l = lhs.begin();
+	auto r = rhs.begin();
+	while(l != lhs.end() || r != rhs.end()) {
+		if(r == rhs.end() || (l != lhs.end() && l->first < r->first)) {
+			only_lhs(*l);
+			++l;
+		} else if(l == lhs.end() || r->first < l->first) {
+			only_rhs(*r);
+			++r;
+		} else {
+			both(*l, *r);
+			++l;
+			++r;
+		}
+	}
+}
+
+}
+
+cpu_diff_t diff_cpus(const cpu_t& before, const cpu_t& after) {
+	cpu_diff_t diff = { after.apic_id };
+	merge_walk(before.leaves, after.leaves,
+		[&] (const auto& l) {
+			for(const auto& s : l.second) {
+				diff.removed.push_back({ l.first, s.first });
+			}
+		},
+		[&] (const auto& l) {
+			for(const auto& s : l.second) {
+				diff.added.push_back({ l.first, s.first });
+			}
+		},
+		[&] (const auto& lb, const auto& la) {
+			merge_walk(lb.second, la.second,
+				[&] (const auto& s) {
+					diff.removed.push_back({ lb.first, s.first });
+				},
+				[&] (const auto& s) {
+					diff.added.push_back({ lb.first, s.first });
+				},
+				[&] (const auto& sb, const auto& sa) {
+					for(register_type reg = eax; reg <= edx; ++reg) {
+						if(sb.second[reg] != sa.second[reg]) {
+							diff.changed.push_back({ lb.first, sb.first, reg, sb.second[reg], sa.second[reg] });
+						}
+					}
+				}
+			);
+		}
+	);
+	return diff;
+}
+
+dump_diff_t diff_dumps(const std::map<std::uint32_t, cpu_t>& before, const std::map<std::uint32_t, cpu_t>& after) {
+	dump_diff_t diff;
+	merge_walk(before, after,
+		[&] (const auto& c) {
+			diff.removed_cpus.push_back(c.first);
+		},
+		[&] (const auto& c) {
+			diff.added_cpus.push_back(c.first);
+		},
+		[&] (const auto& cb, const auto& ca) {
+			cpu_diff_t cpu_diff = diff_cpus(cb.second, ca.second);
+			if(!cpu_diff.added.empty() || !cpu_diff.removed.empty() || !cpu_diff.changed.empty()) {
+				cpu_diff.apic_id = ca.first;
+				diff.changed_cpus.push_back(std::move(cpu_diff));
+			}
+		}
+	);
+	return diff;
+}
+
+namespace {
+
+void print_register_change(fmt::memory_buffer& out, const cpu_t& after, const register_change_t& change) {
+	format_to(out, "\tleaf {:#010x} subleaf {:#x} {:s}: {:#010x} -> {:#010x}", static_cast<std::uint32_t>(change.leaf),
+	                                                                         static_cast<std::uint32_t>(change.subleaf),
+	                                                                         to_string(change.reg),
+	                                                                         change.before,
+	                                                                         change.after);
+	std::uint32_t unnamed = change.before ^ change.after;
+	enumerate_features(after, change.leaf, change.subleaf, change.reg, [&] (const feature_t& feature, bool set) {
+		if((unnamed & feature.mask) != 0_u32 && !feature.mnemonic.empty()) {
+			format_to(out, " {:c}{:s}", set ? '+' : '-', feature.mnemonic);
+			unnamed &= ~feature.mask;
+		}
+	});
+	if(unnamed != 0_u32 && unnamed != (change.before ^ change.after)) {
+		format_to(out, " (other bits {:#010x})", unnamed);
+	}
+	format_to(out, "\n");
+}
+
+void print_topology_differences(fmt::memory_buffer& out, const system_t& before, const system_t& after) {
+	const auto count_cores = [] (const system_t& machine) {
+		std::size_t physical = 0;
+		for(const auto& package : machine.packages) {
+			physical += package.second.physical_cores.size();
+		}
+		return physical;
+	};
+	const auto compare = [&] (const char* what, std::size_t b, std::size_t a) {
+		if(b != a) {
+			format_to(out, "{:s}: {:d} -> {:d}\n", what, b, a);
+		}
+	};
+	compare("packages"      , before.packages.size(), after.packages.size());
+	compare("physical cores", count_cores(before)   , count_cores(after));
+	compare("logical cores" , before.all_cores.size(), after.all_cores.size());
+
+	// caches are matched up by level and type
+	const auto describe = [] (const system_t& machine) {
+		std::map<std::pair<std::uint32_t, std::uint32_t>, std::pair<std::uint32_t, std::size_t>> caches;
+		for(const cache_t& cache : machine.all_caches) {
+			caches[{ cache.level, cache.type }] = { cache.total_size, cache.instances.size() };
+		}
+		return caches;
+	};
+	const auto name = [] (const std::pair<std::uint32_t, std::uint32_t>& key) {
+		return fmt::format("L{:d} {:s}", key.first, key.second == 1_u32 ? "data" : key.second == 2_u32 ? "instruction" : "unified");
+	};
+	merge_walk(describe(before), describe(after),
+		[&] (const auto& c) {
+			format_to(out, "{:s} cache removed\n", name(c.first));
+		},
+		[&] (const auto& c) {
+			format_to(out, "{:s} cache added\n", name(c.first));
+		},
+		[&] (const auto& cb, const auto& ca) {
+			if(cb.second.first != ca.second.first) {
+				format_to(out, "{:s} cache size: {:d} -> {:d} bytes\n", name(cb.first), cb.second.first, ca.second.first);
+			}
+			if(cb.second.second != ca.second.second) {
+				format_to(out, "{:s} cache instances: {:d} -> {:d}\n", name(cb.first), cb.second.second, ca.second.second);
+			}
+		}
+	);
+}
+
+}
+
+void print_dump_diff(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& before, const std::map<std::uint32_t, cpu_t>& after) {
+	const dump_diff_t diff = diff_dumps(before, after);
+	if(!diff.removed_cpus.empty()) {
+		format_to(out, "removed apic ids {:s}\n", to_cpulist(diff.removed_cpus));
+	}
+	if(!diff.added_cpus.empty()) {
+		format_to(out, "added apic ids {:s}\n", to_cpulist(diff.added_cpus));
+	}
+
+	// CPUs with identical changes are reported together
+	std::vector<std::pair<std::string, std::vector<std::uint32_t>>> groups;
+	std::unordered_map<std::string, std::size_t> group_of;
+	for(const cpu_diff_t& cpu_diff : diff.changed_cpus) {
+		const cpu_t& cpu = after.at(cpu_diff.apic_id);
+		fmt::memory_buffer description;
+		for(const auto& l : cpu_diff.removed) {
+			format_to(description, "\tleaf {:#010x} subleaf {:#x} removed\n", static_cast<std::uint32_t>(l.first), static_cast<std::uint32_t>(l.second));
+		}
+		for(const auto& l : cpu_diff.added) {
+			format_to(description, "\tleaf {:#010x} subleaf {:#x} added\n", static_cast<std::uint32_t>(l.first), static_cast<std::uint32_t>(l.second));
+		}
+		for(const register_change_t& change : cpu_diff.changed) {
+			print_register_change(description, cpu, change);
+		}
+		std::string key = to_string(description);
+		const auto it = group_of.insert({ key, groups.size() });
+		if(it.second) {
+			groups.push_back({ std::move(key), {} });
+		}
+		groups[it.first->second].second.push_back(cpu_diff.apic_id);
+	}
+	for(const auto& g : groups) {
+		format_to(out, "apic ids {:s}:\n{:s}", to_cpulist(g.second), g.first);
+	}
+
+	if(!before.empty() && !after.empty()) {
+		print_topology_differences(out, build_topology(before), build_topology(after));
+	}
+}
+
+}
@@ -0,0 +1,485 @@
+#include "stdafx.h"
+
+#include "cpuid/export.hpp"
+#include "cpuid/sink.hpp"
+#include "features.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+namespace {
+
+void write_quoted(fmt::memory_buffer& out, std::string_view field) {
+	out.push_back('"');
+	for(const char ch : field) {
+		if(ch == '"') {
+			out.push_back('"');
+		}
+		out.push_back(ch);
+	}
+	out.push_back('"');
+}
+
+// type is 1 for data, 2 for instructions, and 3 for unified, as in leaf 4
+const cache_t* find_cache(const system_t& machine, std::uint32_t level, std::uint32_t type) noexcept {
+	for(const cache_t& cache : machine.all_caches) {
+		if(cache.level == level && cache.type == type) {
+			return &cache;
+		}
+	}
+	return nullptr;
+}
+
+void put_le(std::vector<std::uint8_t>& bytes, std::size_t size, std::uint64_t value) {
+	for(std::size_t i = 0; i < size; ++i) {
+		bytes.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+	}
+}
+
+constexpr std::size_t round_up(std::size_t value, std::size_t alignment) noexcept {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Just enough of a flatbuffers encoder for Arrow's messages. It works front to back, writing each table's vtable
+// just ahead of it and the objects it refers to after it, since flatbuffers' offsets to objects only point forward.
+class flatbuffer_builder_t
+{
+public:
+	// writes an object at the end of the buffer, returning where it starts
+	using object_writer_t = std::function<std::size_t(flatbuffer_builder_t&)>;
+
+	struct field_t
+	{
+		std::uint16_t id;
+		std::size_t size; // of the scalar, or of the offset to the object
+		std::uint64_t value;
+		object_writer_t object;
+	};
+
+	static field_t scalar(std::uint16_t id, std::size_t size, std::uint64_t value) {
+		return { id, size, value, nullptr };
+	}
+
+	static field_t object(std::uint16_t id, object_writer_t writer) {
+		return { id, 4, 0, std::move(writer) };
+	}
+
+	std::size_t table(std::vector<field_t> fields) {
+		// the largest fields go first, to keep the padding down
+		std::stable_sort(fields.begin(), fields.end(), [] (const field_t& lhs, const field_t& rhs) {
+			return lhs.size > rhs.size;
+		});
+		std::size_t slots = 0;
+		for(const field_t& field : fields) {
+			slots = std::max(slots, field.id + std::size_t{ 1 });
+		}
+		pad_to(round_up(bytes.size(), 2));
+		const std::size_t vtable = bytes.size();
+		const std::size_t start = round_up(vtable + 4 + 2 * slots, 4);
+		std::vector<std::size_t> positions;
+		std::vector<std::size_t> offsets(slots);
+		std::size_t end = start + 4;
+		for(const field_t& field : fields) {
+			end = round_up(end, field.size);
+			positions.push_back(end);
+			offsets[field.id] = end - start;
+			end += field.size;
+		}
+		put_le(bytes, 2, 4 + 2 * slots);
+		put_le(bytes, 2, end - start);
+		for(const std::size_t offset : offsets) {
+			put_le(bytes, 2, offset);
+		}
+		pad_to(start);
+		put_le(bytes, 4, start - vtable);
+		for(std::size_t i = 0; i < fields.size(); ++i) {
+			pad_to(positions[i]);
+			put_le(bytes, fields[i].size, fields[i].value);
+		}
+		for(std::size_t i = 0; i < fields.size(); ++i) {
+			if(fields[i].object) {
+				patch(positions[i], fields[i].object(*this));
+			}
+		}
+		return start;
+	}
+
+	std::size_t string(std::string_view value) {
+		pad_to(round_up(bytes.size(), 4));
+		const std::size_t start = bytes.size();
+		put_le(bytes, 4, value.size());
+		bytes.insert(bytes.end(), value.begin(), value.end());
+		bytes.push_back(0_u8);
+		return start;
+	}
+
+	std::size_t tables(const std::vector<object_writer_t>& writers) {
+		pad_to(round_up(bytes.size(), 4));
+		const std::size_t start = bytes.size();
+		put_le(bytes, 4, writers.size());
+		pad_to(bytes.size() + 4 * writers.size());
+		for(std::size_t i = 0; i < writers.size(); ++i) {
+			patch(start + 4 + 4 * i, writers[i](*this));
+		}
+		return start;
+	}
+
+	// a vector of structs made of two int64s, which must themselves be 8-aligned
+	std::size_t pairs(const std::vector<std::pair<std::uint64_t, std::uint64_t>>& values) {
+		pad_to(round_up(bytes.size() + 4, 8) - 4);
+		const std::size_t start = bytes.size();
+		put_le(bytes, 4, values.size());
+		for(const auto& value : values) {
+			put_le(bytes, 8, value.first);
+			put_le(bytes, 8, value.second);
+		}
+		return start;
+	}
+
+	// the root offset, then the root object, padded to 8 bytes as Arrow wants
+	std::vector<std::uint8_t> finish(const object_writer_t& root) {
+		put_le(bytes, 4, 0_u32);
+		patch(0, root(*this));
+		pad_to(round_up(bytes.size(), 8));
+		return std::move(bytes);
+	}
+
+private:
+	void pad_to(std::size_t size) {
+		bytes.resize(std::max(bytes.size(), size));
+	}
+
+	void patch(std::size_t position, std::size_t target) noexcept {
+		const std::size_t offset = target - position;
+		for(std::size_t i = 0; i < 4; ++i) {
+			bytes[position + i] = static_cast<std::uint8_t>(offset >> (8 * i));
+		}
+	}
+
+	std::vector<std::uint8_t> bytes;
+};
+
+using fb = flatbuffer_builder_t;
+
+// Arrow's format/Message.fbs and format/Schema.fbs
+constexpr std::uint64_t arrow_metadata_v5      = 4;
+constexpr std::uint64_t arrow_header_schema    = 1;
+constexpr std::uint64_t arrow_header_batch     = 3;
+constexpr std::uint64_t arrow_type_int         = 2;
+constexpr std::uint64_t arrow_type_utf8        = 5;
+constexpr std::uint64_t arrow_type_bool        = 6;
+constexpr std::uint32_t arrow_continuation     = 0xffff'ffff_u32;
+
+// an encapsulated message: the continuation marker, the metadata's length, the metadata, then the body
+void write_arrow_message(fmt::memory_buffer& out, const std::vector<std::uint8_t>& metadata) {
+	std::vector<std::uint8_t> prefix;
+	put_le(prefix, 4, arrow_continuation);
+	put_le(prefix, 4, metadata.size());
+	out.append(reinterpret_cast<const char*>(prefix.data()), reinterpret_cast<const char*>(prefix.data() + prefix.size()));
+	out.append(reinterpret_cast<const char*>(metadata.data()), reinterpret_cast<const char*>(metadata.data() + metadata.size()));
+}
+
+}
+
+table_exporter_t::table_exporter_t(output_sink_t& sink_, export_table table_, table_format format_) : sink(sink_), table(table_), format(format_) {
+	add_column("host", column_type::utf8);
+	switch(table) {
+	case export_table::leaves:
+		for(const std::string_view name : { "apic_id", "leaf", "subleaf", "eax", "ebx", "ecx", "edx" }) {
+			add_column(name, column_type::uint32);
+		}
+		break;
+	case export_table::features:
+		{
+			add_column("apic_id", column_type::uint32);
+			// a mnemonic can live in different places for different vendors, but gets a single column
+			std::map<std::string_view, std::size_t> columns_by_name;
+			for(const auto& l : all_features) {
+				for(const auto& s : l.second) {
+					for(const auto& r : s.second) {
+						for(const feature_t& feature : r.second) {
+							if(feature.mnemonic.empty() || (feature.mask & (feature.mask - 1_u32)) != 0_u32) {
+								continue;
+							}
+							const auto it = columns_by_name.insert({ feature.mnemonic, feature_names.size() });
+							if(it.second) {
+								feature_names.push_back(feature.mnemonic);
+							}
+							feature_bits.push_back({ l.first, s.first, r.first, feature.mask, feature.vendor, it.first->second });
+						}
+					}
+				}
+			}
+			feature_values.resize(feature_names.size());
+			for(const std::string_view name : feature_names) {
+				add_column(name, column_type::boolean);
+			}
+		}
+		break;
+	case export_table::machines:
+		add_column("vendor", column_type::utf8);
+		for(const std::string_view name : { "logical_cpus", "physical_cores", "packages", "l1d_size", "l1i_size", "l2_size", "l3_size", "l2_instances", "l3_instances" }) {
+			add_column(name, column_type::uint32);
+		}
+		break;
+	}
+
+	fmt::memory_buffer& out = sink.buffer();
+	switch(format) {
+	case table_format::csv:
+		for(std::size_t i = 0; i < columns.size(); ++i) {
+			if(i != 0) {
+				out.push_back(',');
+			}
+			write_quoted(out, columns[i].name);
+		}
+		format_to(out, "\n");
+		break;
+	case table_format::arrow:
+		{
+			std::vector<fb::object_writer_t> fields;
+			for(const column_t& column : columns) {
+				fields.push_back([&column] (fb& b) {
+					const std::uint64_t type_type = column.type == column_type::utf8   ? arrow_type_utf8
+					                              : column.type == column_type::uint32 ? arrow_type_int
+					                              :                                      arrow_type_bool;
+					return b.table({ fb::object(0, [&column] (fb& b) { return b.string(column.name); }),
+					                 fb::scalar(1, 1, 0), // not nullable
+					                 fb::scalar(2, 1, type_type),
+					                 fb::object(3, [&column] (fb& b) {
+					                     // Int's bit width and signedness; Utf8 and Bool have no properties
+					                     return column.type == column_type::uint32 ? b.table({ fb::scalar(0, 4, 32), fb::scalar(1, 1, 0) })
+					                                                               : b.table({});
+					                 }),
+					                 fb::object(5, [] (fb& b) { return b.tables({}); }) });
+				});
+			}
+			const std::vector<std::uint8_t> metadata = fb{}.finish([&fields] (fb& b) {
+				return b.table({ fb::scalar(0, 2, arrow_metadata_v5),
+				                 fb::scalar(1, 1, arrow_header_schema),
+				                 fb::object(2, [&fields] (fb& b) { return b.table({ fb::object(1, [&fields] (fb& b) { return b.tables(fields); }) }); }),
+				                 fb::scalar(3, 8, 0) });
+			});
+			write_arrow_message(out, metadata);
+		}
+		break;
+	}
+	sink.commit();
+}
+
+void table_exporter_t::add_column(std::string_view name, column_type type) {
+	columns.push_back({ name, type, {}, {} });
+	if(type == column_type::utf8) {
+		put_le(columns.back().offsets, 4, 0_u32);
+	}
+}
+
+void table_exporter_t::write_string(std::string_view value) {
+	column_t& column = columns[next_column++];
+	switch(format) {
+	case table_format::csv:
+		if(next_column != 1) {
+			sink.buffer().push_back(',');
+		}
+		write_quoted(sink.buffer(), value);
+		break;
+	case table_format::arrow:
+		column.values.insert(column.values.end(), value.begin(), value.end());
+		put_le(column.offsets, 4, column.values.size());
+		break;
+	}
+}
+
+void table_exporter_t::write_uint32(std::uint32_t value) {
+	column_t& column = columns[next_column++];
+	switch(format) {
+	case table_format::csv:
+		format_to(sink.buffer(), ",{:d}", value);
+		break;
+	case table_format::arrow:
+		put_le(column.values, 4, value);
+		break;
+	}
+}
+
+void table_exporter_t::write_boolean(bool value) {
+	column_t& column = columns[next_column++];
+	switch(format) {
+	case table_format::csv:
+		sink.buffer().push_back(',');
+		sink.buffer().push_back(value ? '1' : '0');
+		break;
+	case table_format::arrow:
+		// bits are packed least significant first
+		if(rows % 8 == 0) {
+			column.values.push_back(0_u8);
+		}
+		if(value) {
+			column.values.back() |= static_cast<std::uint8_t>(1_u32 << (rows % 8));
+		}
+		break;
+	}
+}
+
+void table_exporter_t::end_row() {
+	next_column = 0;
+	++rows;
+	if(format == table_format::csv) {
+		format_to(sink.buffer(), "\n");
+		sink.commit();
+	}
+}
+
+// every column is non-nullable, so each has an empty validity buffer, then its offsets if it's utf8, then its values
+void table_exporter_t::write_record_batch() {
+	if(rows == 0) {
+		return;
+	}
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> nodes;
+	std::vector<const std::vector<std::uint8_t>*> body;
+	const std::vector<std::uint8_t> validity;
+	for(const column_t& column : columns) {
+		nodes.push_back({ rows, 0 });
+		body.push_back(&validity);
+		if(column.type == column_type::utf8) {
+			body.push_back(&column.offsets);
+		}
+		body.push_back(&column.values);
+	}
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> buffers;
+	std::size_t body_length = 0;
+	for(const std::vector<std::uint8_t>* buffer : body) {
+		buffers.push_back({ body_length, buffer->size() });
+		body_length += round_up(buffer->size(), 8);
+	}
+
+	const std::vector<std::uint8_t> metadata = fb{}.finish([&] (fb& b) {
+		return b.table({ fb::scalar(0, 2, arrow_metadata_v5),
+		                 fb::scalar(1, 1, arrow_header_batch),
+		                 fb::object(2, [&] (fb& b) {
+		                     return b.table({ fb::scalar(0, 8, rows),
+		                                      fb::object(1, [&nodes] (fb& b) { return b.pairs(nodes); }),
+		                                      fb::object(2, [&buffers] (fb& b) { return b.pairs(buffers); }) });
+		                 }),
+		                 fb::scalar(3, 8, body_length) });
+	});
+	fmt::memory_buffer& out = sink.buffer();
+	write_arrow_message(out, metadata);
+	for(const std::vector<std::uint8_t>* buffer : body) {
+		out.append(reinterpret_cast<const char*>(buffer->data()), reinterpret_cast<const char*>(buffer->data() + buffer->size()));
+		for(std::size_t i = buffer->size(); i < round_up(buffer->size(), 8); ++i) {
+			out.push_back('\0');
+		}
+	}
+
+	for(column_t& column : columns) {
+		column.values.clear();
+		if(column.type == column_type::utf8) {
+			column.offsets.clear();
+			put_le(column.offsets, 4, 0_u32);
+		}
+	}
+	rows = 0;
+	sink.commit();
+}
+
+void table_exporter_t::add_host(std::string_view host, const std::map<std::uint32_t, cpu_t>& logical_cpus) {
+	switch(table) {
+	case export_table::leaves:
+		for(const auto& c : logical_cpus) {
+			for(const auto& l : c.second.leaves) {
+				for(const auto& s : l.second) {
+					const register_set_t& regs = s.second;
+					write_string(host);
+					write_uint32(c.first);
+					write_uint32(static_cast<std::uint32_t>(l.first));
+					write_uint32(static_cast<std::uint32_t>(s.first));
+					write_uint32(regs[eax]);
+					write_uint32(regs[ebx]);
+					write_uint32(regs[ecx]);
+					write_uint32(regs[edx]);
+					end_row();
+				}
+			}
+		}
+		break;
+	case export_table::features:
+		for(const auto& c : logical_cpus) {
+			const cpu_t& cpu = c.second;
+			std::fill(feature_values.begin(), feature_values.end(), false);
+			for(const feature_bit_t& bit : feature_bits) {
+				if((cpu.vendor & bit.vendor) == vendor_type::unknown) {
+					continue;
+				}
+				const auto leaf = cpu.leaves.find(bit.leaf);
+				if(leaf == cpu.leaves.end()) {
+					continue;
+				}
+				const auto subleaf = leaf->second.find(bit.subleaf);
+				if(subleaf != leaf->second.end() && (subleaf->second[bit.reg] & bit.mask) != 0_u32) {
+					feature_values[bit.column] = true;
+				}
+			}
+			write_string(host);
+			write_uint32(c.first);
+			for(const bool value : feature_values) {
+				write_boolean(value);
+			}
+			end_row();
+		}
+		break;
+	case export_table::machines:
+		{
+			const system_t machine = build_topology(logical_cpus);
+			std::size_t physical_cores = 0;
+			for(const auto& package : machine.packages) {
+				physical_cores += package.second.physical_cores.size();
+			}
+			const auto size_of = [] (const cache_t* cache) {
+				return cache ? cache->total_size : 0_u32;
+			};
+			const auto instances_of = [] (const cache_t* cache) {
+				return cache ? static_cast<std::uint32_t>(cache->instances.size()) : 0_u32;
+			};
+			const cache_t* l1d = find_cache(machine, 1_u32, 1_u32);
+			const cache_t* l1i = find_cache(machine, 1_u32, 2_u32);
+			const cache_t* l2  = find_cache(machine, 2_u32, 3_u32);
+			const cache_t* l3  = find_cache(machine, 3_u32, 3_u32);
+			write_string(host);
+			write_string(to_string(machine.vendor));
+			write_uint32(static_cast<std::uint32_t>(logical_cpus.size()));
+			write_uint32(static_cast<std::uint32_t>(physical_cores));
+			write_uint32(static_cast<std::uint32_t>(machine.packages.size()));
+			write_uint32(size_of(l1d));
+			write_uint32(size_of(l1i));
+			write_uint32(size_of(l2));
+			write_uint32(size_of(l3));
+			write_uint32(instances_of(l2));
+			write_uint32(instances_of(l3));
+			end_row();
+		}
+		break;
+	}
+	if(format == table_format::arrow) {
+		write_record_batch();
+	}
+}
+
+void table_exporter_t::finish() {
+	if(format == table_format::arrow) {
+		std::vector<std::uint8_t> end_of_stream;
+		put_le(end_of_stream, 4, arrow_continuation);
+		put_le(end_of_stream, 4, 0_u32);
+		sink.buffer().append(reinterpret_cast<const char*>(end_of_stream.data()), reinterpret_cast<const char*>(end_of_stream.data() + end_of_stream.size()));
+	}
+	sink.commit();
+}
+
+}
@@ -0,0 +1,439 @@
+#include "stdafx.h"
+
+#include "cpuid/expression.hpp"
+#include "features.hpp"
+
+#include <limits>
+
+#include <boost/algorithm/string.hpp>
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+namespace
+{
+	using feature_index_t = std::multimap<std::string, std::pair<vendor_type, flag_location_t>>;
+
+	// every named feature, keyed by lowercase mnemonic
+	const feature_index_t& get_feature_index() {
+		static const feature_index_t index = [] () {
+			feature_index_t idx;
+			for(const auto& leaf : all_features) {
+				for(const auto& sub : leaf.second) {
+					for(const auto& reg : sub.second) {
+						for(const feature_t& feature : reg.second) {
+							if(feature.mnemonic != "") {
+								idx.insert({ boost::algorithm::to_lower_copy(feature.mnemonic), { feature.vendor, { leaf.first, sub.first, reg.first, feature.mask } } });
+							}
+						}
+					}
+				}
+			}
+			return idx;
+		}();
+		return index;
+	}
+
+	enum struct token_type
+	{
+		end,
+		word,
+		logical_and,
+		logical_or,
+		logical_not,
+		open,
+		close,
+		comparison
+	};
+
+	struct token_t
+	{
+		token_type type;
+		std::string text;
+		std::size_t offset;
+		expression_opcode comparison;
+	};
+
+	enum struct value_kind
+	{
+		number,
+		condition
+	};
+
+	bool is_word_character(char ch) noexcept {
+		return std::isalnum(static_cast<unsigned char>(ch)) || ch == '.' || ch == '_' || ch == '-';
+	}
+
+	// CPUID specs additionally use :, [, ], and = (EAX=07H)
+	bool is_spec_character(const std::string& source, std::size_t pos) noexcept {
+		const char ch = source[pos];
+		return ch == ':' || ch == '[' || ch == ']'
+		    || (ch == '=' && (pos + 1 == source.size() || source[pos + 1] != '='));
+	}
+
+	struct compiler_t
+	{
+		expression_t& expression;
+		std::vector<token_t> tokens;
+		std::size_t current = 0;
+
+		[[noreturn]] void fail(const std::string& message, std::size_t offset) const {
+			throw std::runtime_error(fmt::format("{:s} at offset {:d} in expression: {:s}", message, offset, expression.source));
+		}
+
+		void tokenize() {
+			const std::string& source = expression.source;
+			std::size_t pos = 0;
+			while(pos < source.size()) {
+				if(std::isspace(static_cast<unsigned char>(source[pos]))) {
+					++pos;
+					continue;
+				}
+				const std::string rest = source.substr(pos, 2);
+				const auto punctuation = [&] (token_type type, std::size_t length, expression_opcode comparison = expression_opcode::test) {
+					tokens.push_back({ type, source.substr(pos, length), pos, comparison });
+					pos += length;
+				};
+				if(rest == "&&") {
+					punctuation(token_type::logical_and, 2);
+				} else if(rest == "||") {
+					punctuation(token_type::logical_or, 2);
+				} else if(rest == "==") {
+					punctuation(token_type::comparison, 2, expression_opcode::equal);
+				} else if(rest == "!=") {
+					punctuation(token_type::comparison, 2, expression_opcode::not_equal);
+				} else if(rest == "<=") {
+					punctuation(token_type::comparison, 2, expression_opcode::less_equal);
+				} else if(rest == ">=") {
+					punctuation(token_type::comparison, 2, expression_opcode::greater_equal);
+				} else if(source[pos] == '<') {
+					punctuation(token_type::comparison, 1, expression_opcode::less);
+				} else if(source[pos] == '>') {
+					punctuation(token_type::comparison, 1, expression_opcode::greater);
+				} else if(source[pos] == '!') {
+					punctuation(token_type::logical_not, 1);
+				} else if(source[pos] == '(') {
+					punctuation(token_type::open, 1);
+				} else if(source[pos] == ')') {
+					punctuation(token_type::close, 1);
+				} else if(is_word_character(source[pos])) {
+					std::size_t end = pos;
+					const bool spec = boost::algorithm::istarts_with(source.substr(pos), "cpuid.");
+					while(end < source.size() && (is_word_character(source[end]) || (spec && is_spec_character(source, end)))) {
+						++end;
+					}
+					tokens.push_back({ token_type::word, source.substr(pos, end - pos), pos, expression_opcode::test });
+					pos = end;
+				} else {
+					fail(fmt::format("Unexpected character '{:c}'", source[pos]), pos);
+				}
+			}
+			tokens.push_back({ token_type::end, "", source.size(), expression_opcode::test });
+		}
+
+		const token_t& peek() const noexcept {
+			return tokens[current];
+		}
+
+		void emit(expression_opcode opcode, std::uint32_t operand = 0_u32) {
+			expression.program.push_back({ opcode, operand });
+		}
+
+		void as_condition(value_kind kind) {
+			if(kind == value_kind::number) {
+				emit(expression_opcode::test);
+			}
+		}
+
+		// digits, optionally prefixed with 0x, optionally suffixed with K, M, or G (and an optional B)
+		std::optional<std::uint64_t> parse_number(const std::string& text, std::size_t offset) const {
+			std::string digits = boost::algorithm::to_lower_copy(text);
+			std::uint64_t multiplier = 1;
+			if(boost::algorithm::ends_with(digits, "b") && digits.size() > 1 && std::string("kmg").find(digits[digits.size() - 2]) != std::string::npos) {
+				digits.pop_back();
+			}
+			if(digits.size() > 1 && !boost::algorithm::starts_with(digits, "0x")) {
+				switch(digits.back()) {
+				case 'k': multiplier = 1'024ull;                   digits.pop_back(); break;
+				case 'm': multiplier = 1'024ull * 1'024ull;        digits.pop_back(); break;
+				case 'g': multiplier = 1'024ull * 1'024ull * 1'024ull; digits.pop_back(); break;
+				}
+			}
+			const bool hex = boost::algorithm::starts_with(digits, "0x");
+			const std::string body = hex ? digits.substr(2) : digits;
+			if(body.empty() || body.size() > 15 || !std::all_of(body.begin(), body.end(), [hex] (char ch) { return hex ? std::isxdigit(static_cast<unsigned char>(ch)) != 0 : std::isdigit(static_cast<unsigned char>(ch)) != 0; })) {
+				return std::nullopt;
+			}
+			const std::uint64_t value = std::stoull(body, nullptr, hex ? 16 : 10);
+			if(value > std::numeric_limits<std::uint64_t>::max() / multiplier) {
+				fail(fmt::format("Number {:s} is too large", text), offset);
+			}
+			return value * multiplier;
+		}
+
+		value_kind parse_operand() {
+			const token_t token = peek();
+			if(token.type != token_type::word) {
+				fail(token.type == token_type::end ? "Unexpected end" : fmt::format("Unexpected '{:s}'", token.text), token.offset);
+			}
+			++current;
+
+			const std::string name = boost::algorithm::to_lower_copy(token.text);
+			if(const std::optional<std::uint64_t> number = parse_number(name, token.offset)) {
+				expression.constants.push_back(*number);
+				emit(expression_opcode::load_constant, gsl::narrow_cast<std::uint32_t>(expression.constants.size() - 1));
+				return value_kind::number;
+			}
+			if(name == "l1d" || name == "l1i" || name == "l2" || name == "l3" || name == "l4") {
+				expression.caches.push_back({ gsl::narrow_cast<std::uint32_t>(name[1] - '0'), name == "l1i" });
+				emit(expression_opcode::load_cache, gsl::narrow_cast<std::uint32_t>(expression.caches.size() - 1));
+				return value_kind::number;
+			}
+
+			expression_flag_t flag;
+			if(boost::algorithm::starts_with(name, "cpuid.")) {
+				const flag_location_t location = resolve_flag_spec(parse_flag_spec(token.text));
+				if(location.mask == 0_u32) {
+					fail(fmt::format("Unknown flag {:s}", token.text), token.offset);
+				}
+				flag.candidates.push_back({ vendor_type::any, location });
+			} else {
+				const feature_index_t& index = get_feature_index();
+				auto range = index.equal_range(name);
+				if(range.first == range.second) {
+					range = index.equal_range(boost::algorithm::replace_all_copy(name, "_", "."));
+				}
+				if(range.first == range.second) {
+					fail(fmt::format("Unknown feature {:s}", token.text), token.offset);
+				}
+				for(auto it = range.first; it != range.second; ++it) {
+					flag.candidates.push_back(it->second);
+				}
+			}
+			expression.flags.push_back(flag);
+			emit(expression_opcode::load_flag, gsl::narrow_cast<std::uint32_t>(expression.flags.size() - 1));
+			return value_kind::number;
+		}
+
+		// a parenthesized expression can be compared, as in (L3) >= 32M, so long as it's a number
+		value_kind parse_primary() {
+			if(peek().type == token_type::open) {
+				++current;
+				const value_kind kind = parse_or();
+				if(peek().type != token_type::close) {
+					fail("Expected ')'", peek().offset);
+				}
+				++current;
+				return kind;
+			}
+			return parse_operand();
+		}
+
+		value_kind parse_comparison() {
+			const std::size_t lhs_offset = peek().offset;
+			const value_kind lhs = parse_primary();
+			if(peek().type != token_type::comparison) {
+				return lhs;
+			}
+			const token_t comparison = peek();
+			++current;
+			const std::size_t rhs_offset = peek().offset;
+			const value_kind rhs = parse_primary();
+			if(lhs != value_kind::number) {
+				fail("Expected a number", lhs_offset);
+			}
+			if(rhs != value_kind::number) {
+				fail("Expected a number", rhs_offset);
+			}
+			emit(comparison.comparison);
+			return value_kind::condition;
+		}
+
+		value_kind parse_unary() {
+			const token_t token = peek();
+			if(token.type == token_type::logical_not) {
+				++current;
+				as_condition(parse_unary());
+				emit(expression_opcode::logical_not);
+				return value_kind::condition;
+			}
+			return parse_comparison();
+		}
+
+		value_kind parse_and() {
+			value_kind kind = parse_unary();
+			while(peek().type == token_type::logical_and) {
+				++current;
+				as_condition(kind);
+				as_condition(parse_unary());
+				emit(expression_opcode::logical_and);
+				kind = value_kind::condition;
+			}
+			return kind;
+		}
+
+		value_kind parse_or() {
+			value_kind kind = parse_and();
+			while(peek().type == token_type::logical_or) {
+				++current;
+				as_condition(kind);
+				as_condition(parse_and());
+				emit(expression_opcode::logical_or);
+				kind = value_kind::condition;
+			}
+			return kind;
+		}
+	};
+
+	std::uint64_t get_cache_size(const system_t& machine, const expression_cache_t& wanted) noexcept {
+		// types use leaf 4's encoding: 1 is data, 2 is instructions, 3 is unified
+		std::uint64_t size = 0;
+		for(const cache_t& cache : machine.all_caches) {
+			const bool matches = cache.type == 3_u32
+			                  || cache.type == (wanted.instructions ? 2_u32 : 1_u32);
+			if(cache.level == wanted.level && matches) {
+				size = std::max<std::uint64_t>(size, cache.total_size);
+			}
+		}
+		return size;
+	}
+}
+
+expression_t compile_expression(const std::string& source) {
+	expression_t expression = { source, {}, {}, {}, {} };
+	compiler_t compiler = { expression, {} };
+	compiler.tokenize();
+	compiler.as_condition(compiler.parse_or());
+	if(compiler.peek().type != token_type::end) {
+		compiler.fail(fmt::format("Unexpected '{:s}'", compiler.peek().text), compiler.peek().offset);
+	}
+	return expression;
+}
+
+std::vector<bool> evaluate_expression(const expression_t& expression, const std::vector<expression_lane_t>& lanes) {
+	// numbers have one value per lane; conditions pack one lane per bit
+	using numbers_t    = std::vector<std::uint64_t>;
+	using conditions_t = std::vector<std::uint64_t>;
+
+	const std::size_t lane_count = lanes.size();
+	const std::size_t word_count = (lane_count + 63) / 64;
+	const std::uint64_t tail_mask = lane_count % 64 == 0 ? ~0ull : (1ull << (lane_count % 64)) - 1ull;
+
+	std::vector<numbers_t> numbers;
+	std::vector<conditions_t> conditions;
+
+	const auto compare = [&] (auto&& predicate) {
+		const numbers_t rhs = std::move(numbers.back());
+		numbers.pop_back();
+		const numbers_t lhs = std::move(numbers.back());
+		numbers.pop_back();
+		conditions_t result(word_count);
+		for(std::size_t i = 0; i < lane_count; ++i) {
+			result[i / 64] |= static_cast<std::uint64_t>(predicate(lhs[i], rhs[i])) << (i % 64);
+		}
+		conditions.push_back(std::move(result));
+	};
+
+	const auto combine = [&] (auto&& operation) {
+		const conditions_t rhs = std::move(conditions.back());
+		conditions.pop_back();
+		conditions_t& lhs = conditions.back();
+		for(std::size_t w = 0; w < word_count; ++w) {
+			lhs[w] = operation(lhs[w], rhs[w]);
+		}
+	};
+
+	for(const expression_instruction_t& instruction : expression.program) {
+		switch(instruction.opcode) {
+		case expression_opcode::load_flag:
+			{
+				const expression_flag_t& flag = expression.flags[instruction.operand];
+				numbers_t values(lane_count);
+				for(std::size_t i = 0; i < lane_count; ++i) {
+					for(const auto& candidate : flag.candidates) {
+						if((candidate.first & lanes[i].cpu->vendor) != vendor_type::unknown) {
+							values[i] = get_flag_value(*lanes[i].cpu, candidate.second).value_or(0_u32);
+							break;
+						}
+					}
+				}
+				numbers.push_back(std::move(values));
+			}
+			break;
+		case expression_opcode::load_cache:
+			{
+				const expression_cache_t& cache = expression.caches[instruction.operand];
+				numbers_t values(lane_count);
+				for(std::size_t i = 0; i < lane_count; ++i) {
+					values[i] = get_cache_size(*lanes[i].machine, cache);
+				}
+				numbers.push_back(std::move(values));
+			}
+			break;
+		case expression_opcode::load_constant:
+			numbers.push_back(numbers_t(lane_count, expression.constants[instruction.operand]));
+			break;
+		case expression_opcode::test:
+			{
+				const numbers_t values = std::move(numbers.back());
+				numbers.pop_back();
+				conditions_t result(word_count);
+				for(std::size_t i = 0; i < lane_count; ++i) {
+					result[i / 64] |= static_cast<std::uint64_t>(values[i] != 0) << (i % 64);
+				}
+				conditions.push_back(std::move(result));
+			}
+			break;
+		case expression_opcode::equal:
+			compare([] (std::uint64_t lhs, std::uint64_t rhs) { return lhs == rhs; });
+			break;
+		case expression_opcode::not_equal:
+			compare([] (std::uint64_t lhs, std::uint64_t rhs) { return lhs != rhs; });
+			break;
+		case expression_opcode::less:
+			compare([] (std::uint64_t lhs, std::uint64_t rhs) { return lhs < rhs; });
+			break;
+		case expression_opcode::less_equal:
+			compare([] (std::uint64_t lhs, std::uint64_t rhs) { return lhs <= rhs; });
+			break;
+		case expression_opcode::greater:
+			compare([] (std::uint64_t lhs, std::uint64_t rhs) { return lhs > rhs; });
+			break;
+		case expression_opcode::greater_equal:
+			compare([] (std::uint64_t lhs, std::uint64_t rhs) { return lhs >= rhs; });
+			break;
+		case expression_opcode::logical_and:
+			combine([] (std::uint64_t lhs, std::uint64_t rhs) { return lhs & rhs; });
+			break;
+		case expression_opcode::logical_or:
+			combine([] (std::uint64_t lhs, std::uint64_t rhs) { return lhs | rhs; });
+			break;
+		case expression_opcode::logical_not:
+			for(std::uint64_t& word : conditions.back()) {
+				word = ~word;
+			}
+			if(word_count != 0) {
+				conditions.back().back() &= tail_mask;
+			}
+			break;
+		}
+	}
+
+	std::vector<bool> results(lane_count);
+	for(std::size_t i = 0; i < lane_count; ++i) {
+		results[i] = ((conditions.back()[i / 64] >> (i % 64)) & 1ull) != 0;
+	}
+	return results;
+}
+
+std::vector<bool> evaluate_expression(const expression_t& expression, const std::map<std::uint32_t, cpu_t>& logical_cpus, const system_t& machine) {
+	std::vector<expression_lane_t> lanes;
+	lanes.reserve(logical_cpus.size());
+	for(const auto& p : logical_cpus) {
+		lanes.push_back({ &p.second, &machine });
+	}
+	return evaluate_expression(expression, lanes);
+}
+
+}
@@ -188,6 +188,7 @@ const feature_map_t all_features = {
 				{ intel                  , 0x0000'0004_u32, "AVX512_4NNIW"      , "AVX512 4-register Neural Network Instructions"                                , "avx512_4vnniw"     },
 				{ intel                  , 0x0000'0008_u32, "AVX512_4FMAPS"     , "AVX512 4-register Multiply Accumulate Single Precision"                       , "avx512_4fmaps"     },
 				{ intel                  , 0x0000'0010_u32, "REPMOVS"           , "Fast short REP MOV"                                                           , ""                  },
+				{ intel                  , 0x0000'8000_u32, "HYBRID"            , "Hybrid part, with core types in leaf 0x1a"                                    , "hybrid_cpu"        },
 				{ intel                  , 0x0004'0000_u32, "PCONFIG"           , "Platform configuration for MKTME"                                             , ""                  },
 				{ intel                  , 0x0400'0000_u32, "IBRS"              , "Indirect Branch Restricted Speculation and Indirect Branch Predictor Barrier" , "pconfig"           },
 				{ intel                  , 0x0800'0000_u32, "STIBP"             , "Single Thread Indirect Branch Predictors"                                     , ""                  },
@@ -696,7 +697,7 @@ void for_feature_range(const cpu_t& cpu, leaf_type leaf, subleaf_type subleaf, r
 		if(it->second.find(subleaf) == it->second.end()) {
 			continue;
 		}
-		auto sl = it->second.at(subleaf);
+		const auto& sl = it->second.at(subleaf);
 		if(sl.find(reg) == sl.end()) {
 			continue;
 		}
@@ -731,6 +732,17 @@ void print_features(fmt::memory_buffer& out, const cpu_t& cpu, leaf_type leaf, s
 	);
 }
 
+void enumerate_features(const cpu_t& cpu, leaf_type leaf, subleaf_type subleaf, register_type reg, const std::function<void(const feature_t&, bool)>& fn) {
+	for_feature_range(cpu, leaf, subleaf, reg,
+		[&] (const feature_t& feature, std::uint32_t) {
+			fn(feature, true);
+		},
+		[&] (const feature_t& feature, std::uint32_t) {
+			fn(feature, false);
+		}
+	);
+}
+
 bool has_feature(const cpu_t& cpu, leaf_type leaf, subleaf_type subleaf, register_type reg, std::uint32_t bit) {
 	if(cpu.leaves.find(leaf) != cpu.leaves.end()) {
 		if(cpu.leaves.at(leaf).find(subleaf) != cpu.leaves.at(leaf).end()) {
@@ -3,6 +3,8 @@
 
 #include "cpuid/cpuid.hpp"
 
+#include <functional>
+
 #include <fmt/format.h>
 
 namespace cpuid
@@ -21,6 +23,8 @@ namespace cpuid
 	extern const feature_map_t all_features;
 
 	void print_features(fmt::memory_buffer& out, const cpu_t& cpu, leaf_type leaf, subleaf_type sub, register_type reg);
+	// visits the single-bit features of the register that apply to the CPU's vendor, with whether each is set
+	void enumerate_features(const cpu_t& cpu, leaf_type leaf, subleaf_type sub, register_type reg, const std::function<void(const feature_t&, bool)>& fn);
 
 	std::vector<std::string> get_linux_features(const cpu_t& cpu);
 	std::vector<std::string> get_linux_bugs(const cpu_t& cpu) noexcept;
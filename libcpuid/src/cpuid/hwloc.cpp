@@ -0,0 +1,239 @@
+#include "stdafx.h"
+
+#include "cpuid/cpuid.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+namespace {
+
+// hwloc's bitmap syntax: 32-bit words, most significant first, separated by commas
+std::string to_hwloc_bitmap(const std::set<std::uint32_t>& bits) {
+	if(bits.empty()) {
+		return "0x0";
+	}
+	std::vector<std::uint32_t> words(*bits.rbegin() / 32_u32 + 1_u32);
+	for(const std::uint32_t bit : bits) {
+		words[bit / 32_u32] |= 1_u32 << (bit % 32_u32);
+	}
+	std::string bitmap;
+	for(auto it = words.rbegin(); it != words.rend(); ++it) {
+		bitmap += fmt::format("{:s}{:#010x}", bitmap.empty() ? "" : ",", *it);
+	}
+	return bitmap;
+}
+
+struct hwloc_writer_t
+{
+	fmt::memory_buffer& out;
+	std::uint32_t next_gp_index = 1_u32;
+
+	// cpuset and nodeset, with the complete_ copies that hwloc expects alongside them; caches have no os_index
+	void open(std::size_t depth, std::string_view type, std::uint32_t os_index, const std::set<std::uint32_t>& cpus, const std::set<std::uint32_t>& nodes, std::string_view extra, bool empty) {
+		const std::string cpuset  = to_hwloc_bitmap(cpus);
+		const std::string nodeset = to_hwloc_bitmap(nodes);
+		format_to(out, "{:s}<object type=\"{:s}\"", std::string(depth * 2, ' '), type);
+		if(os_index != unknown_id) {
+			format_to(out, " os_index=\"{:d}\"", os_index);
+		}
+		format_to(out, " cpuset=\"{:s}\" complete_cpuset=\"{:s}\"", cpuset, cpuset);
+		if(type == "Machine") {
+			format_to(out, " allowed_cpuset=\"{:s}\"", cpuset);
+		}
+		format_to(out, " nodeset=\"{:s}\" complete_nodeset=\"{:s}\"", nodeset, nodeset);
+		if(type == "Machine") {
+			format_to(out, " allowed_nodeset=\"{:s}\"", nodeset);
+		}
+		format_to(out, "{:s} gp_index=\"{:d}\"{:s}>\n", extra, next_gp_index++, empty ? "/" : "");
+	}
+
+	void close(std::size_t depth) {
+		format_to(out, "{:s}</object>\n", std::string(depth * 2, ' '));
+	}
+};
+
+}
+
+void print_hwloc_xml(fmt::memory_buffer& out, const system_t& machine) {
+	// PUs are numbered as the OS does when every CPU's number is known. Otherwise hwloc still needs an os_index
+	// for each, so they're numbered in APIC ID order, and the machine says so, as the topology can't be bound to
+	const bool use_os_numbers = knows_os_numbers(machine);
+	std::unordered_map<std::uint32_t, std::uint32_t> pu_of;
+	for(std::size_t i = 0; i < machine.all_cores.size(); ++i) {
+		const std::uint32_t apic_id = machine.all_cores[i].full_apic_id;
+		pu_of[apic_id] = use_os_numbers ? machine.os_index_by_apic_id.at(apic_id) : static_cast<std::uint32_t>(i);
+	}
+
+	// hwloc wants a NUMA node even when there's only the one
+	std::map<std::uint32_t, std::set<std::uint32_t>> node_cpus;
+	if(machine.node_distances.empty()) {
+		node_cpus[0_u32];
+	} else {
+		for(const auto& node : machine.node_distances) {
+			node_cpus[node.first];
+		}
+	}
+	// hwloc wants every PU in a node, so the CPUs whose node isn't known go in the first
+	const std::uint32_t first_node = node_cpus.begin()->first;
+	const auto node_of = [first_node] (const logical_core_t& core) {
+		return core.node_id != unknown_id ? core.node_id : first_node;
+	};
+	std::map<std::uint32_t, std::uint32_t> package_of_node;
+	std::set<std::uint32_t> machine_nodes;
+	for(const logical_core_t& core : machine.all_cores) {
+		node_cpus[node_of(core)].insert(pu_of.at(core.full_apic_id));
+		const auto it = package_of_node.insert({ node_of(core), core.package_id });
+		if(it.first->second != core.package_id) {
+			machine_nodes.insert(node_of(core));
+		}
+	}
+	for(const auto& node : node_cpus) {
+		if(package_of_node.find(node.first) == package_of_node.end()) {
+			machine_nodes.insert(node.first);
+		}
+	}
+
+	// caches whose instances cross packages can't be nested under them, so they're left out; the rest
+	// go from the outermost level in, with data caches above instruction caches
+	std::vector<std::size_t> cache_order;
+	for(std::size_t i = 0; i < machine.all_caches.size(); ++i) {
+		bool within_packages = true;
+		for(const auto& instance : machine.all_caches[i].instances) {
+			std::set<std::uint32_t> packages;
+			for(const logical_core_t& core : machine.all_cores) {
+				if(std::find(instance.second.sharing_ids.begin(), instance.second.sharing_ids.end(), core.full_apic_id) != instance.second.sharing_ids.end()) {
+					packages.insert(core.package_id);
+				}
+			}
+			within_packages = within_packages && packages.size() <= 1;
+		}
+		if(within_packages) {
+			cache_order.push_back(i);
+		}
+	}
+	std::sort(cache_order.begin(), cache_order.end(), [&machine] (std::size_t lhs, std::size_t rhs) {
+		const cache_t& l = machine.all_caches[lhs];
+		const cache_t& r = machine.all_caches[rhs];
+		return l.level != r.level ? l.level > r.level
+		                          : (l.type == 2_u32 ? 1 : 0) < (r.type == 2_u32 ? 1 : 0);
+	});
+
+	hwloc_writer_t writer = { out };
+	const auto cpus_of = [&pu_of] (const std::vector<const logical_core_t*>& cores) {
+		std::set<std::uint32_t> cpus;
+		for(const logical_core_t* core : cores) {
+			cpus.insert(pu_of.at(core->full_apic_id));
+		}
+		return cpus;
+	};
+	const auto nodes_of = [&node_of] (const std::vector<const logical_core_t*>& cores) {
+		std::set<std::uint32_t> nodes;
+		for(const logical_core_t* core : cores) {
+			nodes.insert(node_of(*core));
+		}
+		return nodes;
+	};
+	const auto write_node = [&] (std::size_t depth, std::uint32_t node) {
+		writer.open(depth, "NUMANode", node, node_cpus.at(node), { node }, "", true);
+	};
+
+	// each level splits its cores by cache instance, then by physical core, down to the PUs
+	const auto write_level = [&] (const auto& self, std::size_t depth, std::size_t level, const std::vector<const logical_core_t*>& cores) -> void {
+		if(level < cache_order.size()) {
+			const std::size_t index = cache_order[level];
+			const cache_t& cache = machine.all_caches[index];
+			std::map<std::uint32_t, std::vector<const logical_core_t*>> instances;
+			for(const logical_core_t* core : cores) {
+				instances[core->non_shared_cache_ids[index]].push_back(core);
+			}
+			const std::string type_name = fmt::format("L{:d}{:s}Cache", cache.level, cache.type == 2_u32 ? "i" : "");
+			for(const auto& instance : instances) {
+				// hwloc's cache types are 0 for unified, 1 for data, 2 for instructions, and -1 associativity is fully associative
+				const std::string attributes = fmt::format(" cache_size=\"{:d}\" depth=\"{:d}\" cache_linesize=\"{:d}\" cache_associativity=\"{:d}\" cache_type=\"{:d}\"",
+				                                           cache.total_size, cache.level, cache.line_size, cache.fully_associative ? -1 : static_cast<int>(cache.ways), cache.type == 3_u32 ? 0 : cache.type);
+				writer.open(depth, type_name, unknown_id, cpus_of(instance.second), nodes_of(instance.second), attributes, false);
+				self(self, depth + 1, level + 1, instance.second);
+				writer.close(depth);
+			}
+		} else {
+			std::map<std::uint32_t, std::vector<const logical_core_t*>> physical_cores;
+			for(const logical_core_t* core : cores) {
+				physical_cores[core->core_id].push_back(core);
+			}
+			for(const auto& physical : physical_cores) {
+				writer.open(depth, "Core", physical.first, cpus_of(physical.second), nodes_of(physical.second), "", false);
+				for(const logical_core_t* core : physical.second) {
+					writer.open(depth + 1, "PU", pu_of.at(core->full_apic_id), cpus_of({ core }), { node_of(*core) }, "", true);
+				}
+				writer.close(depth);
+			}
+		}
+	};
+
+	std::vector<const logical_core_t*> all_cores;
+	for(const logical_core_t& core : machine.all_cores) {
+		all_cores.push_back(&core);
+	}
+	std::set<std::uint32_t> all_nodes;
+	for(const auto& node : node_cpus) {
+		all_nodes.insert(node.first);
+	}
+
+	format_to(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	format_to(out, "<!DOCTYPE topology SYSTEM \"hwloc2.dtd\">\n");
+	format_to(out, "<topology version=\"2.0\">\n");
+	writer.open(1, "Machine", 0_u32, cpus_of(all_cores), all_nodes, "", false);
+	if(!use_os_numbers) {
+		format_to(out, "    <info name=\"CPUIDUnbound\" value=\"PU os_index values are in APIC ID order, not the OS's CPU numbers, so they can't be bound to\"/>\n");
+	}
+	for(const auto& package : machine.packages) {
+		std::vector<const logical_core_t*> package_cores;
+		for(const logical_core_t* core : all_cores) {
+			if(core->package_id == package.first) {
+				package_cores.push_back(core);
+			}
+		}
+		writer.open(2, "Package", package.first, cpus_of(package_cores), nodes_of(package_cores), "", false);
+		write_level(write_level, 3, 0, package_cores);
+		// memory children come after the normal ones, as hwloc writes them
+		for(const auto& node : package_of_node) {
+			if(node.second == package.first && machine_nodes.count(node.first) == 0) {
+				write_node(3, node.first);
+			}
+		}
+		writer.close(2);
+	}
+	for(const std::uint32_t node : machine_nodes) {
+		write_node(2, node);
+	}
+	writer.close(1);
+
+	if(!machine.node_distances.empty()) {
+		const std::size_t count = machine.node_distances.size();
+		format_to(out, "  <distances2 type=\"NUMANode\" nbobjs=\"{:d}\" kind=\"5\" indexing=\"os\">\n", count);
+		format_to(out, "    <indexes length=\"{:d}\">", count);
+		for(const auto& node : machine.node_distances) {
+			format_to(out, "{:d} ", node.first);
+		}
+		format_to(out, "</indexes>\n");
+		format_to(out, "    <u64values length=\"{:d}\">", count * count);
+		for(const auto& node : machine.node_distances) {
+			for(std::size_t i = 0; i < count; ++i) {
+				format_to(out, "{:d} ", i < node.second.size() ? node.second[i] : 0_u32);
+			}
+		}
+		format_to(out, "</u64values>\n");
+		format_to(out, "  </distances2>\n");
+	}
+	format_to(out, "</topology>\n");
+}
+
+}
@@ -0,0 +1,140 @@
+#ifndef JSON_WRITER_HPP
+#define JSON_WRITER_HPP
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "cpuid/suffixes.hpp"
+
+namespace cpuid {
+
+	// Writes JSON straight into a memory_buffer as it goes, keeping only a comma flag per open container,
+	// so there is no document to build and nothing to allocate beyond the buffer itself.
+	class json_writer_t
+	{
+	public:
+		explicit json_writer_t(fmt::memory_buffer& out_) noexcept : out(out_) {
+		}
+
+		void begin_object() {
+			open('{');
+		}
+
+		void end_object() {
+			close('}');
+		}
+
+		void begin_array() {
+			open('[');
+		}
+
+		void end_array() {
+			close(']');
+		}
+
+		json_writer_t& key(std::string_view name) {
+			separate();
+			quoted(name);
+			out.push_back(':');
+			after_key = true;
+			return *this;
+		}
+
+		void number(std::uint64_t value) {
+			separate();
+			format_to(out, "{:d}", value);
+		}
+
+		void boolean(bool value) {
+			separate();
+			append(value ? "true" : "false");
+		}
+
+		void string(std::string_view value) {
+			separate();
+			quoted(value);
+		}
+
+		// starts a new line before the next value, after its comma, to keep lines short for line-oriented tools
+		void line_break() {
+			if(depth == 0) {
+				out.push_back('\n');
+			} else {
+				break_pending = true;
+			}
+		}
+
+	private:
+		void open(char bracket) {
+			if(depth == max_depth) {
+				throw std::runtime_error(fmt::format("JSON is nested more than {:d} deep", max_depth));
+			}
+			separate();
+			out.push_back(bracket);
+			first[depth++] = true;
+		}
+
+		void close(char bracket) {
+			break_pending = false;
+			--depth;
+			out.push_back(bracket);
+		}
+
+		void separate() {
+			if(after_key) {
+				after_key = false;
+				return;
+			}
+			if(depth > 0) {
+				if(!first[depth - 1]) {
+					out.push_back(',');
+				}
+				first[depth - 1] = false;
+			}
+			if(break_pending) {
+				break_pending = false;
+				out.push_back('\n');
+			}
+		}
+
+		void append(std::string_view text) {
+			out.append(text.data(), text.data() + text.size());
+		}
+
+		void quoted(std::string_view text) {
+			out.push_back('"');
+			std::size_t start = 0;
+			for(std::size_t i = 0; i < text.size(); ++i) {
+				const unsigned char ch = static_cast<unsigned char>(text[i]);
+				if(ch >= 0x20_u8 && ch != '"' && ch != '\\') {
+					continue;
+				}
+				append(text.substr(start, i - start));
+				switch(ch) {
+				case '"':  append("\\\""); break;
+				case '\\': append("\\\\"); break;
+				case '\n': append("\\n");  break;
+				case '\t': append("\\t");  break;
+				default:   format_to(out, "\\u{:04x}", static_cast<std::uint32_t>(ch)); break;
+				}
+				start = i + 1;
+			}
+			append(text.substr(start));
+			out.push_back('"');
+		}
+
+		static constexpr std::size_t max_depth = 32;
+
+		fmt::memory_buffer& out;
+		std::array<bool, max_depth> first = {};
+		std::size_t depth = 0;
+		bool after_key = false;
+		bool break_pending = false;
+	};
+}
+
+#endif
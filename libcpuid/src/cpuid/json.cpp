@@ -0,0 +1,208 @@
+#include "stdafx.h"
+
+#include "cpuid/cpuid.hpp"
+#include "cpuid/sink.hpp"
+#include "features.hpp"
+#include "json-writer.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+namespace {
+
+std::string_view cache_type_name(std::uint32_t type) noexcept {
+	switch(type) {
+	case 1:
+		return "data";
+	case 2:
+		return "instruction";
+	case 3:
+		return "unified";
+	default:
+		return "unknown";
+	}
+}
+
+// the text printers colour the feature markers; the document carries the plain text
+std::string strip_escapes(std::string_view text) {
+	std::string plain;
+	plain.reserve(text.size());
+	for(std::size_t i = 0; i < text.size(); ++i) {
+		if(text[i] == '\x1b' && i + 1 < text.size() && text[i + 1] == '[') {
+			i = std::min(text.find('m', i), text.size() - 1);
+		} else {
+			plain.push_back(text[i]);
+		}
+	}
+	return plain;
+}
+
+void write_cpu(json_writer_t& json, const cpu_t& cpu, bool skip_vendor_check, bool skip_feature_check) {
+	json.begin_object();
+	json.key("apic_id").number(cpu.apic_id);
+	json.key("vendor").string(to_string(cpu.vendor));
+	json.key("family").number(cpu.model.family);
+	json.key("model").number(cpu.model.model);
+	json.key("stepping").number(cpu.model.stepping);
+	json.key("leaves").begin_array();
+	for(const auto& l : cpu.leaves) {
+		for(const auto& s : l.second) {
+			const register_set_t& regs = s.second;
+			json.begin_object();
+			json.key("leaf").number(static_cast<std::uint32_t>(l.first));
+			json.key("subleaf").number(static_cast<std::uint32_t>(s.first));
+			json.key("eax").number(regs[eax]);
+			json.key("ebx").number(regs[ebx]);
+			json.key("ecx").number(regs[ecx]);
+			json.key("edx").number(regs[edx]);
+			json.key("features").begin_array();
+			for(register_type reg = eax; reg <= edx; ++reg) {
+				enumerate_features(cpu, l.first, s.first, reg, [&json] (const feature_t& feature, bool set) {
+					if(set && !feature.mnemonic.empty()) {
+						json.string(feature.mnemonic);
+					}
+				});
+			}
+			json.end_array();
+			json.end_object();
+		}
+	}
+	json.end_array();
+	json.key("decoded").begin_array();
+	for(const auto& l : cpu.leaves) {
+		fmt::memory_buffer text;
+		print_leaf(text, cpu, l.first, skip_vendor_check, skip_feature_check);
+		if(text.size() != 0) {
+			json.begin_object();
+			json.key("leaf").number(static_cast<std::uint32_t>(l.first));
+			json.key("text").string(strip_escapes(to_string(text)));
+			json.end_object();
+		}
+	}
+	json.end_array();
+	json.end_object();
+}
+
+void write_topology(json_writer_t& json, const system_t& machine) {
+	json.begin_object();
+	json.key("vendor").string(to_string(machine.vendor));
+	json.key("caches").begin_array();
+	for(const cache_t& cache : machine.all_caches) {
+		json.begin_object();
+		json.key("level").number(cache.level);
+		json.key("type").string(cache_type_name(cache.type));
+		json.key("total_size").number(cache.total_size);
+		json.key("line_size").number(cache.line_size);
+		json.key("ways").number(cache.ways);
+		json.key("sets").number(cache.sets);
+		json.key("line_partitions").number(cache.line_partitions);
+		json.key("fully_associative").boolean(cache.fully_associative);
+		json.key("self_initializing").boolean(cache.self_initializing);
+		json.key("inclusive").boolean(cache.inclusive);
+		json.key("complex_addressed").boolean(cache.complex_addressed);
+		json.key("instances").begin_array();
+		for(const auto& instance : cache.instances) {
+			json.begin_array();
+			for(const std::uint32_t apic_id : instance.second.sharing_ids) {
+				json.number(apic_id);
+			}
+			json.end_array();
+		}
+		json.end_array();
+		json.end_object();
+	}
+	json.end_array();
+	json.key("packages").begin_array();
+	for(const auto& package : machine.packages) {
+		json.begin_object();
+		json.key("id").number(package.first);
+		json.key("cores").begin_array();
+		for(const auto& physical : package.second.physical_cores) {
+			json.begin_object();
+			json.key("id").number(physical.first);
+			json.key("threads").begin_array();
+			for(const auto& logical : physical.second.logical_cores) {
+				json.begin_object();
+				json.key("id").number(logical.first);
+				json.key("apic_id").number(logical.second.full_apic_id);
+				if(logical.second.os_index != unknown_id) {
+					json.key("os_index").number(logical.second.os_index);
+				}
+				if(logical.second.core_type != hybrid_core_type::none) {
+					json.key("core_type").string(logical.second.core_type == hybrid_core_type::core ? "core"
+				                           : logical.second.core_type == hybrid_core_type::atom ? "atom"
+				                           :                                                      "unknown");
+				}
+				if(logical.second.node_id != unknown_id) {
+					json.key("node").number(logical.second.node_id);
+				}
+				json.end_object();
+			}
+			json.end_array();
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+	}
+	json.end_array();
+	if(!machine.node_distances.empty()) {
+		json.key("nodes").begin_array();
+		for(const auto& node : machine.node_distances) {
+			json.begin_object();
+			json.key("id").number(node.first);
+			const bool sub_numa = std::any_of(machine.sub_numa_domains.begin(), machine.sub_numa_domains.end(), [&node] (const auto& domains) {
+				return std::find(domains.second.begin(), domains.second.end(), node.first) != domains.second.end();
+			});
+			json.key("sub_numa").boolean(sub_numa);
+			json.key("distances").begin_array();
+			for(const std::uint32_t distance : node.second) {
+				json.number(distance);
+			}
+			json.end_array();
+			json.end_object();
+		}
+		json.end_array();
+	}
+	json.end_object();
+}
+
+void print_json(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const system_t* machine, bool skip_vendor_check, bool skip_feature_check, output_sink_t* sink) {
+	json_writer_t json(out);
+	json.begin_object();
+	json.key("cpus").begin_array();
+	for(const std::uint32_t apic_id : apic_ids) {
+		json.line_break();
+		write_cpu(json, logical_cpus.at(apic_id), skip_vendor_check, skip_feature_check);
+		if(sink) {
+			sink->commit();
+		}
+	}
+	json.end_array();
+	if(machine) {
+		json.line_break();
+		json.key("topology");
+		write_topology(json, *machine);
+	}
+	json.end_object();
+	json.line_break();
+}
+
+}
+
+void print_json(fmt::memory_buffer& out, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const system_t* machine, bool skip_vendor_check, bool skip_feature_check) {
+	print_json(out, logical_cpus, apic_ids, machine, skip_vendor_check, skip_feature_check, nullptr);
+}
+
+void print_json(output_sink_t& sink, const std::map<std::uint32_t, cpu_t>& logical_cpus, const std::vector<std::uint32_t>& apic_ids, const system_t* machine, bool skip_vendor_check, bool skip_feature_check) {
+	print_json(sink.buffer(), logical_cpus, apic_ids, machine, skip_vendor_check, skip_feature_check, &sink);
+	sink.flush();
+}
+
+}
@@ -0,0 +1,156 @@
+#include "stdafx.h"
+
+#include "cpuid/cpuid.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cpuid {
+
+namespace {
+
+// Sub-NUMA clustering and cluster-on-die split a package's L3 between nodes with their own memory controllers,
+// so the nodes of a split L3 are closer to each other than to any node outside it.
+void find_sub_numa_domains(system_t& machine) {
+	const cache_t* last_level = nullptr;
+	std::size_t last_level_index = 0;
+	for(std::size_t i = 0; i < machine.all_caches.size(); ++i) {
+		const cache_t& cache = machine.all_caches[i];
+		if(cache.type != 2_u32 && (last_level == nullptr || cache.level > last_level->level)) {
+			last_level = &cache;
+			last_level_index = i;
+		}
+	}
+	if(last_level == nullptr) {
+		return;
+	}
+
+	// the distance rows are in node ID order, whatever the IDs are
+	std::unordered_map<std::uint32_t, std::size_t> column_of;
+	for(const auto& node : machine.node_distances) {
+		column_of.insert({ node.first, column_of.size() });
+	}
+	const auto distance = [&machine, &column_of] (std::uint32_t from, std::uint32_t to) {
+		const std::vector<std::uint32_t>& row = machine.node_distances.at(from);
+		const std::size_t column = column_of.at(to);
+		return column < row.size() ? row[column] : 0_u32;
+	};
+
+	std::map<std::uint32_t, std::set<std::uint32_t>> nodes_of_instance;
+	std::map<std::uint32_t, std::uint32_t> package_of_instance;
+	// CPUs that sysfs didn't list, because they're offline or their OS numbers aren't known, have no node to count
+	for(const logical_core_t& core : machine.all_cores) {
+		if(core.node_id == unknown_id) {
+			continue;
+		}
+		const std::uint32_t instance = core.non_shared_cache_ids[last_level_index];
+		nodes_of_instance[instance].insert(core.node_id);
+		package_of_instance[instance] = core.package_id;
+	}
+	for(const auto& instance : nodes_of_instance) {
+		const std::set<std::uint32_t>& nodes = instance.second;
+		if(nodes.size() < 2 || !std::all_of(nodes.begin(), nodes.end(), [&column_of] (std::uint32_t node) { return column_of.count(node) != 0; })) {
+			continue;
+		}
+		bool closer = true;
+		for(const std::uint32_t from : nodes) {
+			for(const std::uint32_t to : nodes) {
+				for(const auto& other : machine.node_distances) {
+					if(from != to && nodes.count(other.first) == 0) {
+						closer = closer && distance(from, to) < distance(from, other.first);
+					}
+				}
+			}
+		}
+		if(closer) {
+			std::vector<std::uint32_t>& domains = machine.sub_numa_domains[package_of_instance.at(instance.first)];
+			domains.insert(domains.end(), nodes.begin(), nodes.end());
+		}
+	}
+	if(!machine.sub_numa_domains.empty()) {
+		machine.valid_levels.insert(level_type::sub_numa);
+	}
+}
+
+}
+
+void add_numa_nodes(system_t& machine, const std::filesystem::path& sysfs_root) {
+	const std::filesystem::path node_root = sysfs_root / "devices" / "system" / "node";
+	std::error_code ec;
+	if(!std::filesystem::is_directory(node_root, ec)) {
+		return;
+	}
+
+	std::unordered_map<std::uint32_t, std::uint32_t> node_of;
+	std::map<std::uint32_t, std::vector<std::uint32_t>> distances;
+	for(const auto& entry : std::filesystem::directory_iterator(node_root, ec)) {
+		// there are also files such as online and has_cpu alongside the node directories
+		const std::string name = entry.path().filename().string();
+		if(name.size() <= 4 || name.compare(0, 4, "node") != 0 || !std::all_of(name.begin() + 4, name.end(), [] (char ch) { return std::isdigit(static_cast<unsigned char>(ch)) != 0; })) {
+			continue;
+		}
+		const std::uint32_t node = static_cast<std::uint32_t>(std::stoul(name.substr(4)));
+
+		std::ifstream cpulist(entry.path() / "cpulist");
+		std::string line;
+		std::getline(cpulist, line);
+		// memory-only nodes have an empty list
+		for(const std::uint32_t os_cpu : from_cpulist(line)) {
+			if(os_cpu < machine.apic_id_by_os_index.size() && machine.apic_id_by_os_index[os_cpu] != unknown_id) {
+				node_of[machine.apic_id_by_os_index[os_cpu]] = node;
+			}
+		}
+
+		std::ifstream distance(entry.path() / "distance");
+		std::vector<std::uint32_t>& row = distances[node];
+		for(std::uint32_t d = 0_u32; distance >> d; ) {
+			row.push_back(d);
+		}
+	}
+	if(distances.empty()) {
+		return;
+	}
+
+	const auto assign = [&node_of] (logical_core_t& core) {
+		const auto it = node_of.find(core.full_apic_id);
+		if(it != node_of.end()) {
+			core.node_id = it->second;
+		}
+	};
+	for(logical_core_t& core : machine.all_cores) {
+		assign(core);
+	}
+	for(auto& package : machine.packages) {
+		for(auto& physical : package.second.physical_cores) {
+			for(auto& logical : physical.second.logical_cores) {
+				assign(logical.second);
+				if(logical.second.node_id != unknown_id) {
+					package.second.nodes[logical.second.node_id].physical_cores[physical.first].logical_cores[logical.first] = logical.second;
+				}
+			}
+		}
+		for(auto& die : package.second.dies) {
+			for(auto& tile : die.second.tiles) {
+				for(auto& module : tile.second.modules) {
+					for(auto& physical : module.second.physical_cores) {
+						for(auto& logical : physical.second.logical_cores) {
+							assign(logical.second);
+						}
+					}
+				}
+			}
+		}
+	}
+	machine.node_distances = std::move(distances);
+	machine.valid_levels.insert(level_type::node);
+	find_sub_numa_domains(machine);
+}
+
+}
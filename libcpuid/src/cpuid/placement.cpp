@@ -0,0 +1,325 @@
+#include "stdafx.h"
+
+#include "cpuid/placement.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+namespace {
+
+struct core_threads_t
+{
+	std::uint32_t package;
+	std::vector<std::uint32_t> threads;
+};
+
+std::map<std::uint32_t, std::vector<std::size_t>> group_by_package(const std::vector<core_threads_t>& cores) {
+	std::map<std::uint32_t, std::vector<std::size_t>> packages;
+	for(std::size_t i = 0; i < cores.size(); ++i) {
+		packages[cores[i].package].push_back(i);
+	}
+	return packages;
+}
+
+// the last level cache, which is what the L3 domains are made from
+const cache_t* find_last_level_cache(const system_t& machine) noexcept {
+	const cache_t* last_level = nullptr;
+	for(const cache_t& cache : machine.all_caches) {
+		if(cache.type != 2_u32 && !cache.instances.empty() && (last_level == nullptr || cache.level > last_level->level)) {
+			last_level = &cache;
+		}
+	}
+	return last_level;
+}
+
+// each domain is the indices of its physical cores, in the order collect_cores gave them
+std::vector<std::vector<std::size_t>> find_l3_domains(const system_t& machine, const std::vector<core_threads_t>& cores) {
+	std::unordered_map<std::uint32_t, std::size_t> core_of;
+	for(std::size_t i = 0; i < cores.size(); ++i) {
+		for(const std::uint32_t apic_id : cores[i].threads) {
+			core_of[apic_id] = i;
+		}
+	}
+
+	std::vector<std::vector<std::size_t>> domains;
+	if(const cache_t* last_level = find_last_level_cache(machine)) {
+		for(const auto& instance : last_level->instances) {
+			std::vector<std::size_t> domain;
+			for(const std::uint32_t apic_id : instance.second.sharing_ids) {
+				const auto it = core_of.find(apic_id);
+				if(it != core_of.end() && std::find(domain.begin(), domain.end(), it->second) == domain.end()) {
+					domain.push_back(it->second);
+				}
+			}
+			if(!domain.empty()) {
+				std::sort(domain.begin(), domain.end());
+				domains.push_back(std::move(domain));
+			}
+		}
+	} else {
+		for(auto& package : group_by_package(cores)) {
+			domains.push_back(std::move(package.second));
+		}
+	}
+	return domains;
+}
+
+// in APIC ID order, except that on hybrid parts the Core cores come before the Atom cores
+std::vector<core_threads_t> collect_cores(const system_t& machine, hybrid_core_type only_type) {
+	std::vector<core_threads_t> cores;
+	std::vector<core_threads_t> atom_cores;
+	for(const auto& package : machine.packages) {
+		for(const auto& physical : package.second.physical_cores) {
+			const hybrid_core_type type = physical.second.logical_cores.begin()->second.core_type;
+			if(only_type != hybrid_core_type::none && type != only_type) {
+				continue;
+			}
+			core_threads_t core = { package.first };
+			for(const auto& logical : physical.second.logical_cores) {
+				core.threads.push_back(logical.second.full_apic_id);
+			}
+			(type == hybrid_core_type::atom ? atom_cores : cores).push_back(std::move(core));
+		}
+	}
+	cores.insert(cores.end(), std::make_move_iterator(atom_cores.begin()), std::make_move_iterator(atom_cores.end()));
+	return cores;
+}
+
+void check_capacity(std::size_t workers, std::size_t available, const char* what) {
+	if(workers > available) {
+		throw std::runtime_error(fmt::format("{:d} workers need more than the {:d} {:s} available", workers, available, what));
+	}
+}
+
+std::vector<std::vector<std::uint32_t>> place_apic_ids(const system_t& machine, std::size_t workers, placement_policy policy, std::size_t workers_per_l3, hybrid_core_type only_type) {
+	const std::vector<core_threads_t> cores = collect_cores(machine, only_type);
+	std::size_t total_threads = 0;
+	for(const core_threads_t& core : cores) {
+		total_threads += core.threads.size();
+	}
+
+	std::vector<std::vector<std::uint32_t>> placement;
+	placement.reserve(workers);
+	switch(policy) {
+	case placement_policy::compact:
+		check_capacity(workers, total_threads, "threads");
+		for(const core_threads_t& core : cores) {
+			for(const std::uint32_t apic_id : core.threads) {
+				if(placement.size() == workers) {
+					return placement;
+				}
+				placement.push_back({ apic_id });
+			}
+		}
+		break;
+	case placement_policy::physical:
+		check_capacity(workers, cores.size(), "physical cores");
+		for(std::size_t i = 0; i < workers; ++i) {
+			placement.push_back({ cores[i].threads.front() });
+		}
+		break;
+	case placement_policy::scatter:
+		{
+			check_capacity(workers, total_threads, "threads");
+			// the n-th domain of each package comes before the n+1-th of any
+			std::map<std::uint32_t, std::vector<std::vector<std::size_t>>> by_package;
+			for(std::vector<std::size_t>& domain : find_l3_domains(machine, cores)) {
+				by_package[cores[domain.front()].package].push_back(std::move(domain));
+			}
+			std::vector<std::vector<std::uint32_t>> sequences;
+			for(std::size_t round = 0; ; ++round) {
+				bool any = false;
+				for(const auto& package : by_package) {
+					if(round >= package.second.size()) {
+						continue;
+					}
+					any = true;
+					// every core's first thread, then every core's second, and so on
+					std::vector<std::uint32_t> sequence;
+					for(std::size_t sibling = 0; ; ++sibling) {
+						const std::size_t before = sequence.size();
+						for(const std::size_t core : package.second[round]) {
+							if(sibling < cores[core].threads.size()) {
+								sequence.push_back(cores[core].threads[sibling]);
+							}
+						}
+						if(sequence.size() == before) {
+							break;
+						}
+					}
+					sequences.push_back(std::move(sequence));
+				}
+				if(!any) {
+					break;
+				}
+			}
+			std::vector<std::size_t> taken(sequences.size(), 0);
+			while(placement.size() < workers) {
+				for(std::size_t d = 0; d < sequences.size() && placement.size() < workers; ++d) {
+					if(taken[d] < sequences[d].size()) {
+						placement.push_back({ sequences[d][taken[d]++] });
+					}
+				}
+			}
+		}
+		break;
+	case placement_policy::l3_helper:
+		{
+			const std::vector<std::vector<std::size_t>> domains = find_l3_domains(machine, cores);
+			check_capacity(workers, domains.size() * workers_per_l3, "L3 domain slots");
+			for(std::size_t i = 0; i < workers; ++i) {
+				const std::vector<std::size_t>& domain = domains[i / workers_per_l3];
+				if(domain.size() < workers_per_l3) {
+					throw std::runtime_error(fmt::format("an L3 domain has only {:d} cores for {:d} workers", domain.size(), workers_per_l3));
+				}
+				const core_threads_t& core = cores[domain[i % workers_per_l3]];
+				if(core.threads.size() < 2) {
+					throw std::runtime_error(fmt::format("apic id {:#04x} has no SMT sibling for a helper", core.threads.front()));
+				}
+				placement.push_back({ core.threads[0], core.threads[1] });
+			}
+		}
+		break;
+	}
+	return placement;
+}
+
+}
+
+std::vector<std::vector<std::uint32_t>> place_workers(const system_t& machine, std::size_t workers, placement_policy policy, std::size_t workers_per_l3, hybrid_core_type only_type) {
+	if(!knows_os_numbers(machine)) {
+		throw std::runtime_error("workers can only be placed on a machine with every CPU's OS number");
+	}
+	std::vector<std::vector<std::uint32_t>> placement = place_apic_ids(machine, workers, policy, workers_per_l3, only_type);
+	for(std::vector<std::uint32_t>& worker : placement) {
+		for(std::uint32_t& cpu : worker) {
+			cpu = machine.os_index_by_apic_id.at(cpu);
+		}
+	}
+	return placement;
+}
+
+#if defined(__linux__)
+cpu_set_t to_cpu_set(const std::vector<std::uint32_t>& os_cpus) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(const std::uint32_t cpu : os_cpus) {
+		if(cpu >= CPU_SETSIZE) {
+			throw std::runtime_error(fmt::format("CPU {:d} doesn't fit in a cpu_set_t", cpu));
+		}
+		CPU_SET(cpu, &set);
+	}
+	return set;
+}
+#endif
+
+namespace {
+
+std::string to_coremask(const std::vector<std::uint32_t>& sorted_ids) {
+	std::vector<std::uint32_t> nibbles(sorted_ids.back() / 4_u32 + 1_u32);
+	for(const std::uint32_t id : sorted_ids) {
+		nibbles[id / 4_u32] |= 1_u32 << (id % 4_u32);
+	}
+	std::string mask = "0x";
+	for(auto it = nibbles.rbegin(); it != nibbles.rend(); ++it) {
+		mask.push_back("0123456789abcdef"[*it]);
+	}
+	return mask;
+}
+
+}
+
+void print_placement(fmt::memory_buffer& out, const system_t& machine, placement_export kind, placement_domain domain, bool skip_siblings, hybrid_core_type only_type, bool apic_ids) {
+	const bool use_os_numbers = knows_os_numbers(machine);
+	if(!use_os_numbers && !apic_ids) {
+		throw std::runtime_error("placements need every CPU's OS number, and the machine doesn't have them");
+	}
+	const std::vector<core_threads_t> cores = collect_cores(machine, only_type);
+	std::vector<std::pair<std::string, std::vector<std::size_t>>> domains;
+	switch(domain) {
+	case placement_domain::machine:
+		domains.push_back({ "machine", {} });
+		for(std::size_t i = 0; i < cores.size(); ++i) {
+			domains.back().second.push_back(i);
+		}
+		break;
+	case placement_domain::package:
+		for(auto& package : group_by_package(cores)) {
+			domains.push_back({ fmt::format("package-{:d}", package.first), std::move(package.second) });
+		}
+		break;
+	case placement_domain::l3:
+		for(std::vector<std::size_t>& l3 : find_l3_domains(machine, cores)) {
+			domains.push_back({ fmt::format("l3-{:d}", domains.size()), std::move(l3) });
+		}
+		break;
+	}
+	// a type that the machine has none of leaves every domain empty
+	domains.erase(std::remove_if(domains.begin(), domains.end(), [] (const auto& d) { return d.second.empty(); }), domains.end());
+	if(domains.empty()) {
+		throw std::runtime_error("there are no CPUs of that type to place");
+	}
+
+	const auto number = [&machine, use_os_numbers] (std::uint32_t apic_id) {
+		return use_os_numbers ? machine.os_index_by_apic_id.at(apic_id) : apic_id;
+	};
+
+	if(!use_os_numbers) {
+		format_to(out, "# warning: these are APIC IDs, not the OS CPU numbers that affinity tools take, which the dump doesn't record\n");
+	}
+	if(kind == placement_export::cpuset) {
+		format_to(out, "# from the parent cgroup's directory\n");
+		format_to(out, "echo +cpuset > cgroup.subtree_control\n");
+	}
+	for(const auto& d : domains) {
+		std::vector<std::uint32_t> ids;
+		for(const std::size_t core : d.second) {
+			for(std::size_t t = 0; t < (skip_siblings ? 1 : cores[core].threads.size()); ++t) {
+				ids.push_back(number(cores[core].threads[t]));
+			}
+		}
+		std::sort(ids.begin(), ids.end());
+		const std::string cpulist = to_cpulist(ids);
+
+		format_to(out, "# {:s}\n", d.first);
+		switch(kind) {
+		case placement_export::taskset:
+			format_to(out, "taskset -c {:s}\n", cpulist);
+			break;
+		case placement_export::cpuset:
+			format_to(out, "mkdir -p {:s}\n", d.first);
+			format_to(out, "echo {:s} > {:s}/cpuset.cpus\n", cpulist, d.first);
+			format_to(out, "echo root > {:s}/cpuset.cpus.partition\n", d.first);
+			break;
+		case placement_export::omp:
+			{
+				// a place for each physical core, holding whichever of its threads are used
+				format_to(out, "OMP_PLACES=\"");
+				for(std::size_t i = 0; i < d.second.size(); ++i) {
+					const core_threads_t& core = cores[d.second[i]];
+					format_to(out, "{:s}{{", i != 0 ? "," : "");
+					for(std::size_t t = 0; t < (skip_siblings ? 1 : core.threads.size()); ++t) {
+						format_to(out, "{:s}{:d}", t != 0 ? "," : "", number(core.threads[t]));
+					}
+					format_to(out, "}}");
+				}
+				format_to(out, "\" OMP_PROC_BIND=spread OMP_NUM_THREADS={:d}\n", ids.size());
+			}
+			break;
+		case placement_export::dpdk:
+			format_to(out, "-l {:s}\n", cpulist);
+			format_to(out, "-c {:s}\n", to_coremask(ids));
+			break;
+		}
+	}
+}
+
+}
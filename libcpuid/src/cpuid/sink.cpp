@@ -0,0 +1,108 @@
+#include "stdafx.h"
+
+#include "cpuid/sink.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+namespace {
+#if defined(_WIN32)
+	int open_for_output(const std::string& filename) noexcept {
+		return ::_open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_TEXT, _S_IREAD | _S_IWRITE);
+	}
+
+	int standard_output() noexcept {
+		return ::_fileno(stdout);
+	}
+
+	long long write_some(int fd, const char* data, std::size_t size) noexcept {
+		// _write takes an unsigned int length
+		const unsigned int length = size > 0x4000'0000 ? 0x4000'0000u : static_cast<unsigned int>(size);
+		return ::_write(fd, data, length);
+	}
+
+	void close_output(int fd) noexcept {
+		::_close(fd);
+	}
+#else
+	int open_for_output(const std::string& filename) noexcept {
+		int fd = -1;
+		do {
+			fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		} while(fd == -1 && errno == EINTR);
+		return fd;
+	}
+
+	int standard_output() noexcept {
+		return STDOUT_FILENO;
+	}
+
+	long long write_some(int fd, const char* data, std::size_t size) noexcept {
+		return ::write(fd, data, size);
+	}
+
+	void close_output(int fd) noexcept {
+		::close(fd);
+	}
+#endif
+}
+
+output_sink_t::output_sink_t(std::size_t chunk_size_) : fd(standard_output()), owns_fd(false), chunk_size(chunk_size_), out() {
+}
+
+output_sink_t::output_sink_t(const std::string& filename, std::size_t chunk_size_) : fd(-1), owns_fd(false), chunk_size(chunk_size_), out() {
+	if(filename == "-") {
+		fd = standard_output();
+	} else {
+		fd = open_for_output(filename);
+		if(fd == -1) {
+			throw std::runtime_error(fmt::format("Could not open {:s} for output", filename));
+		}
+		owns_fd = true;
+	}
+}
+
+output_sink_t::~output_sink_t() {
+	try {
+		flush();
+	} catch(...) {
+	}
+	if(owns_fd) {
+		close_output(fd);
+	}
+}
+
+void output_sink_t::flush() {
+	const char* data = out.data();
+	std::size_t remaining = out.size();
+	while(remaining > 0) {
+		const long long written = write_some(fd, data, remaining);
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			const int error = errno;
+			out.resize(0);
+			throw std::system_error(error, std::generic_category(), "Could not write output");
+		}
+		data      += written;
+		remaining -= static_cast<std::size_t>(written);
+	}
+	out.resize(0);
+}
+
+}
@@ -832,6 +832,31 @@ void print_system_on_chip_vendor(fmt::memory_buffer& out, const cpu_t& cpu) {
 	}
 }
 
+void print_hybrid_information(fmt::memory_buffer& out, const cpu_t& cpu) {
+	const register_set_t& regs = cpu.leaves.at(leaf_type::hybrid_information).at(subleaf_type::main);
+
+	const struct
+	{
+		std::uint32_t native_model_id : 24;
+		std::uint32_t core_type       : 8;
+	} a = bit_cast<decltype(a)>(regs[eax]);
+
+	format_to(out, "Hybrid information\n");
+	switch(a.core_type) {
+	case 0x20:
+		format_to(out, "\tCore type: Atom\n");
+		break;
+	case 0x40:
+		format_to(out, "\tCore type: Core\n");
+		break;
+	default:
+		format_to(out, "\tCore type: unknown ({:#04x})\n", a.core_type);
+		break;
+	}
+	format_to(out, "\tNative model ID: {:#08x}\n", a.native_model_id);
+	format_to(out, "\n");
+}
+
 void enumerate_pconfig(cpu_t& cpu) {
 	cpu.leaves[leaf_type::pconfig][subleaf_type::main] = cpuid(leaf_type::pconfig, subleaf_type::main);
 
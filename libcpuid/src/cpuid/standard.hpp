@@ -44,6 +44,8 @@ namespace cpuid
 	void enumerate_system_on_chip_vendor(cpu_t& cpu);
 	void print_system_on_chip_vendor(fmt::memory_buffer& out, const cpu_t& cpu);
 
+	void print_hybrid_information(fmt::memory_buffer& out, const cpu_t& cpu);
+
 	void enumerate_pconfig(cpu_t& cpu);
 	void print_pconfig(fmt::memory_buffer& out, const cpu_t& cpu);
 
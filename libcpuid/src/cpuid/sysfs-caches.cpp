@@ -0,0 +1,278 @@
+#include "stdafx.h"
+
+#include "cpuid/cpuid.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace cpuid {
+
+namespace {
+
+std::string read_line(const std::filesystem::path& file) {
+	std::ifstream fin(file);
+	std::string line;
+	std::getline(fin, line);
+	return line;
+}
+
+std::uint32_t read_number(const std::filesystem::path& file) {
+	const std::string line = read_line(file);
+	return line.empty() ? 0_u32 : static_cast<std::uint32_t>(std::stoul(line));
+}
+
+// Linux writes sizes in kilobytes, as 32K, though some architectures use M for the biggest caches
+std::uint32_t read_size(const std::filesystem::path& file) {
+	const std::string line = read_line(file);
+	if(line.empty()) {
+		return 0_u32;
+	}
+	std::size_t end = 0;
+	const std::uint32_t size = static_cast<std::uint32_t>(std::stoul(line, &end));
+	switch(end < line.size() ? line[end] : ' ') {
+	case 'K':
+		return size * 1'024_u32;
+	case 'M':
+		return size * 1'024_u32 * 1'024_u32;
+	default:
+		return size;
+	}
+}
+
+bool is_numbered(const std::string& name, const std::string& prefix) {
+	return name.size() > prefix.size()
+	    && name.compare(0, prefix.size(), prefix) == 0
+	    && std::all_of(name.begin() + static_cast<std::ptrdiff_t>(prefix.size()), name.end(), [] (char ch) { return std::isdigit(static_cast<unsigned char>(ch)) != 0; });
+}
+
+using cache_key_t = std::pair<std::uint32_t, std::uint32_t>;
+
+struct sysfs_cache_t
+{
+	cache_t geometry;
+	// each instance's APIC IDs, sorted
+	std::set<std::vector<std::uint32_t>> instances;
+};
+
+std::map<cache_key_t, sysfs_cache_t> read_sysfs_caches(const system_t& machine, const std::filesystem::path& cpu_root) {
+	std::map<cache_key_t, sysfs_cache_t> caches;
+	std::error_code ec;
+	for(const auto& cpu : std::filesystem::directory_iterator(cpu_root, ec)) {
+		const std::string name = cpu.path().filename().string();
+		if(!is_numbered(name, "cpu")) {
+			continue;
+		}
+		const std::uint32_t os_cpu = static_cast<std::uint32_t>(std::stoul(name.substr(3)));
+		if(os_cpu >= machine.apic_id_by_os_index.size() || machine.apic_id_by_os_index[os_cpu] == unknown_id) {
+			continue;
+		}
+		for(const auto& index : std::filesystem::directory_iterator(cpu.path() / "cache", ec)) {
+			if(!is_numbered(index.path().filename().string(), "index")) {
+				continue;
+			}
+			const std::string type = read_line(index.path() / "type");
+			const cache_key_t key = { read_number(index.path() / "level"),
+			                          type == "Data"        ? 1_u32
+			                        : type == "Instruction" ? 2_u32
+			                        :                         3_u32 };
+			auto it = caches.find(key);
+			if(it == caches.end()) {
+				// every CPU describes the same cache, so the first one's geometry is used
+				cache_t geometry = {};
+				geometry.level     = key.first;
+				geometry.type      = key.second;
+				geometry.ways      = read_number(index.path() / "ways_of_associativity");
+				geometry.sets      = read_number(index.path() / "number_of_sets");
+				geometry.line_size = read_number(index.path() / "coherency_line_size");
+				geometry.total_size = read_size(index.path() / "size");
+				it = caches.insert({ key, { geometry, {} } }).first;
+			}
+			std::vector<std::uint32_t> sharing_ids;
+			for(const std::uint32_t os_sharer : from_cpulist(read_line(index.path() / "shared_cpu_list"))) {
+				if(os_sharer < machine.apic_id_by_os_index.size() && machine.apic_id_by_os_index[os_sharer] != unknown_id) {
+					sharing_ids.push_back(machine.apic_id_by_os_index[os_sharer]);
+				}
+			}
+			std::sort(sharing_ids.begin(), sharing_ids.end());
+			if(!sharing_ids.empty()) {
+				it->second.instances.insert(std::move(sharing_ids));
+			}
+		}
+	}
+	return caches;
+}
+
+// the APIC ID bits that differ within an instance, filled down to bit 0, as CPUID's sharing masks are
+std::uint32_t sharing_mask_of(const std::set<std::vector<std::uint32_t>>& instances) noexcept {
+	std::uint32_t varying = 0_u32;
+	for(const std::vector<std::uint32_t>& instance : instances) {
+		for(const std::uint32_t id : instance) {
+			varying |= id ^ instance.front();
+		}
+	}
+	std::uint32_t mask = 0_u32;
+	while(mask < varying) {
+		mask = (mask << 1_u32) | 1_u32;
+	}
+	return mask;
+}
+
+}
+
+std::vector<cache_disagreement_t> check_sysfs_caches(system_t& machine, const std::filesystem::path& sysfs_root, bool prefer_sysfs) {
+	std::vector<cache_disagreement_t> disagreements;
+	const std::map<cache_key_t, sysfs_cache_t> sysfs_caches = read_sysfs_caches(machine, sysfs_root / "devices" / "system" / "cpu");
+	if(sysfs_caches.empty()) {
+		return disagreements;
+	}
+
+	std::map<cache_key_t, std::size_t> cpuid_caches;
+	for(std::size_t i = 0; i < machine.all_caches.size(); ++i) {
+		cpuid_caches.insert({ { machine.all_caches[i].level, machine.all_caches[i].type }, i });
+	}
+	for(const auto& c : cpuid_caches) {
+		if(sysfs_caches.find(c.first) == sysfs_caches.end()) {
+			disagreements.push_back({ c.first.first, c.first.second, "CPUID reports it, but sysfs doesn't" });
+		}
+	}
+
+	std::vector<cache_key_t> preferred;
+	for(const auto& s : sysfs_caches) {
+		const auto c = cpuid_caches.find(s.first);
+		if(c == cpuid_caches.end()) {
+			disagreements.push_back({ s.first.first, s.first.second, "sysfs reports it, but CPUID doesn't" });
+			preferred.push_back(s.first);
+			continue;
+		}
+		const cache_t& cache = machine.all_caches[c->second];
+		bool disagrees = false;
+		if(cache.total_size != s.second.geometry.total_size) {
+			disagreements.push_back({ s.first.first, s.first.second, fmt::format("CPUID says it's {:d}K, but sysfs says {:d}K", cache.total_size / 1'024_u32, s.second.geometry.total_size / 1'024_u32) });
+			disagrees = true;
+		}
+
+		// CPUs that sysfs doesn't list, because they're offline or their OS numbers aren't known, can't be compared
+		std::set<std::uint32_t> listed;
+		for(const std::vector<std::uint32_t>& instance : s.second.instances) {
+			listed.insert(instance.begin(), instance.end());
+		}
+		std::set<std::vector<std::uint32_t>> cpuid_instances;
+		for(const auto& instance : cache.instances) {
+			std::vector<std::uint32_t> sharing_ids;
+			std::copy_if(instance.second.sharing_ids.begin(), instance.second.sharing_ids.end(), std::back_inserter(sharing_ids), [&listed] (std::uint32_t id) {
+				return listed.count(id) != 0;
+			});
+			std::sort(sharing_ids.begin(), sharing_ids.end());
+			if(!sharing_ids.empty()) {
+				cpuid_instances.insert(std::move(sharing_ids));
+			}
+		}
+		if(cpuid_instances != s.second.instances) {
+			const auto unmatched = std::find_if(s.second.instances.begin(), s.second.instances.end(), [&cpuid_instances] (const std::vector<std::uint32_t>& instance) {
+				return cpuid_instances.count(instance) == 0;
+			});
+			std::string description = fmt::format("CPUID has {:d} instances, but sysfs has {:d}", cpuid_instances.size(), s.second.instances.size());
+			if(unmatched != s.second.instances.end()) {
+				description += fmt::format(", including one shared by apic ids {:s}", to_cpulist(*unmatched));
+			}
+			disagreements.push_back({ s.first.first, s.first.second, description });
+			disagrees = true;
+		}
+		if(disagrees) {
+			preferred.push_back(s.first);
+		}
+	}
+
+	if(!prefer_sysfs || preferred.empty()) {
+		return disagreements;
+	}
+
+	// the preferred caches take sysfs's geometry and sharing, keeping any properties that only CPUID knows
+	std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> cache_ids;
+	for(const logical_core_t& core : machine.all_cores) {
+		cache_ids[core.full_apic_id] = core.non_shared_cache_ids;
+		cache_ids[core.full_apic_id].resize(machine.all_caches.size());
+	}
+	for(const cache_key_t& key : preferred) {
+		const sysfs_cache_t& source = sysfs_caches.at(key);
+		const auto c = cpuid_caches.find(key);
+		if(c == cpuid_caches.end()) {
+			machine.all_caches.push_back(source.geometry);
+		}
+		const std::size_t i = c != cpuid_caches.end() ? c->second : machine.all_caches.size() - 1;
+		cache_t& cache = machine.all_caches[i];
+		cache.ways         = source.geometry.ways;
+		cache.sets         = source.geometry.sets;
+		cache.line_size    = source.geometry.line_size;
+		cache.total_size   = source.geometry.total_size;
+		cache.sharing_mask = sharing_mask_of(source.instances);
+		for(auto& ids : cache_ids) {
+			ids.second.resize(machine.all_caches.size());
+			ids.second[i] = ids.first & ~cache.sharing_mask;
+		}
+		// sysfs's instances are keyed by their lowest APIC ID, which is what the mask gives when they're aligned,
+		// and the CPUs that sysfs doesn't list fall back to the mask
+		for(const std::vector<std::uint32_t>& instance : source.instances) {
+			for(const std::uint32_t id : instance) {
+				const auto ids = cache_ids.find(id);
+				if(ids != cache_ids.end()) {
+					ids->second[i] = instance.front();
+				}
+			}
+		}
+		cache.instances.clear();
+		for(const logical_core_t& core : machine.all_cores) {
+			cache.instances[cache_ids.at(core.full_apic_id)[i]].sharing_ids.push_back(core.full_apic_id);
+		}
+	}
+
+	const auto assign = [&machine, &cache_ids] (logical_core_t& core) {
+		core.non_shared_cache_ids = cache_ids.at(core.full_apic_id);
+		core.shared_cache_ids.clear();
+		for(const cache_t& cache : machine.all_caches) {
+			core.shared_cache_ids.push_back(core.full_apic_id & cache.sharing_mask);
+		}
+	};
+	for(logical_core_t& core : machine.all_cores) {
+		assign(core);
+	}
+	for(auto& package : machine.packages) {
+		for(auto& physical : package.second.physical_cores) {
+			for(auto& logical : physical.second.logical_cores) {
+				assign(logical.second);
+			}
+		}
+		for(auto& die : package.second.dies) {
+			for(auto& tile : die.second.tiles) {
+				for(auto& module : tile.second.modules) {
+					for(auto& physical : module.second.physical_cores) {
+						for(auto& logical : physical.second.logical_cores) {
+							assign(logical.second);
+						}
+					}
+				}
+			}
+		}
+		for(auto& node : package.second.nodes) {
+			for(auto& physical : node.second.physical_cores) {
+				for(auto& logical : physical.second.logical_cores) {
+					assign(logical.second);
+				}
+			}
+		}
+	}
+	return disagreements;
+}
+
+}
@@ -17,6 +17,12 @@
 #endif
 
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <vector>
+#include <algorithm>
 
 #include <codecvt>
 
@@ -48,37 +54,156 @@ inline void free_cpu_set(cpu_set_t* s) {
 
 #endif
 
+// calls f on each logical CPU in turn, passing the OS's number for it. CPUs that the thread can't be pinned to,
+// because they're offline or outside the process's affinity, are skipped, as f would be running elsewhere
 template<typename Fn>
 void run_on_every_core(Fn&& f) {
 	std::thread bouncer = std::thread([&]() {
 #ifdef _WIN32
+		// Windows numbers processors within groups, so the OS index counts across them
+		std::uint32_t os_index = 0_u32;
 		const WORD total_processor_groups = ::GetMaximumProcessorGroupCount();
 		for(WORD group_id = 0; group_id < total_processor_groups; ++group_id) {
 			const DWORD processors_in_group = ::GetMaximumProcessorCount(group_id);
 			for(DWORD proc = 0; proc < processors_in_group; ++proc) {
 				const GROUP_AFFINITY aff = { 1_u64 << proc, group_id };
-				::SetThreadGroupAffinity(::GetCurrentThread(), &aff, nullptr);
-				f();
+				if(::SetThreadGroupAffinity(::GetCurrentThread(), &aff, nullptr)) {
+					f(os_index);
+				}
+				++os_index;
 			}
 		}
 #else
-		long int total_cores = sysconf(_SC_NPROCESSORS_CONF);
+		// the CPUs the process may run on, which needn't be numbered contiguously, nor start at 0
 		std::size_t cpu_size = 0;
+		cpu_set_t* allowed = alloc_cpu_set(&cpu_size);
 		cpu_set_t* cpus = alloc_cpu_set(&cpu_size);
+		if(sched_getaffinity(0, cpu_size, allowed) != 0) {
+			CPU_ZERO_S(cpu_size, allowed);
+		}
 
-		CPU_ZERO_S(cpu_size, cpus);
-		for(long int i = 0; i < total_cores; ++i) {
+		for(std::size_t i = 0; i < cpu_size * 8; ++i) {
+			if(!CPU_ISSET_S(i, cpu_size, allowed)) {
+				continue;
+			}
+			CPU_ZERO_S(cpu_size, cpus);
 			CPU_SET_S(i, cpu_size, cpus);
-			pthread_setaffinity_np(pthread_self(), cpu_size, cpus);
-			f();
-			CPU_CLR_S(i, cpu_size, cpus);
+			// a CPU can go offline between the two calls
+			if(pthread_setaffinity_np(pthread_self(), cpu_size, cpus) != 0 || sched_getcpu() != static_cast<int>(i)) {
+				continue;
+			}
+			f(static_cast<std::uint32_t>(i));
 		}
 		free_cpu_set(cpus);
+		free_cpu_set(allowed);
 #endif
 	});
 	bouncer.join();
 }
 
+// Formats items [0, count) into separate buffers on every hardware thread, or on workers threads, then passes the
+// buffers to emit in order. Items are handled in batches, so that only a batch's worth of output is held at once. The
+// helper threads are started once, and sleep between batches; they're always joined, even if starting them, formatting,
+// or emitting throws.
+template<typename FormatFn, typename EmitFn>
+void format_in_parallel(std::size_t count, FormatFn&& format, EmitFn&& emit, std::size_t workers = std::max(std::thread::hardware_concurrency(), 1u)) {
+	if(count == 0) {
+		return;
+	}
+	workers = std::max(workers, std::size_t{ 1 });
+	const std::size_t batch_size = workers * 16;
+	std::vector<fmt::memory_buffer> buffers(std::min(count, batch_size));
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::size_t generation = 0;
+	std::size_t busy = 0;
+	bool stopping = false;
+	std::size_t base = 0;
+	std::size_t batch = 0;
+	std::atomic<std::size_t> next = 0;
+	std::exception_ptr failure;
+	std::atomic<bool> failed = false;
+	const auto work = [&] () {
+		for(std::size_t i = next++; i < batch && !failed; i = next++) {
+			try {
+				buffers[i].resize(0);
+				format(buffers[i], base + i);
+			} catch(...) {
+				if(!failed.exchange(true)) {
+					failure = std::current_exception();
+				}
+			}
+		}
+	};
+	// each batch bumps the generation, and every helper works on it once before the batch is emitted
+	const auto helper = [&] () {
+		std::size_t seen = 0;
+		for(;;) {
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake.wait(guard, [&] () { return stopping || generation != seen; });
+				if(stopping) {
+					return;
+				}
+				seen = generation;
+			}
+			work();
+			std::lock_guard<std::mutex> guard(lock);
+			if(--busy == 0) {
+				done.notify_one();
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const auto stop = [&] () {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(std::thread& t : threads) {
+			t.join();
+		}
+	};
+	struct join_guard_t
+	{
+		const decltype(stop)& stop_helpers;
+		~join_guard_t() {
+			stop_helpers();
+		}
+	} join_guard = { stop };
+
+	const std::size_t helpers = std::min(workers, buffers.size()) - 1;
+	threads.reserve(helpers);
+	for(std::size_t i = 0; i < helpers; ++i) {
+		threads.emplace_back(helper);
+	}
+	for(; base < count; base += batch_size) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			batch = std::min(batch_size, count - base);
+			next = 0;
+			busy = threads.size();
+			++generation;
+		}
+		wake.notify_all();
+		work();
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			done.wait(guard, [&] () { return busy == 0; });
+		}
+		if(failure) {
+			std::rethrow_exception(failure);
+		}
+		for(std::size_t i = 0; i < batch; ++i) {
+			emit(buffers[i]);
+		}
+	}
+}
+
 #if defined(_MSC_VER)
 inline unsigned char bit_scan_reverse(unsigned long* index, unsigned int mask) noexcept {
 	return _BitScanReverse(index, mask);
@@ -1,8 +1,15 @@
 #include "stdafx.h"
 
 #include "cpuid/cpuid.hpp"
+#include "cpuid/flag-spec.hpp"
+#include "cpuid/expression.hpp"
+#include "cpuid/export.hpp"
+#include "cpuid/placement.hpp"
+#include "cpuid/sink.hpp"
+#include "cpuid/utility.hpp"
 
 #include <filesystem>
+#include <sstream>
 
 #if defined(_MSC_VER)
 #pragma warning(push)
@@ -137,6 +144,8 @@ std::string file_spec_param_printer(testing::TestParamInfo<file_parse_data> data
 			return "aida64";
 		case cpuid::file_format::cpuinfo:
 			return "cpuinfo";
+		case cpuid::file_format::folded:
+			return "folded";
 		default:
 			UNREACHABLE();
 		}
@@ -161,6 +170,954 @@ TEST_P(CpuidFlagCrackingTest, ParserTest) {
 	EXPECT_EQ(data.second, spec);
 }
 
+TEST(CpuidFlagLiteralTest, LiteralTest) {
+	constexpr cpuid::constant_flag_spec_t avx2 = "CPUID.(EAX=07H, ECX=0H):EBX.AVX2[bit 5]"_cpuid;
+	static_assert(avx2.selector_eax == 0x0000'0007_u32 && avx2.flag_register == cpuid::ebx && avx2.mask() == 0x0000'0020_u32);
+	static_assert("CPUID.80000008H:EAX[bits 7-0]"_cpuid.mask() == 0x0000'00ff_u32);
+	static_assert(!"CPUID.1:ECX.OSXSAVE"_cpuid.is_resolved());
+	static_assert(!cpuid::try_parse_flag_spec("CPUID.1:ESP"));
+
+	const cpuid::flag_spec_t spec = avx2;
+	EXPECT_EQ(cpuid::parse_flag_spec("CPUID.(EAX=07H, ECX=0H):EBX.AVX2[bit 5]"), spec);
+	EXPECT_EQ(avx2.location(), cpuid::resolve_flag_spec(spec));
+	EXPECT_EQ(0x0010'0000_u32, cpuid::resolve_flag_spec("CPUID.01H:ECX.SSE4_2"_cpuid).mask);
+}
+
+TEST(CpuidFlagLiteralTest, BatchTest) {
+	cpuid::cpu_t cpu = {};
+	cpu.leaves[cpuid::leaf_type::version_info][cpuid::subleaf_type::main] = { 0x0000'0000_u32, 0x0010'0000_u32, 0x0010'0000_u32, 0x0000'0000_u32 };
+	const std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = { { 0_u32, cpu } };
+	const std::vector<cpuid::flag_spec_t> specs = { "CPUID.01H:ECX.SSE4.2"_cpuid, "CPUID.07H.0H:EBX.AVX2"_cpuid, "CPUID.1.EBX[23:16]"_cpuid };
+	const cpuid::flag_values_t values = cpuid::evaluate_flag_specs(logical_cpus, { 0_u32 }, specs);
+	ASSERT_EQ(1, values.size());
+	EXPECT_EQ(std::optional<std::uint32_t>(1_u32), values[0][0]);
+	EXPECT_EQ(std::nullopt, values[0][1]);
+	EXPECT_EQ(std::optional<std::uint32_t>(0x10_u32), values[0][2]);
+}
+
+TEST(CpuidFlagLiteralTest, TableTest) {
+	cpuid::cpu_t cpu = {};
+	cpu.leaves[cpuid::leaf_type::version_info][cpuid::subleaf_type::main] = { 0x0000'0000_u32, 0x0010'0000_u32, 0x0010'0000_u32, 0x0000'0000_u32 };
+	const std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = { { 0x02_u32, cpu }, { 0x1'0002_u32, cpu } };
+	const std::vector<cpuid::flag_spec_t> specs = { "CPUID.01H:ECX.SSE4.2"_cpuid, "CPUID.1.EBX[23:16]"_cpuid };
+
+	fmt::memory_buffer small;
+	cpuid::print_flag_values(small, logical_cpus, { 0x02_u32 }, specs, cpuid::value_format::table);
+	EXPECT_EQ("cpu   CPUID.(EAX=01H, ECX=00H):ECX.SSE4.2  CPUID.(EAX=01H, ECX=00H):EBX[23:16]\n"
+	          "0x02  0x00000001                           0x00000010\n", to_string(small));
+
+	// x2APIC IDs widen the first column
+	fmt::memory_buffer wide;
+	cpuid::print_flag_values(wide, logical_cpus, { 0x02_u32, 0x1'0002_u32 }, specs, cpuid::value_format::table);
+	EXPECT_EQ(0, to_string(wide).find("cpu      CPUID"));
+	EXPECT_NE(std::string::npos, to_string(wide).find("\n0x02     0x00000001"));
+	EXPECT_NE(std::string::npos, to_string(wide).find("\n0x10002  0x00000001"));
+}
+
+TEST(CpuidExpressionTest, EvaluationTest) {
+	cpuid::cpu_t with_avx2 = {};
+	with_avx2.vendor = cpuid::intel;
+	with_avx2.leaves[cpuid::leaf_type::extended_features][cpuid::subleaf_type::main] = { 0x0000'0000_u32, 0x0000'0020_u32, 0x0000'0000_u32, 0x0000'0000_u32 };
+	cpuid::cpu_t without_avx2 = with_avx2;
+	without_avx2.leaves[cpuid::leaf_type::extended_features][cpuid::subleaf_type::main][cpuid::ebx] = 0_u32;
+
+	cpuid::system_t machine = {};
+	machine.all_caches.push_back({ 3_u32, 3_u32, 16_u32, 32'768_u32, 64_u32, 1_u32, 32_u32 * 1'024_u32 * 1'024_u32 });
+
+	std::vector<cpuid::expression_lane_t> lanes;
+	for(std::size_t i = 0; i < 100; ++i) {
+		lanes.push_back({ i % 3 == 0 ? &without_avx2 : &with_avx2, &machine });
+	}
+	const std::vector<bool> results = cpuid::evaluate_expression(cpuid::compile_expression("AVX2 && (AVX512F || !VAES) && L3 >= 32M"), lanes);
+	ASSERT_EQ(lanes.size(), results.size());
+	for(std::size_t i = 0; i < lanes.size(); ++i) {
+		EXPECT_EQ(i % 3 != 0, results[i]);
+	}
+
+	EXPECT_EQ(std::vector<bool>(100, true ), cpuid::evaluate_expression(cpuid::compile_expression("!(CPUID.07H.0H:EBX[5] > 1) && L2 == 0 && 0x20 == 32"), lanes));
+	EXPECT_EQ(std::vector<bool>(100, false), cpuid::evaluate_expression(cpuid::compile_expression("L3 > 32M || L1D"), lanes));
+	EXPECT_THROW(cpuid::compile_expression("AVX2 &&"), std::runtime_error);
+	EXPECT_THROW(cpuid::compile_expression("NOT_A_FEATURE"), std::runtime_error);
+	EXPECT_THROW(cpuid::compile_expression("(AVX2 && SSE) >= 2"), std::runtime_error);
+	EXPECT_EQ(std::vector<bool>(100, true ), cpuid::evaluate_expression(cpuid::compile_expression("(L3) >= 32M && (L2 == 0)"), lanes));
+	EXPECT_THROW(cpuid::compile_expression("L3 >= 99999999999999G"), std::runtime_error);
+	EXPECT_THROW(cpuid::compile_expression("L3 >= 17179869184G"), std::runtime_error);
+}
+
+// numbers the CPUs as Linux does, the first thread of every core and then the second, taking bit 0 of the APIC ID
+// to be the thread
+void number_like_linux(std::map<std::uint32_t, cpuid::cpu_t>& logical_cpus) {
+	std::uint32_t first_threads = 0_u32;
+	for(const auto& c : logical_cpus) {
+		first_threads += (c.first & 1_u32) == 0_u32 ? 1_u32 : 0_u32;
+	}
+	std::uint32_t next_first = 0_u32;
+	std::uint32_t next_second = first_threads;
+	for(auto& c : logical_cpus) {
+		c.second.os_index = (c.first & 1_u32) == 0_u32 ? next_first++ : next_second++;
+	}
+}
+
+// a Threadripper 1920X, whose sysfs is in data/sysfs/threadripper-1920x
+const char threadripper_dump[] = "../../../libcpuid/tests/data/dumps/aida64/amd/AuthenticAMD0800F11_K17_Zen_CPUID16_TR.txt";
+
+// builds the topology of an AIDA64 dump with its CPUs numbered as Linux does, so that sysfs can be matched to it
+cpuid::system_t build_numbered_topology(const char* dump) {
+	std::ifstream fin(dump);
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	number_like_linux(logical_cpus);
+	return cpuid::build_topology(logical_cpus);
+}
+
+TEST(CpuidUtilityTest, FormatInParallelTest) {
+	// items of different lengths, so that the helpers finish out of order
+	const auto format = [] (fmt::memory_buffer& buffer, std::size_t i) {
+		format_to(buffer, "{:d}:", i);
+		for(std::size_t j = 0; j < i % 97; ++j) {
+			format_to(buffer, "{:02x}", (i * 31 + j) & 0xff);
+		}
+		format_to(buffer, "\n");
+	};
+	const std::size_t count = 5'000;
+	fmt::memory_buffer sequential;
+	for(std::size_t i = 0; i < count; ++i) {
+		format(sequential, i);
+	}
+
+	// the worker counts are given, so that the helpers run even on a single core
+	for(const std::size_t workers : { std::size_t{ 1 }, std::size_t{ 4 }, std::size_t{ 7 } }) {
+		fmt::memory_buffer parallel;
+		std::size_t emitted = 0;
+		format_in_parallel(count, format, [&] (const fmt::memory_buffer& buffer) {
+			parallel.append(buffer.data(), buffer.data() + buffer.size());
+			++emitted;
+		}, workers);
+		EXPECT_EQ(count, emitted);
+		EXPECT_EQ(to_string(sequential), to_string(parallel));
+	}
+
+	std::size_t calls = 0;
+	format_in_parallel(0, [&] (fmt::memory_buffer&, std::size_t) { ++calls; }, [&] (const fmt::memory_buffer&) { ++calls; }, 4);
+	EXPECT_EQ(0, calls);
+
+	// a failure in any item stops the formatting, and nothing from its batch is emitted; the helpers are joined either way
+	std::size_t emitted = 0;
+	EXPECT_THROW(format_in_parallel(count, [&] (fmt::memory_buffer& buffer, std::size_t i) {
+		if(i == 1'000) {
+			throw std::runtime_error("formatting failed");
+		}
+		format(buffer, i);
+	}, [&] (const fmt::memory_buffer&) { ++emitted; }, 4), std::runtime_error);
+	EXPECT_EQ(1'000 / 64 * 64, emitted);
+
+	EXPECT_THROW(format_in_parallel(count, format, [] (const fmt::memory_buffer&) {
+		throw std::runtime_error("emitting failed");
+	}, 4), std::runtime_error);
+}
+
+TEST(CpuidFoldedDumpTest, RoundTripTest) {
+	std::ifstream fin("../../../libcpuid/tests/data/dumps/aida64/intel/GenuineIntel0050654_SkylakeXeon_CPUID6.txt");
+	const std::map<std::uint32_t, cpuid::cpu_t> original = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	ASSERT_EQ(112, original.size());
+
+	fmt::memory_buffer native;
+	fmt::memory_buffer folded;
+	cpuid::print_dump(native, original, cpuid::file_format::native);
+	cpuid::print_dump(folded, original, cpuid::file_format::folded);
+	EXPECT_LT(folded.size() * 10, native.size());
+
+	std::istringstream folded_in(to_string(folded));
+	const std::map<std::uint32_t, cpuid::cpu_t> round_tripped = cpuid::enumerate_file(folded_in, cpuid::file_format::folded);
+	EXPECT_EQ(original, round_tripped);
+}
+
+TEST(CpuidFoldedDumpTest, RangeLimitTest) {
+	// four billion CPUs
+	std::istringstream corrupt("0x00000000-0xffffffff 0x00000000 0x00000000: 0x00000016 0x756e6547 0x6c65746e 0x49656e69\n");
+	EXPECT_THROW(cpuid::enumerate_file(corrupt, cpuid::file_format::folded), std::runtime_error);
+}
+
+TEST(CpuidFoldedDumpTest, OsIndexTest) {
+	std::ifstream fin(threadripper_dump);
+	std::map<std::uint32_t, cpuid::cpu_t> original = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	number_like_linux(original);
+	original.rbegin()->second.os_index = cpuid::unknown_id;
+
+	fmt::memory_buffer folded;
+	cpuid::print_dump(folded, original, cpuid::file_format::folded);
+	EXPECT_NE(std::string::npos, to_string(folded).find("#os 0x00000003 13\n"));
+	EXPECT_EQ(std::string::npos, to_string(folded).find("#os 0x0000001d "));
+
+	std::istringstream folded_in(to_string(folded));
+	const std::map<std::uint32_t, cpuid::cpu_t> round_tripped = cpuid::enumerate_file(folded_in, cpuid::file_format::folded);
+	EXPECT_EQ(original, round_tripped);
+}
+
+TEST(CpuidTopologyTest, CpuListTest) {
+	EXPECT_EQ(""                , cpuid::to_cpulist({}));
+	EXPECT_EQ("5"               , cpuid::to_cpulist({ 5_u32 }));
+	EXPECT_EQ("0-3"             , cpuid::to_cpulist({ 3_u32, 1_u32, 2_u32, 0_u32 }));
+	EXPECT_EQ("0-1,4,6-7,224-251", cpuid::to_cpulist([] () {
+		std::vector<std::uint32_t> ids = { 0_u32, 1_u32, 4_u32, 6_u32, 7_u32 };
+		for(std::uint32_t i = 224_u32; i <= 251_u32; ++i) {
+			ids.push_back(i);
+		}
+		return ids;
+	}()));
+}
+
+TEST(CpuidTopologyTest, DieTest) {
+	// one package of two dies, each of two cores with two threads, as leaf 0x1f reports it
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus;
+	for(std::uint32_t id = 0_u32; id < 8_u32; ++id) {
+		cpuid::cpu_t& cpu = logical_cpus[id];
+		cpu.apic_id = id;
+		cpu.vendor = cpuid::intel;
+		auto& topology = cpu.leaves[cpuid::leaf_type::extended_topology_v2];
+		topology[cpuid::subleaf_type{ 0 }] = { 1_u32, 2_u32, 0x0000'0100_u32, id };
+		topology[cpuid::subleaf_type{ 1 }] = { 2_u32, 4_u32, 0x0000'0201_u32, id };
+		topology[cpuid::subleaf_type{ 2 }] = { 3_u32, 8_u32, 0x0000'0502_u32, id };
+		topology[cpuid::subleaf_type{ 3 }] = { 0_u32, 0_u32, 0x0000'0003_u32, id };
+	}
+
+	const cpuid::system_t machine = cpuid::build_topology(logical_cpus);
+	EXPECT_EQ(3_u32, machine.die_mask_width);
+	EXPECT_EQ(1, machine.valid_levels.count(cpuid::level_type::die));
+	ASSERT_EQ(1, machine.packages.size());
+	const cpuid::package_t& package = machine.packages.at(0_u32);
+	EXPECT_EQ(4, package.physical_cores.size());
+	ASSERT_EQ(2, package.dies.size());
+	const auto& second_die_cores = package.dies.at(1_u32).tiles.at(0_u32).modules.at(0_u32).physical_cores;
+	ASSERT_EQ(2, second_die_cores.size());
+	EXPECT_EQ(2_u32, second_die_cores.begin()->first);
+	EXPECT_EQ(1_u32, second_die_cores.begin()->second.logical_cores.at(1_u32).die_id);
+	EXPECT_EQ(5_u32, second_die_cores.begin()->second.logical_cores.at(1_u32).full_apic_id);
+
+	fmt::memory_buffer out;
+	cpuid::print_topology(out, machine, cpuid::topology_style::ranges, true);
+	EXPECT_EQ("\n"
+	          "physical 0:0-1 \u00d7 2 threads apic ids: 0-3\n"
+	          "die      0:0 apic ids: 0-3\n"
+	          "physical 0:2-3 \u00d7 2 threads apic ids: 4-7\n"
+	          "die      0:1 apic ids: 4-7\n"
+	          "package  0 apic ids: 0-7\n", to_string(out));
+}
+
+TEST(CpuidTopologyTest, AmdCcxTest) {
+	// a 12-core Threadripper: two dies, each of two CCXs with three of their four cores enabled
+	std::ifstream fin(threadripper_dump);
+	const std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	ASSERT_EQ(24, logical_cpus.size());
+
+	const cpuid::system_t machine = cpuid::build_topology(logical_cpus);
+	const auto l3 = std::find_if(machine.all_caches.begin(), machine.all_caches.end(), [] (const cpuid::cache_t& cache) {
+		return cache.level == 3_u32;
+	});
+	ASSERT_NE(machine.all_caches.end(), l3);
+	ASSERT_EQ(4, l3->instances.size());
+	const std::vector<std::uint32_t> third_ccx = { 16_u32, 17_u32, 18_u32, 19_u32, 20_u32, 21_u32 };
+	EXPECT_EQ(third_ccx, std::next(l3->instances.begin(), 2)->second.sharing_ids);
+
+	ASSERT_EQ(1, machine.packages.size());
+	const cpuid::package_t& package = machine.packages.at(0_u32);
+	ASSERT_EQ(2, package.dies.size());
+	EXPECT_EQ(2, package.dies.at(1_u32).tiles.size());
+	EXPECT_EQ(3, package.dies.at(1_u32).tiles.at(1_u32).modules.at(0_u32).physical_cores.size());
+	EXPECT_EQ(1_u32, machine.all_cores.back().die_id);
+}
+
+TEST(CpuidTopologyTest, AmdPartialCcxTest) {
+	// a 2+2 Ryzen 3: each CCX has two of its four cores enabled, so its L3 is shared by only four threads,
+	// but the second CCX still starts at apic id 8
+	std::ifstream fin("../../../libcpuid/tests/data/dumps/aida64/amd/AuthenticAMD0800F11_K17_Zen3_CPUID.txt");
+	const cpuid::system_t machine = cpuid::build_topology(cpuid::enumerate_file(fin, cpuid::file_format::aida64));
+	ASSERT_EQ(8, machine.all_cores.size());
+
+	const auto l3 = std::find_if(machine.all_caches.begin(), machine.all_caches.end(), [] (const cpuid::cache_t& cache) {
+		return cache.level == 3_u32;
+	});
+	ASSERT_NE(machine.all_caches.end(), l3);
+	ASSERT_EQ(2, l3->instances.size());
+	EXPECT_EQ((std::vector<std::uint32_t>{ 8_u32, 9_u32, 10_u32, 11_u32 }), std::next(l3->instances.begin())->second.sharing_ids);
+
+	ASSERT_EQ(1, machine.packages.size());
+	const cpuid::package_t& package = machine.packages.at(0_u32);
+	ASSERT_EQ(1, package.dies.size());
+	const auto& ccxs = package.dies.at(0_u32).tiles;
+	ASSERT_EQ(2, ccxs.size());
+	EXPECT_EQ(0_u32, ccxs.begin()->first);
+	EXPECT_EQ(1_u32, ccxs.rbegin()->first);
+	EXPECT_EQ(2, ccxs.at(1_u32).modules.at(0_u32).physical_cores.size());
+	EXPECT_EQ(1_u32, machine.all_cores.back().tile_id);
+}
+
+TEST(CpuidTopologyTest, HybridTest) {
+	// four Atom cores at even APIC IDs 0-6, then two Core cores with two threads each
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus;
+	for(const std::uint32_t id : { 0_u32, 2_u32, 4_u32, 6_u32, 8_u32, 9_u32, 10_u32, 11_u32 }) {
+		cpuid::cpu_t& cpu = logical_cpus[id];
+		cpu.apic_id = id;
+		cpu.vendor = cpuid::intel;
+		auto& topology = cpu.leaves[cpuid::leaf_type::extended_topology];
+		topology[cpuid::subleaf_type{ 0 }] = { 1_u32, 2_u32, 0x0000'0100_u32, id };
+		topology[cpuid::subleaf_type{ 1 }] = { 4_u32, 8_u32, 0x0000'0201_u32, id };
+		topology[cpuid::subleaf_type{ 2 }] = { 0_u32, 0_u32, 0x0000'0002_u32, id };
+		cpu.leaves[cpuid::leaf_type::hybrid_information][cpuid::subleaf_type::main] = { id < 8_u32 ? 0x2000'0001_u32 : 0x4000'0001_u32, 0_u32, 0_u32, 0_u32 };
+	}
+	// OS CPUs 0-5 are apic ids 0-10 even, and 6 and 7 are 9 and 11
+	number_like_linux(logical_cpus);
+
+	const cpuid::system_t machine = cpuid::build_topology(logical_cpus);
+	EXPECT_EQ(cpuid::hybrid_core_type::atom, machine.all_cores.front().core_type);
+	EXPECT_EQ(cpuid::hybrid_core_type::core, machine.packages.at(0_u32).physical_cores.at(5_u32).logical_cores.at(1_u32).core_type);
+
+	fmt::memory_buffer out;
+	cpuid::print_topology(out, machine, cpuid::topology_style::ranges, true);
+	EXPECT_EQ("\n"
+	          "physical 0:0-3 \u00d7 1 threads (Atom) apic ids: 0,2,4,6 os cpus: 0-3\n"
+	          "physical 0:4-5 \u00d7 2 threads (Core) apic ids: 8-11 os cpus: 4-7\n"
+	          "package  0 apic ids: 0,2,4,6,8-11 os cpus: 0-7\n", to_string(out));
+
+	using placement_t = std::vector<std::vector<std::uint32_t>>;
+	EXPECT_EQ((placement_t{ { 4_u32 }, { 5_u32 }, { 0_u32 } }), cpuid::place_workers(machine, 3, cpuid::placement_policy::physical));
+	EXPECT_EQ((placement_t{ { 0_u32 }, { 1_u32 } }), cpuid::place_workers(machine, 2, cpuid::placement_policy::compact, 1, cpuid::hybrid_core_type::atom));
+	EXPECT_THROW(cpuid::place_workers(machine, 3, cpuid::placement_policy::physical, 1, cpuid::hybrid_core_type::core), std::runtime_error);
+
+	fmt::memory_buffer taskset;
+	cpuid::print_placement(taskset, machine, cpuid::placement_export::taskset, cpuid::placement_domain::package, false, cpuid::hybrid_core_type::core);
+	EXPECT_EQ("# package-0\ntaskset -c 4-7\n", to_string(taskset));
+}
+
+TEST(CpuidTopologyTest, NumaTest) {
+	cpuid::system_t machine = build_numbered_topology(threadripper_dump);
+	cpuid::add_numa_nodes(machine, "../../../libcpuid/tests/data/sysfs/threadripper-1920x");
+	EXPECT_EQ(1, machine.valid_levels.count(cpuid::level_type::node));
+	ASSERT_EQ(2, machine.node_distances.size());
+	EXPECT_EQ((std::vector<std::uint32_t>{ 16_u32, 10_u32 }), machine.node_distances.at(1_u32));
+	const cpuid::package_t& package = machine.packages.at(0_u32);
+	ASSERT_EQ(2, package.nodes.size());
+	EXPECT_EQ(6, package.nodes.at(1_u32).physical_cores.size());
+	EXPECT_EQ(1_u32, package.physical_cores.at(8_u32).logical_cores.at(1_u32).node_id);
+	EXPECT_EQ(1_u32, machine.all_cores.back().node_id);
+
+	fmt::memory_buffer out;
+	cpuid::print_topology(out, machine, cpuid::topology_style::ranges, true);
+	const std::string text = to_string(out);
+	EXPECT_NE(std::string::npos, text.find("node     0 apic ids: 0-5,8-13 os cpus: 0-5,12-17 distances: 10 16\n"
+	                                       "node     1 apic ids: 16-21,24-29 os cpus: 6-11,18-23 distances: 16 10\n"));
+
+	EXPECT_EQ((std::vector<std::uint32_t>{ 0_u32, 1_u32, 2_u32, 12_u32 }), cpuid::from_cpulist("0-2,12\n"));
+	EXPECT_TRUE(cpuid::from_cpulist("").empty());
+	EXPECT_THROW(cpuid::from_cpulist("3-1"), std::runtime_error);
+}
+
+TEST(CpuidTopologyTest, UnknownNodeTest) {
+	std::ifstream fin(threadripper_dump);
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	EXPECT_EQ(cpuid::unknown_id, cpuid::build_topology(logical_cpus).all_cores.front().node_id);
+
+	// the last CPU's number isn't known
+	number_like_linux(logical_cpus);
+	logical_cpus.rbegin()->second.os_index = cpuid::unknown_id;
+	cpuid::system_t machine = cpuid::build_topology(logical_cpus);
+	cpuid::add_numa_nodes(machine, "../../../libcpuid/tests/data/sysfs/threadripper-1920x");
+	EXPECT_EQ(cpuid::unknown_id, machine.all_cores.back().node_id);
+	const cpuid::package_t& package = machine.packages.at(0_u32);
+	ASSERT_EQ(2, package.nodes.size());
+	EXPECT_EQ(0, package.nodes.at(1_u32).physical_cores.at(14_u32).logical_cores.count(1_u32));
+	EXPECT_EQ(1, package.nodes.at(1_u32).physical_cores.at(14_u32).logical_cores.count(0_u32));
+	EXPECT_TRUE(machine.sub_numa_domains.empty());
+}
+
+TEST(CpuidTopologyTest, OsIndexTest) {
+	std::ifstream fin(threadripper_dump);
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	EXPECT_EQ(cpuid::unknown_id, logical_cpus.begin()->second.os_index);
+	number_like_linux(logical_cpus);
+
+	fmt::memory_buffer out;
+	cpuid::print_dump(out, logical_cpus, cpuid::file_format::native);
+	std::istringstream in(to_string(out));
+	const std::map<std::uint32_t, cpuid::cpu_t> read_back = cpuid::enumerate_file(in, cpuid::file_format::native);
+	EXPECT_EQ(logical_cpus, read_back);
+
+	const cpuid::system_t machine = cpuid::build_topology(read_back);
+	ASSERT_EQ(24, machine.apic_id_by_os_index.size());
+	EXPECT_EQ(1_u32, machine.apic_id_by_os_index[12]);
+	EXPECT_EQ(6_u32, machine.os_index_by_apic_id.at(16_u32));
+	EXPECT_EQ(23_u32, machine.packages.at(0_u32).physical_cores.at(14_u32).logical_cores.at(1_u32).os_index);
+
+	fmt::memory_buffer taskset;
+	cpuid::print_placement(taskset, machine, cpuid::placement_export::taskset, cpuid::placement_domain::l3, false);
+	EXPECT_EQ(0, to_string(taskset).find("# l3-0\ntaskset -c 0-2,12-14\n"));
+
+	fmt::memory_buffer ranges;
+	cpuid::print_topology(ranges, machine, cpuid::topology_style::ranges, false);
+	const std::string text = to_string(ranges);
+	EXPECT_NE(std::string::npos, text.find("logical  0:1:1 apic id: 0x03 os cpu: 13\n"
+	                                       "physical 0:1 apic ids: 2-3 os cpus: 1,13\n"));
+	EXPECT_NE(std::string::npos, text.find("ccx      0:0:0 apic ids: 0-5 os cpus: 0-2,12-14\n"));
+	EXPECT_NE(std::string::npos, text.find("package  0 apic ids: 0-5,8-13,16-21,24-29 os cpus: 0-23\n"));
+}
+
+TEST(CpuidTopologyTest, HwlocTest) {
+	std::ifstream fin(threadripper_dump);
+	cpuid::system_t machine = cpuid::build_topology(cpuid::enumerate_file(fin, cpuid::file_format::aida64));
+
+	const auto count = [] (const std::string& text, const std::string& needle) {
+		std::size_t n = 0;
+		for(std::size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+			++n;
+		}
+		return n;
+	};
+
+	fmt::memory_buffer single;
+	cpuid::print_hwloc_xml(single, machine);
+	const std::string single_text = to_string(single);
+	EXPECT_EQ(0, single_text.find("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!DOCTYPE topology SYSTEM \"hwloc2.dtd\">\n<topology version=\"2.0\">\n"));
+	EXPECT_EQ(1, count(single_text, "type=\"Package\""));
+	EXPECT_EQ(4, count(single_text, "type=\"L3Cache\""));
+	EXPECT_EQ(12, count(single_text, "type=\"L1iCache\""));
+	EXPECT_EQ(12, count(single_text, "type=\"Core\""));
+	EXPECT_EQ(24, count(single_text, "type=\"PU\""));
+	EXPECT_EQ(1, count(single_text, "type=\"NUMANode\" os_index=\"0\" cpuset=\"0x00ffffff\""));
+	EXPECT_NE(std::string::npos, single_text.find("type=\"L3Cache\" cpuset=\"0x00000fc0\""));
+	EXPECT_NE(std::string::npos, single_text.find("cache_size=\"8388608\" depth=\"3\" cache_linesize=\"64\" cache_associativity=\"16\" cache_type=\"0\""));
+	EXPECT_EQ(std::string::npos, single_text.find("<distances2"));
+	// the dump has no OS numbers, so the PUs can't be bound to
+	EXPECT_NE(std::string::npos, single_text.find("\n    <info name=\"CPUIDUnbound\" value=\""));
+
+	cpuid::system_t numbered = build_numbered_topology(threadripper_dump);
+	cpuid::add_numa_nodes(numbered, "../../../libcpuid/tests/data/sysfs/threadripper-1920x");
+
+	fmt::memory_buffer numa;
+	cpuid::print_hwloc_xml(numa, numbered);
+	const std::string numa_text = to_string(numa);
+	EXPECT_EQ(2, count(numa_text, "<object type=\"NUMANode\""));
+	EXPECT_NE(std::string::npos, numa_text.find("<object type=\"NUMANode\" os_index=\"1\" cpuset=\"0x00fc0fc0\" complete_cpuset=\"0x00fc0fc0\" nodeset=\"0x00000002\""));
+	EXPECT_NE(std::string::npos, numa_text.find("type=\"L3Cache\" cpuset=\"0x00007007\""));
+	EXPECT_EQ(std::string::npos, numa_text.find("CPUIDUnbound"));
+	EXPECT_NE(std::string::npos, numa_text.find("  <distances2 type=\"NUMANode\" nbobjs=\"2\" kind=\"5\" indexing=\"os\">\n"
+	                                            "    <indexes length=\"2\">0 1 </indexes>\n"
+	                                            "    <u64values length=\"4\">10 16 16 10 </u64values>\n"
+	                                            "  </distances2>\n"
+	                                            "</topology>\n"));
+}
+
+TEST(CpuidTopologyTest, SysfsCacheTest) {
+	cpuid::system_t machine = build_numbered_topology(threadripper_dump);
+	const std::string sysfs_root = "../../../libcpuid/tests/data/sysfs/threadripper-1920x";
+	EXPECT_TRUE(cpuid::check_sysfs_caches(machine, sysfs_root, false).empty());
+
+	// as a hypervisor might, leave out the instruction cache, and claim that the whole package shares one L3
+	const auto l1i = std::find_if(machine.all_caches.begin(), machine.all_caches.end(), [] (const cpuid::cache_t& cache) { return cache.level == 1_u32 && cache.type == 2_u32; });
+	ASSERT_NE(machine.all_caches.end(), l1i);
+	const std::ptrdiff_t l1i_index = l1i - machine.all_caches.begin();
+	machine.all_caches.erase(l1i);
+	const auto l3 = std::find_if(machine.all_caches.begin(), machine.all_caches.end(), [] (const cpuid::cache_t& cache) { return cache.level == 3_u32; });
+	ASSERT_NE(machine.all_caches.end(), l3);
+	const std::size_t l3_index = static_cast<std::size_t>(l3 - machine.all_caches.begin());
+	l3->sharing_mask = 0xff_u32;
+	l3->instances.clear();
+	for(cpuid::logical_core_t& core : machine.all_cores) {
+		core.non_shared_cache_ids.erase(core.non_shared_cache_ids.begin() + l1i_index);
+		core.non_shared_cache_ids[l3_index] = 0_u32;
+		l3->instances[0_u32].sharing_ids.push_back(core.full_apic_id);
+	}
+
+	const std::vector<cpuid::cache_disagreement_t> disagreements = cpuid::check_sysfs_caches(machine, sysfs_root, true);
+	ASSERT_EQ(2, disagreements.size());
+	EXPECT_EQ(1_u32, disagreements[0].level);
+	EXPECT_EQ(2_u32, disagreements[0].type);
+	EXPECT_EQ("sysfs reports it, but CPUID doesn't", disagreements[0].description);
+	EXPECT_EQ(3_u32, disagreements[1].level);
+	EXPECT_EQ("CPUID has 1 instances, but sysfs has 4, including one shared by apic ids 0-5", disagreements[1].description);
+
+	// preferring sysfs puts back the CCXs and the instruction cache
+	EXPECT_EQ(4, machine.all_caches[l3_index].instances.size());
+	EXPECT_EQ(7_u32, machine.all_caches[l3_index].sharing_mask);
+	EXPECT_EQ(12, machine.all_caches.back().instances.size());
+	EXPECT_EQ(65'536_u32, machine.all_caches.back().total_size);
+	EXPECT_EQ(16_u32, machine.packages.at(0_u32).physical_cores.at(8_u32).logical_cores.at(1_u32).non_shared_cache_ids[l3_index]);
+	EXPECT_TRUE(cpuid::check_sysfs_caches(machine, sysfs_root, false).empty());
+
+	// the nodes are built from the corrected caches, so the Threadripper's CCXs still keep its nodes from being sub-NUMA domains
+	cpuid::add_numa_nodes(machine, sysfs_root);
+	EXPECT_EQ(16_u32, machine.packages.at(0_u32).nodes.at(1_u32).physical_cores.at(8_u32).logical_cores.at(1_u32).non_shared_cache_ids[l3_index]);
+	EXPECT_TRUE(machine.sub_numa_domains.empty());
+}
+
+TEST(CpuidTopologyTest, SubNumaTest) {
+	// two packages of 18 cores, each with one L3, in SNC2 mode
+	cpuid::system_t machine = build_numbered_topology("../../../libcpuid/tests/data/dumps/aida64/intel/GenuineIntel0050654_SkylakeXeon_CPUID5.txt");
+	ASSERT_EQ(2, machine.packages.size());
+	cpuid::add_numa_nodes(machine, "../../../libcpuid/tests/data/sysfs/skylake-xeon-snc2");
+	EXPECT_EQ(1, machine.valid_levels.count(cpuid::level_type::sub_numa));
+	EXPECT_EQ((std::map<std::uint32_t, std::vector<std::uint32_t>>{ { 0_u32, { 0_u32, 1_u32 } }, { 1_u32, { 2_u32, 3_u32 } } }), machine.sub_numa_domains);
+
+	fmt::memory_buffer out;
+	cpuid::print_topology(out, machine, cpuid::topology_style::ranges, true);
+	EXPECT_NE(std::string::npos, to_string(out).find("sub-numa 0:0 apic ids: 0-9,16-23 os cpus: 0-8,36-44\n"
+	                                                 "sub-numa 0:1 apic ids: 32-41,48-55 os cpus: 9-17,45-53\n"
+	                                                 "sub-numa 1:2 apic ids: 64-73,80-87 os cpus: 18-26,54-62\n"
+	                                                 "sub-numa 1:3 apic ids: 96-105,112-119 os cpus: 27-35,63-71\n"
+	                                                 "node     0 apic ids: 0-9,16-23 os cpus: 0-8,36-44 distances: 10 11 21 21\n"));
+
+	// the Threadripper's nodes each have their own L3s, so they aren't sub-NUMA domains
+	cpuid::system_t threadripper = build_numbered_topology(threadripper_dump);
+	cpuid::add_numa_nodes(threadripper, "../../../libcpuid/tests/data/sysfs/threadripper-1920x");
+	EXPECT_EQ(2, threadripper.node_distances.size());
+	EXPECT_TRUE(threadripper.sub_numa_domains.empty());
+	EXPECT_EQ(0, threadripper.valid_levels.count(cpuid::level_type::sub_numa));
+}
+
+TEST(CpuidPlacementTest, PolicyTest) {
+	// four CCXs of three cores each, at apic ids 0, 8, 16, and 24, and OS CPUs 0, 3, 6, and 9
+	std::ifstream fin(threadripper_dump);
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	EXPECT_THROW(cpuid::place_workers(cpuid::build_topology(logical_cpus), 1, cpuid::placement_policy::compact), std::runtime_error);
+	number_like_linux(logical_cpus);
+	const cpuid::system_t machine = cpuid::build_topology(logical_cpus);
+
+	using placement_t = std::vector<std::vector<std::uint32_t>>;
+	EXPECT_EQ((placement_t{ { 0_u32 }, { 12_u32 }, { 1_u32 } }), cpuid::place_workers(machine, 3, cpuid::placement_policy::compact));
+	EXPECT_EQ((placement_t{ { 0_u32 }, { 1_u32 }, { 2_u32 }, { 3_u32 } }), cpuid::place_workers(machine, 4, cpuid::placement_policy::physical));
+	EXPECT_EQ((placement_t{ { 0_u32 }, { 3_u32 }, { 6_u32 }, { 9_u32 }, { 1_u32 } }), cpuid::place_workers(machine, 5, cpuid::placement_policy::scatter));
+	EXPECT_EQ((placement_t{ { 0_u32, 12_u32 }, { 1_u32, 13_u32 }, { 3_u32, 15_u32 } }), cpuid::place_workers(machine, 3, cpuid::placement_policy::l3_helper, 2));
+#if defined(__linux__)
+	const cpu_set_t helper = cpuid::to_cpu_set({ 3_u32, 15_u32 });
+	EXPECT_EQ(2, CPU_COUNT(&helper));
+	EXPECT_TRUE(CPU_ISSET(15, &helper));
+#endif
+
+	EXPECT_EQ(24, cpuid::place_workers(machine, 24, cpuid::placement_policy::scatter).size());
+	EXPECT_THROW(cpuid::place_workers(machine, 13, cpuid::placement_policy::physical), std::runtime_error);
+	EXPECT_THROW(cpuid::place_workers(machine, 9, cpuid::placement_policy::l3_helper, 2), std::runtime_error);
+	EXPECT_THROW(cpuid::place_workers(machine, 4, cpuid::placement_policy::l3_helper, 4), std::runtime_error);
+}
+
+TEST(CpuidPlacementTest, ExportTest) {
+	std::ifstream fin(threadripper_dump);
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	number_like_linux(logical_cpus);
+	const cpuid::system_t machine = cpuid::build_topology(logical_cpus);
+
+	fmt::memory_buffer dpdk;
+	cpuid::print_placement(dpdk, machine, cpuid::placement_export::dpdk, cpuid::placement_domain::l3, true);
+	EXPECT_EQ("# l3-0\n-l 0-2\n-c 0x7\n"
+	          "# l3-1\n-l 3-5\n-c 0x38\n"
+	          "# l3-2\n-l 6-8\n-c 0x1c0\n"
+	          "# l3-3\n-l 9-11\n-c 0xe00\n", to_string(dpdk));
+
+	fmt::memory_buffer omp;
+	cpuid::print_placement(omp, machine, cpuid::placement_export::omp, cpuid::placement_domain::l3, false);
+	EXPECT_EQ(0, to_string(omp).find("# l3-0\nOMP_PLACES=\"{0,12},{1,13},{2,14}\" OMP_PROC_BIND=spread OMP_NUM_THREADS=6\n"));
+
+	fmt::memory_buffer taskset;
+	cpuid::print_placement(taskset, machine, cpuid::placement_export::taskset, cpuid::placement_domain::package, false);
+	EXPECT_EQ("# package-0\ntaskset -c 0-23\n", to_string(taskset));
+}
+
+TEST(CpuidPlacementTest, ApicIdExportTest) {
+	std::ifstream fin(threadripper_dump);
+	const cpuid::system_t machine = cpuid::build_topology(cpuid::enumerate_file(fin, cpuid::file_format::aida64));
+
+	// without the OS numbers, APIC IDs are only exported on request, and under a warning
+	fmt::memory_buffer refused;
+	EXPECT_THROW(cpuid::print_placement(refused, machine, cpuid::placement_export::taskset, cpuid::placement_domain::package, false), std::runtime_error);
+	fmt::memory_buffer taskset;
+	cpuid::print_placement(taskset, machine, cpuid::placement_export::taskset, cpuid::placement_domain::package, false, cpuid::hybrid_core_type::none, true);
+	const std::string text = to_string(taskset);
+	EXPECT_EQ(0, text.find("# warning: "));
+	EXPECT_NE(std::string::npos, text.find("# package-0\ntaskset -c 0-5,8-13,16-21,24-29\n"));
+}
+
+TEST(CpuidPlacementTest, MissingCoreTypeTest) {
+	// a Skylake has no Atom cores, so every domain is empty
+	std::ifstream fin("../../../libcpuid/tests/data/dumps/aida64/intel/GenuineIntel00406E3_Skylake_CPUID.txt");
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	number_like_linux(logical_cpus);
+	const cpuid::system_t machine = cpuid::build_topology(logical_cpus);
+
+	for(const cpuid::placement_domain domain : { cpuid::placement_domain::machine, cpuid::placement_domain::package, cpuid::placement_domain::l3 }) {
+		fmt::memory_buffer dpdk;
+		EXPECT_THROW(cpuid::print_placement(dpdk, machine, cpuid::placement_export::dpdk, domain, false, cpuid::hybrid_core_type::atom), std::runtime_error);
+		EXPECT_EQ(0, dpdk.size());
+	}
+	fmt::memory_buffer taskset;
+	cpuid::print_placement(taskset, machine, cpuid::placement_export::taskset, cpuid::placement_domain::machine, false, cpuid::hybrid_core_type::none);
+	EXPECT_EQ("# machine\ntaskset -c 0-3\n", to_string(taskset));
+}
+
+TEST(CpuidJsonTest, DocumentTest) {
+	cpuid::cpu_t cpu = {};
+	cpu.apic_id = 2_u32;
+	cpu.vendor = cpuid::intel;
+	cpu.leaves[cpuid::leaf_type::extended_features][cpuid::subleaf_type::main] = { 0x0000'0000_u32, 0x0000'0020_u32, 0x0000'0000_u32, 0x0000'0000_u32 };
+	const std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = { { 2_u32, cpu } };
+
+	cpuid::system_t machine = {};
+	machine.vendor = cpuid::intel;
+	machine.all_caches.push_back({ 3_u32, 3_u32, 16_u32, 32'768_u32, 64_u32, 1_u32, 32_u32 * 1'024_u32 * 1'024_u32 });
+	machine.all_caches.back().instances[0_u32].sharing_ids = { 2_u32 };
+	machine.packages[0_u32].physical_cores[1_u32].logical_cores[0_u32].full_apic_id = 2_u32;
+
+	fmt::memory_buffer out;
+	cpuid::print_json(out, logical_cpus, { 2_u32 }, &machine, false, false);
+	const std::string document = to_string(out);
+
+	// the decoded leaf is print_leaf's text, without the colours
+	fmt::memory_buffer text;
+	cpuid::print_leaf(text, cpu, cpuid::leaf_type::extended_features, false, false);
+	const std::string decoded = xp::regex_replace(to_string(text), xp::sregex::compile("\x1b\\[[0-9;]*m"), "");
+	EXPECT_NE(std::string::npos, decoded.find("AVX2 [+]"));
+	EXPECT_EQ(std::string::npos, document.find("\\u001b"));
+
+	std::string escaped;
+	for(const char ch : decoded) {
+		escaped += ch == '\n' ? std::string("\\n")
+		         : ch == '\t' ? std::string("\\t")
+		         : ch == '"'  ? std::string("\\\"")
+		         :              std::string(1, ch);
+	}
+	EXPECT_EQ("{\"cpus\":[\n"
+	          "{\"apic_id\":2,\"vendor\":\"Intel\",\"family\":0,\"model\":0,\"stepping\":0,\"leaves\":[{\"leaf\":7,\"subleaf\":0,\"eax\":0,\"ebx\":32,\"ecx\":0,\"edx\":0,\"features\":[\"AVX2\"]}],"
+	          "\"decoded\":[{\"leaf\":7,\"text\":\"" + escaped + "\"}]}],\n"
+	          "\"topology\":{\"vendor\":\"Intel\",\"caches\":[{\"level\":3,\"type\":\"unified\",\"total_size\":33554432,\"line_size\":64,\"ways\":16,\"sets\":32768,\"line_partitions\":1,"
+	          "\"fully_associative\":false,\"self_initializing\":false,\"inclusive\":false,\"complex_addressed\":false,\"instances\":[[2]]}],"
+	          "\"packages\":[{\"id\":0,\"cores\":[{\"id\":1,\"threads\":[{\"id\":0,\"apic_id\":2}]}]}]}}\n", document);
+}
+
+TEST(CpuidSinkTest, ChunkTest) {
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "cpuid-sink-test";
+	const auto read_back = [&path] () {
+		std::ifstream written(path);
+		return std::string{ std::istreambuf_iterator<char>(written), std::istreambuf_iterator<char>() };
+	};
+
+	// lines that don't divide the chunk evenly, so that the writes straddle chunk boundaries
+	std::string expected;
+	{
+		cpuid::output_sink_t sink(path.string(), 1'000);
+		for(std::size_t i = 0; i < 2'000; ++i) {
+			const std::string line = fmt::format("line {:d} {:s}\n", i, std::string(i % 37, 'x'));
+			expected += line;
+			format_to(sink.buffer(), "{:s}", line);
+			sink.commit();
+			EXPECT_GT(1'000 + line.size(), sink.buffer().size());
+		}
+		sink.flush();
+		EXPECT_EQ(0, sink.buffer().size());
+	}
+	EXPECT_EQ(expected, read_back());
+
+	// the destructor writes whatever wasn't flushed, and a new sink truncates the file
+	{
+		cpuid::output_sink_t sink(path.string());
+		format_to(sink.buffer(), "short\n");
+		sink.commit();
+	}
+	EXPECT_EQ("short\n", read_back());
+	std::filesystem::remove(path);
+}
+
+// exports one host's table to a temporary file, and reads it back
+std::string export_to_file(cpuid::export_table table, cpuid::table_format format, const std::string& host, const std::map<std::uint32_t, cpuid::cpu_t>& logical_cpus) {
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "cpuid-export-test";
+	{
+		cpuid::output_sink_t sink(path.string());
+		cpuid::table_exporter_t exporter(sink, table, format);
+		exporter.add_host(host, logical_cpus);
+		exporter.finish();
+		sink.flush();
+	}
+	std::ifstream exported(path, std::ios::binary);
+	const std::string contents{ std::istreambuf_iterator<char>(exported), std::istreambuf_iterator<char>() };
+	exported.close();
+	std::filesystem::remove(path);
+	return contents;
+}
+
+std::uint32_t read_u32(const std::string& data, std::size_t offset) {
+	std::uint32_t value = 0_u32;
+	for(std::size_t i = 0; i < 4; ++i) {
+		value |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[offset + i])) << (8 * i);
+	}
+	return value;
+}
+
+TEST(CpuidExportTest, LeavesTest) {
+	cpuid::cpu_t cpu = {};
+	cpu.leaves[cpuid::leaf_type::basic_info][cpuid::subleaf_type::main] = { 0x0000'000d_u32, 0x6874'7541_u32, 0x444d'4163_u32, 0x6974'6e65_u32 };
+	cpu.leaves[cpuid::leaf_type::extended_features][cpuid::subleaf_type::main] = { 0x0000'0001_u32, 0x0000'0020_u32, 0x0000'0000_u32, 0x0000'0000_u32 };
+	cpu.leaves[cpuid::leaf_type::extended_features][cpuid::subleaf_type{ 1_u32 }] = { 0x0000'0000_u32, 0x0000'0000_u32, 0x0000'0000_u32, 0x0000'0010_u32 };
+	cpuid::cpu_t other = cpu;
+	other.leaves.erase(cpuid::leaf_type::extended_features);
+
+	// a row for every CPU, leaf, and subleaf, in that order
+	EXPECT_EQ("\"host\",\"apic_id\",\"leaf\",\"subleaf\",\"eax\",\"ebx\",\"ecx\",\"edx\"\n"
+	          "\"a \"\"b\"\"\",0,0,0,13,1752462657,1145913699,1769238117\n"
+	          "\"a \"\"b\"\"\",0,7,0,1,32,0,0\n"
+	          "\"a \"\"b\"\"\",0,7,1,0,0,0,16\n"
+	          "\"a \"\"b\"\"\",2,0,0,13,1752462657,1145913699,1769238117\n",
+	          export_to_file(cpuid::export_table::leaves, cpuid::table_format::csv, "a \"b\"", { { 0_u32, cpu }, { 2_u32, other } }));
+}
+
+TEST(CpuidExportTest, FeaturesTest) {
+	std::ifstream fin(threadripper_dump);
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	// AVX2 only on the first and tenth CPUs, so that its bits straddle a byte
+	std::size_t row = 0;
+	for(auto& c : logical_cpus) {
+		if(row != 0 && row != 9) {
+			c.second.leaves.at(cpuid::leaf_type::extended_features).at(cpuid::subleaf_type::main)[cpuid::ebx] &= ~0x0000'0020_u32;
+		}
+		++row;
+	}
+
+	const std::string csv = export_to_file(cpuid::export_table::features, cpuid::table_format::csv, "tr", logical_cpus);
+	std::vector<std::vector<std::string>> cells;
+	std::istringstream lines(csv);
+	for(std::string line; std::getline(lines, line); ) {
+		std::vector<std::string> fields;
+		boost::algorithm::split(fields, line, [] (char c) { return c == ','; });
+		cells.push_back(fields);
+	}
+	ASSERT_EQ(25, cells.size());
+	EXPECT_EQ("\"host\"", cells[0][0]);
+	EXPECT_EQ("\"apic_id\"", cells[0][1]);
+	const auto column_of = [&cells] (const std::string& name) {
+		return static_cast<std::size_t>(std::find(cells[0].begin(), cells[0].end(), "\"" + name + "\"") - cells[0].begin());
+	};
+	const std::size_t avx2 = column_of("AVX2");
+	const std::size_t avx512f = column_of("AVX512F");
+	ASSERT_LT(avx2, cells[0].size());
+	ASSERT_LT(avx512f, cells[0].size());
+	// each mnemonic gets one column, however many vendors or leaves define it
+	EXPECT_EQ(std::set<std::string>(cells[0].begin(), cells[0].end()).size(), cells[0].size());
+	for(std::size_t i = 1; i < cells.size(); ++i) {
+		ASSERT_EQ(cells[0].size(), cells[i].size());
+		EXPECT_EQ("\"tr\"", cells[i][0]);
+		EXPECT_EQ(i == 1 || i == 10 ? "1" : "0", cells[i][avx2]);
+		EXPECT_EQ("0", cells[i][avx512f]);
+	}
+	EXPECT_EQ("11", cells[10][1]);
+
+	// the batch's body has the host's offsets and values, the apic ids, then three bytes for each boolean column,
+	// every buffer padded to 8 bytes, and bits packed least significant first
+	const std::string arrow = export_to_file(cpuid::export_table::features, cpuid::table_format::arrow, "tr", logical_cpus);
+	const std::size_t batch = 8 + read_u32(arrow, 4);
+	const std::size_t body = batch + 8 + read_u32(arrow, batch + 4);
+	const auto bits_of = [&] (std::size_t column) {
+		const std::size_t offset = body + 104 + 48 + 96 + (column - 2) * 8;
+		return std::vector<std::uint8_t>(arrow.begin() + static_cast<std::ptrdiff_t>(offset), arrow.begin() + static_cast<std::ptrdiff_t>(offset + 3));
+	};
+	EXPECT_EQ((std::vector<std::uint8_t>{ 0x01_u8, 0x02_u8, 0x00_u8 }), bits_of(avx2));
+	EXPECT_EQ((std::vector<std::uint8_t>{ 0x00_u8, 0x00_u8, 0x00_u8 }), bits_of(avx512f));
+	EXPECT_EQ(std::string(5, '\0'), arrow.substr(body + 104 + 48 + 96 + (avx2 - 2) * 8 + 3, 5));
+}
+
+TEST(CpuidExportTest, MachinesTest) {
+	std::ifstream fin(threadripper_dump);
+	const std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+
+	// the L2 and L3 are unified caches
+	EXPECT_EQ("\"host\",\"vendor\",\"logical_cpus\",\"physical_cores\",\"packages\",\"l1d_size\",\"l1i_size\",\"l2_size\",\"l3_size\",\"l2_instances\",\"l3_instances\"\n"
+	          "\"tr\",\"AMD\",24,12,1,32768,65536,524288,8388608,12,4\n", export_to_file(cpuid::export_table::machines, cpuid::table_format::csv, "tr", logical_cpus));
+
+	// the schema message, one record batch, and the end of stream marker, each message 8-byte aligned
+	const std::string arrow = export_to_file(cpuid::export_table::machines, cpuid::table_format::arrow, "tr", logical_cpus);
+	ASSERT_EQ(0, arrow.size() % 8);
+	ASSERT_LE(16, arrow.size());
+	EXPECT_EQ(0xffff'ffff_u32, read_u32(arrow, 0));
+	EXPECT_EQ(0, read_u32(arrow, 4) % 8);
+	EXPECT_NE(std::string::npos, arrow.find("l3_instances"));
+	EXPECT_EQ(0xffff'ffff_u32, read_u32(arrow, arrow.size() - 8));
+	EXPECT_EQ(0_u32, read_u32(arrow, arrow.size() - 4));
+	const std::size_t batch = 8 + read_u32(arrow, 4);
+	EXPECT_EQ(0xffff'ffff_u32, read_u32(arrow, batch));
+	EXPECT_EQ(0, read_u32(arrow, batch + 4) % 8);
+}
+
+TEST(CpuidDiffTest, DumpDiffTest) {
+	std::ifstream fin("../../../libcpuid/tests/data/dumps/aida64/intel/GenuineIntel0050654_SkylakeXeon_CPUID6.txt");
+	const std::map<std::uint32_t, cpuid::cpu_t> before = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	ASSERT_EQ(112, before.size());
+
+	const cpuid::dump_diff_t unchanged = cpuid::diff_dumps(before, before);
+	EXPECT_TRUE(unchanged.added_cpus.empty());
+	EXPECT_TRUE(unchanged.removed_cpus.empty());
+	EXPECT_TRUE(unchanged.changed_cpus.empty());
+
+	// mask off AVX512F everywhere, as a hypervisor might, and lose the last CPU
+	std::map<std::uint32_t, cpuid::cpu_t> after = before;
+	for(auto& c : after) {
+		c.second.leaves.at(cpuid::leaf_type::extended_features).at(cpuid::subleaf_type::main)[cpuid::ebx] &= ~0x0001'0000_u32;
+	}
+	const std::uint32_t last = after.rbegin()->first;
+	after.erase(last);
+
+	const cpuid::dump_diff_t diff = cpuid::diff_dumps(before, after);
+	EXPECT_TRUE(diff.added_cpus.empty());
+	EXPECT_EQ(std::vector<std::uint32_t>{ last }, diff.removed_cpus);
+	ASSERT_EQ(111, diff.changed_cpus.size());
+	ASSERT_EQ(1, diff.changed_cpus.front().changed.size());
+	const cpuid::register_change_t& change = diff.changed_cpus.front().changed.front();
+	EXPECT_EQ(cpuid::leaf_type::extended_features, change.leaf);
+	EXPECT_EQ(cpuid::ebx, change.reg);
+	EXPECT_EQ(0x0001'0000_u32, change.before ^ change.after);
+
+	fmt::memory_buffer out;
+	cpuid::print_dump_diff(out, before, after);
+	const std::string text = to_string(out);
+	EXPECT_NE(std::string::npos, text.find(fmt::format("removed apic ids {:d}\n", last)));
+	EXPECT_NE(std::string::npos, text.find(" -AVX512F\n"));
+	EXPECT_NE(std::string::npos, text.find("logical cores: 112 -> 111\n"));
+}
+
+TEST(CpuidCpuinfoTest, BrandTest) {
+	const auto count = [] (const std::string& text, const std::string& needle) {
+		std::size_t n = 0;
+		for(std::size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+			++n;
+		}
+		return n;
+	};
+
+	std::ifstream fin("../../../libcpuid/tests/data/dumps/aida64/intel/GenuineIntel0050654_SkylakeXeon_CPUID6.txt");
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	fmt::memory_buffer out;
+	cpuid::print_dump(out, logical_cpus, cpuid::file_format::cpuinfo);
+	const std::string text = to_string(out);
+	EXPECT_EQ(0, text.find("processor       : 0\n"
+	                       "vendor_id       : GenuineIntel\n"
+	                       "cpu family      : 6\n"
+	                       "model           : 85\n"
+	                       "model name      : Intel(R) Xeon(R) Platinum 8180 CPU @ 2.50GHz\n"
+	                       "stepping        : 4\n"
+	                       "microcode       : 0xffffffff\n"
+	                       "cpu MHz         : 2500 MHz\n"
+	                       "cache size      : 39424 KB\n"
+	                       "physical id     : 0\n"
+	                       "siblings        : 56\n"));
+	EXPECT_EQ(112, count(text, "model name      : Intel(R) Xeon(R) Platinum 8180 CPU @ 2.50GHz\n"));
+	EXPECT_NE(std::string::npos, text.find("\n\nprocessor       : 111\n"));
+
+	// without leaf 0x16, the frequency comes from the brand string
+	for(auto& c : logical_cpus) {
+		c.second.leaves.erase(cpuid::leaf_type::processor_frequency);
+	}
+	fmt::memory_buffer from_brand;
+	cpuid::print_dump(from_brand, logical_cpus, cpuid::file_format::cpuinfo);
+	EXPECT_EQ(112, count(to_string(from_brand), "cpu MHz         : 2500 MHz\n"));
+
+	// a 486 has no brand string at all
+	std::ifstream old_fin("../../../libcpuid/tests/data/dumps/aida64/intel/GenuineIntel0000480_486_CPUID.txt");
+	const std::map<std::uint32_t, cpuid::cpu_t> old_cpus = cpuid::enumerate_file(old_fin, cpuid::file_format::aida64);
+	fmt::memory_buffer old_out;
+	EXPECT_NO_THROW(cpuid::print_dump(old_out, old_cpus, cpuid::file_format::cpuinfo));
+	EXPECT_NE(std::string::npos, to_string(old_out).find("model name      : \nstepping"));
+	EXPECT_NE(std::string::npos, to_string(old_out).find("cpu MHz         : 0 MHz\n"));
+}
+
+TEST(CpuidDiffTest, LeafDifferencesTest) {
+	std::ifstream fin(threadripper_dump);
+	const cpuid::cpu_t original = cpuid::enumerate_file(fin, cpuid::file_format::aida64).at(0_u32);
+	const auto with_ebx = [&original] (std::uint32_t ebx) {
+		cpuid::cpu_t cpu = original;
+		cpu.leaves.at(cpuid::leaf_type::extended_features).at(cpuid::subleaf_type::main)[cpuid::ebx] = ebx;
+		return cpu;
+	};
+	const std::uint32_t ebx = original.leaves.at(cpuid::leaf_type::extended_features).at(cpuid::subleaf_type::main)[cpuid::ebx];
+
+	// four CPUs alike but for one register of leaf 7, and one that lacks the address limits leaf
+	std::map<std::uint32_t, cpuid::cpu_t> logical_cpus = { { 0_u32, original }, { 1_u32, original }, { 2_u32, with_ebx(ebx ^ 0x20_u32) }, { 3_u32, with_ebx(ebx ^ 0x20_u32) } };
+	logical_cpus.at(1_u32).leaves.erase(cpuid::leaf_type::address_limits);
+
+	fmt::memory_buffer out;
+	cpuid::print_leaf_differences(out, logical_cpus, { 0_u32, 1_u32, 2_u32, 3_u32 }, false, false);
+	const std::string text = to_string(out);
+	EXPECT_EQ(0, text.find("Identical on all 4 CPUs:\n\n"));
+	const std::size_t leaf_7 = text.find("\x1b[33;1mLeaf 0x00000007 differs in 0x0:EBX\x1b[0m\napic ids 0-1:\n");
+	ASSERT_NE(std::string::npos, leaf_7);
+	EXPECT_NE(std::string::npos, text.find("apic ids 2-3:\n", leaf_7));
+	EXPECT_NE(std::string::npos, text.find("\x1b[33;1mLeaf 0x80000008 differs in presence\x1b[0m\nabsent on apic ids 1\napic ids 0,2-3:\n"));
+	// the shared leaves come before any that differ, and nothing else differs
+	EXPECT_LT(text.find("Basic Information\n"), leaf_7);
+	std::size_t differing = 0;
+	for(std::size_t pos = text.find(" differs in "); pos != std::string::npos; pos = text.find(" differs in ", pos + 1)) {
+		++differing;
+	}
+	EXPECT_EQ(2, differing);
+
+	// beyond a handful of classes, only the differing registers are listed
+	std::map<std::uint32_t, cpuid::cpu_t> distinct;
+	std::vector<std::uint32_t> apic_ids;
+	for(std::uint32_t i = 0_u32; i < 6_u32; ++i) {
+		distinct.insert({ i, with_ebx(i) });
+		apic_ids.push_back(i);
+	}
+	fmt::memory_buffer compact;
+	cpuid::print_leaf_differences(compact, distinct, apic_ids, false, false);
+	EXPECT_NE(std::string::npos, to_string(compact).find("apic ids 3:\n"));
+	EXPECT_NE(std::string::npos, to_string(compact).find("\napic ids 4: 0x0:EBX=0x00000004\napic ids 5: 0x0:EBX=0x00000005\n\n"));
+}
+
+TEST(CpuidDeltaDumpTest, RoundTripTest) {
+	std::ifstream fin("../../../libcpuid/tests/data/dumps/aida64/intel/GenuineIntel0050654_SkylakeXeon_CPUID6.txt");
+	const std::map<std::uint32_t, cpuid::cpu_t> baseline = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	ASSERT_EQ(112, baseline.size());
+
+	fmt::memory_buffer unchanged;
+	cpuid::print_delta_dump(unchanged, baseline, baseline);
+	EXPECT_EQ(fmt::format("#cpuid delta: apply to the baseline dump with this hash\nbaseline {:016x}\n", cpuid::dump_hash(baseline)), to_string(unchanged));
+
+	std::map<std::uint32_t, cpuid::cpu_t> current = baseline;
+	for(auto& c : current) {
+		c.second.leaves.at(cpuid::leaf_type::extended_features).at(cpuid::subleaf_type::main)[cpuid::ebx] &= ~0x0001'0000_u32;
+	}
+	current.begin()->second.leaves.erase(cpuid::leaf_type::extended_features);
+	current.erase(current.rbegin()->first);
+
+	fmt::memory_buffer delta;
+	cpuid::print_delta_dump(delta, baseline, current);
+	EXPECT_EQ(5, std::count(delta.data(), delta.data() + delta.size(), '\n'));
+
+	std::istringstream delta_in(to_string(delta));
+	EXPECT_EQ(current, cpuid::enumerate_file(delta_in, baseline));
+
+	std::istringstream wrong_baseline(to_string(delta));
+	EXPECT_THROW(cpuid::enumerate_file(wrong_baseline, current), std::runtime_error);
+}
+
+TEST(CpuidDeltaDumpTest, OsIndexTest) {
+	std::ifstream fin(threadripper_dump);
+	std::map<std::uint32_t, cpuid::cpu_t> unnumbered = cpuid::enumerate_file(fin, cpuid::file_format::aida64);
+	std::map<std::uint32_t, cpuid::cpu_t> baseline = unnumbered;
+	number_like_linux(baseline);
+
+	// learning every CPU's number is a line for each of them, and nothing else
+	fmt::memory_buffer learned;
+	cpuid::print_delta_dump(learned, unnumbered, baseline);
+	EXPECT_EQ(26, std::count(learned.data(), learned.data() + learned.size(), '\n'));
+	std::istringstream learned_in(to_string(learned));
+	EXPECT_EQ(baseline, cpuid::enumerate_file(learned_in, unnumbered));
+
+	// two CPUs swap numbers, and the last one's is lost
+	std::map<std::uint32_t, cpuid::cpu_t> current = baseline;
+	std::swap(current.at(0x00_u32).os_index, current.at(0x01_u32).os_index);
+	current.rbegin()->second.os_index = cpuid::unknown_id;
+
+	fmt::memory_buffer delta;
+	cpuid::print_delta_dump(delta, baseline, current);
+	EXPECT_NE(std::string::npos, to_string(delta).find("#os 0x00000000 12\n#os 0x00000001 0\n#os 0x0000001d -\n"));
+	EXPECT_EQ(5, std::count(delta.data(), delta.data() + delta.size(), '\n'));
+
+	std::istringstream delta_in(to_string(delta));
+	EXPECT_EQ(current, cpuid::enumerate_file(delta_in, baseline));
+}
+
 INSTANTIATE_TEST_SUITE_P(CpuidFullTests, CpuidFlagCrackingTest, ::testing::ValuesIn(flag_specs), flag_spec_param_printer);
 INSTANTIATE_TEST_SUITE_P(CpuidFullTests, CpuidFileParserTest, ::testing::ValuesIn(file_specs), file_spec_param_printer);
 